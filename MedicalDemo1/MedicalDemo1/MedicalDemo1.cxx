@@ -14,39 +14,103 @@
 #include <vtkRenderWindow.h>
 #include <vtkRenderWindowInteractor.h>
 #include <vtkRenderer.h>
-#include <vtkVersion.h>
 
-// vtkFlyingEdges3D was introduced in VTK >= 8.2
-#if VTK_MAJOR_VERSION >= 9 || (VTK_MAJOR_VERSION >= 8 && VTK_MINOR_VERSION >= 2)
-#define USE_FLYING_EDGES
-#else
-#undef USE_FLYING_EDGES
-#endif
-
-#ifdef USE_FLYING_EDGES
-#include <vtkFlyingEdges3D.h>
-#else
-#include <vtkMarchingCubes.h>
-#endif
+// Isosurfaces are extracted and cached by the shared isosuperficies.h helper:
+// one marching-cubes pass over the volume, split in z blocks across threads,
+// yields every isovalue at once (TVG_ISOSUPERFICIES=vtk switches to one
+// vtkFlyingEdges3D per isovalue instead).
+#include "isosuperficies.h"
+// Quarter-resolution preview read while the full volume loads.
+#include "cargaProgresiva.h"
+// Offscreen batch rendering of camera views to PNG.
+#include "renderLotes.h"
+// Per-frame render time, triangle count and memory log / overlay.
+#include "metricas.h"
 
 #include <array>
+#include <memory>
+#include <string>
+
+namespace {
+// The pipeline objects of the scene, shared by the viewer and the batch mode.
+struct Scene
+{
+  vtkNew<vtkPolyDataMapper> skinMapper;
+  vtkNew<vtkActor> skin;
+  vtkNew<vtkProperty> backProp;
+  vtkNew<vtkOutlineFilter> outlineData;
+  vtkNew<vtkPolyDataMapper> mapOutline;
+  vtkNew<vtkActor> outline;
+  vtkNew<vtkCamera> camera;
+};
+
+void BuildScene(Scene& scene, vtkRenderer* aRenderer, vtkImageData* volume,
+                vtkPolyData* skinSurface);
+std::shared_ptr<void> BuildBatchScene(const std::string& fileName,
+                                      vtkRenderer* renderer);
+} // namespace
 
 int main(int argc, char* argv[])
 {
-  if (argc < 2)
+  // Offscreen batch mode: render the camera views of every volume to PNG.
+  if (renderLotes::Pedido(argc, argv))
   {
-    cout << "Usage: " << argv[0] << " file.mhd e.g. FullHead.mhd" << endl;
-    return EXIT_FAILURE;
+    renderLotes::Opciones options;
+    if (!renderLotes::AnalizarArgumentos(argc, argv, options))
+    {
+      cout << "Usage: " << argv[0] << endl;
+      renderLotes::Uso(argv[0]);
+      return EXIT_FAILURE;
+    }
+    return renderLotes::Ejecutar(options, BuildBatchScene) > 0 ? EXIT_SUCCESS
+                                                                : EXIT_FAILURE;
   }
 
-  vtkNew<vtkNamedColors> colors;
+  // Options after the file name. --metrics writes the render time,
+  // triangle count, memory estimate and setup stage times of every frame to
+  // a CSV (or .json) file; --overlay draws them over the scene.
+  bool progressive = false;
+  bool overlay = false;
+  std::string metricsFile;
+  bool validOptions = argc >= 2;
+  for (int i = 2; i < argc && validOptions; ++i)
+  {
+    const std::string arg = argv[i];
+    if (arg == "--progressive")
+    {
+      progressive = true;
+    }
+    else if (arg == "--overlay")
+    {
+      overlay = true;
+    }
+    else if (arg == "--metrics" && i + 1 < argc)
+    {
+      metricsFile = argv[++i];
+    }
+    else
+    {
+      validOptions = false;
+    }
+  }
+  if (!validOptions)
+  {
+    cout << "Usage: " << argv[0]
+         << " file.mhd [--progressive] [--metrics log.csv|log.json]"
+            " [--overlay] e.g. FullHead.mhd"
+         << endl;
+    renderLotes::Uso(argv[0]);
+    return EXIT_FAILURE;
+  }
 
-  std::array<unsigned char, 4> skinColor{{240, 184, 160, 255}};
-  colors->SetColor("SkinColor", skinColor.data());
-  std::array<unsigned char, 4> backColor{{255, 229, 200, 255}};
-  colors->SetColor("BackfaceColor", backColor.data());
-  std::array<unsigned char, 4> bkg{{51, 77, 102, 255}};
-  colors->SetColor("BkgColor", bkg.data());
+  // With --progressive a 1/4 resolution copy of the volume (read with a
+  // strided pass over the file) is shown first, and the full resolution
+  // skin replaces it once it has been read in the background.
+  vtkSmartPointer<vtkImageData> preview;
+  if (progressive)
+  {
+    preview = cargaProgresiva::LeerReducido(argv[1], 4);
+  }
 
   // Create the renderer, the render window, and the interactor. The renderer
   // draws into the render window, the interactor enables mouse- and
@@ -63,46 +127,111 @@ int main(int argc, char* argv[])
   reader->SetFileName(argv[1]);
 
   // An isosurface, or contour value of 500 is known to correspond to the
-  // skin of the patient.
-#ifdef USE_FLYING_EDGES
-  vtkNew<vtkFlyingEdges3D> skinExtractor;
-#else
-  vtkNew<vtkMarchingCubes> skinExtractor;
-#endif
+  // skin of the patient. It is loaded from the isosurface cache when this
+  // volume has been seen before, otherwise extracted by the single-pass
+  // marching cubes and stored. The preview is small enough to be contoured
+  // directly.
+  std::vector<vtkSmartPointer<vtkPolyData>> surfaces;
+  if (preview)
+  {
+    surfaces = isosuperficies::ExtraerVarias(preview, {500});
+    if (surfaces.empty())
+    {
+      // Nothing comes back for previews the single-pass contouring cannot
+      // handle (several components, an unknown scalar type, a flat
+      // volume): skip the preview and load the full volume now.
+      preview = nullptr;
+    }
+  }
+  if (!preview)
+  {
+    {
+      metricas::Cronometro readTime(metricas::Lectura);
+      reader->Update();
+    }
+    surfaces = isosuperficies::Obtener(
+      reader->GetOutput(), {500}, isosuperficies::DirectorioCache(argv[1]));
+  }
 
-  skinExtractor->SetInputConnection(reader->GetOutputPort());
-  skinExtractor->SetValue(0, 500);
+  Scene scene;
+  BuildScene(scene, aRenderer,
+             preview ? preview.Get() : reader->GetOutput(), surfaces[0]);
 
-  vtkNew<vtkPolyDataMapper> skinMapper;
-  skinMapper->SetInputConnection(skinExtractor->GetOutputPort());
-  skinMapper->ScalarVisibilityOff();
+  metricas::Monitor monitor;
+  if ((!metricsFile.empty() || overlay) &&
+      !monitor.Iniciar(aRenderer, metricsFile, overlay))
+  {
+    return EXIT_FAILURE;
+  }
 
-  vtkNew<vtkActor> skin;
-  skin->SetMapper(skinMapper);
-  skin->GetProperty()->SetDiffuseColor(
+  // Set the size of the render window (expressed in pixels).
+  renWin->SetSize(640, 480);
+  renWin->SetWindowName("MedicalDemo1");
+
+  // Initialize the event loop and then start it. In progressive mode the
+  // full volume is read and contoured on a background thread and swapped in
+  // from a timer once it is ready.
+  renWin->Render();
+  iren->Initialize();
+  std::vector<vtkSmartPointer<vtkPolyData>> fullSurfaces;
+  cargaProgresiva::Carga fullLoad;
+  if (preview)
+  {
+    const std::string cacheDir = isosuperficies::DirectorioCache(argv[1]);
+    fullLoad.Iniciar(
+      argv[1], iren,
+      [&fullSurfaces, cacheDir](vtkImageData* volume) {
+        fullSurfaces = isosuperficies::Obtener(volume, {500}, cacheDir);
+      },
+      [&](vtkImageData* volume) {
+        scene.skinMapper->SetInputData(fullSurfaces[0]);
+        scene.outlineData->SetInputData(volume);
+      });
+  }
+  iren->Start();
+
+  return EXIT_SUCCESS;
+}
+
+namespace {
+void BuildScene(Scene& scene, vtkRenderer* aRenderer, vtkImageData* volume,
+                vtkPolyData* skinSurface)
+{
+  vtkNew<vtkNamedColors> colors;
+
+  std::array<unsigned char, 4> skinColor{{240, 184, 160, 255}};
+  colors->SetColor("SkinColor", skinColor.data());
+  std::array<unsigned char, 4> backColor{{255, 229, 200, 255}};
+  colors->SetColor("BackfaceColor", backColor.data());
+  std::array<unsigned char, 4> bkg{{51, 77, 102, 255}};
+  colors->SetColor("BkgColor", bkg.data());
+
+  scene.skinMapper->SetInputData(skinSurface);
+  scene.skinMapper->ScalarVisibilityOff();
+
+  scene.skin->SetMapper(scene.skinMapper);
+  scene.skin->GetProperty()->SetDiffuseColor(
       colors->GetColor3d("SkinColor").GetData());
 
-  vtkNew<vtkProperty> backProp;
-  backProp->SetDiffuseColor(colors->GetColor3d("BackfaceColor").GetData());
-  skin->SetBackfaceProperty(backProp);
+  scene.backProp->SetDiffuseColor(
+      colors->GetColor3d("BackfaceColor").GetData());
+  scene.skin->SetBackfaceProperty(scene.backProp);
 
   // An outline provides context around the data.
   //
-  vtkNew<vtkOutlineFilter> outlineData;
-  outlineData->SetInputConnection(reader->GetOutputPort());
+  scene.outlineData->SetInputData(volume);
 
-  vtkNew<vtkPolyDataMapper> mapOutline;
-  mapOutline->SetInputConnection(outlineData->GetOutputPort());
+  scene.mapOutline->SetInputConnection(scene.outlineData->GetOutputPort());
 
-  vtkNew<vtkActor> outline;
-  outline->SetMapper(mapOutline);
-  outline->GetProperty()->SetColor(colors->GetColor3d("Black").GetData());
+  scene.outline->SetMapper(scene.mapOutline);
+  scene.outline->GetProperty()->SetColor(
+      colors->GetColor3d("Black").GetData());
 
   // It is convenient to create an initial view of the data. The FocalPoint
   // and Position form a vector direction. Later on (ResetCamera() method)
   // this vector is used to position the camera to look at the data in
   // this direction.
-  vtkNew<vtkCamera> aCamera;
+  vtkCamera* aCamera = scene.camera;
   aCamera->SetViewUp(0, 0, -1);
   aCamera->SetPosition(0, -1, 0);
   aCamera->SetFocalPoint(0, 0, 0);
@@ -113,17 +242,14 @@ int main(int argc, char* argv[])
   // Actors are added to the renderer. An initial camera view is created.
   // The Dolly() method moves the camera towards the FocalPoint,
   // thereby enlarging the image.
-  aRenderer->AddActor(outline);
-  aRenderer->AddActor(skin);
+  aRenderer->AddActor(scene.outline);
+  aRenderer->AddActor(scene.skin);
   aRenderer->SetActiveCamera(aCamera);
   aRenderer->ResetCamera();
   aCamera->Dolly(1.5);
 
-  // Set a background color for the renderer and set the size of the
-  // render window (expressed in pixels).
+  // Set a background color for the renderer.
   aRenderer->SetBackground(colors->GetColor3d("BkgColor").GetData());
-  renWin->SetSize(640, 480);
-  renWin->SetWindowName("MedicalDemo1");
 
   // Note that when camera movement occurs (as it does in the Dolly()
   // method), the clipping planes often need adjusting. Clipping planes
@@ -132,11 +258,21 @@ int main(int argc, char* argv[])
   // clips out objects behind the plane. This way only what is drawn
   // between the planes is actually rendered.
   aRenderer->ResetCameraClippingRange();
+}
 
-  // Initialize the event loop and then start it.
-  renWin->Render();
-  iren->Initialize();
-  iren->Start();
+// Reads 'fileName' with its own reader and builds the scene in 'renderer';
+// called from the batch worker threads.
+std::shared_ptr<void> BuildBatchScene(const std::string& fileName,
+                                      vtkRenderer* renderer)
+{
+  vtkNew<vtkMetaImageReader> reader;
+  reader->SetFileName(fileName.c_str());
+  reader->Update();
+  auto surfaces = isosuperficies::Obtener(
+    reader->GetOutput(), {500}, isosuperficies::DirectorioCache(fileName));
 
-  return EXIT_SUCCESS;
+  auto scene = std::make_shared<Scene>();
+  BuildScene(*scene, renderer, reader->GetOutput(), surfaces[0]);
+  return scene;
 }
+} // namespace
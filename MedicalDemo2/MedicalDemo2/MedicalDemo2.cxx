@@ -14,39 +14,106 @@
 #include <vtkRenderWindow.h>
 #include <vtkRenderWindowInteractor.h>
 #include <vtkRenderer.h>
-#include <vtkStripper.h>
-#include <vtkVersion.h>
-
-// vtkFlyingEdges3D was introduced in VTK >= 8.2
-#if VTK_MAJOR_VERSION >= 9 || (VTK_MAJOR_VERSION >= 8 && VTK_MINOR_VERSION >= 2)
-#define USE_FLYING_EDGES
-#else
-#undef USE_FLYING_EDGES
-#endif
-
-#ifdef USE_FLYING_EDGES
-#include <vtkFlyingEdges3D.h>
-#else
-#include <vtkMarchingCubes.h>
-#endif
+
+// Isosurfaces are extracted and cached by the shared isosuperficies.h helper:
+// one marching-cubes pass over the volume, split in z blocks across threads,
+// yields every isovalue at once (TVG_ISOSUPERFICIES=vtk switches to one
+// vtkFlyingEdges3D per isovalue instead).
+#include "isosuperficies.h"
+// Decimated levels of detail used while the camera moves.
+#include "nivelesDetalle.h"
+// Quarter-resolution preview read while the full volume loads.
+#include "cargaProgresiva.h"
+// Offscreen batch rendering of camera views to PNG.
+#include "renderLotes.h"
+// Per-frame render time, triangle count and memory log / overlay.
+#include "metricas.h"
 
 #include <array>
+#include <memory>
+#include <string>
+
+namespace {
+// The pipeline objects of the scene, shared by the viewer and the batch mode.
+struct Scene
+{
+  vtkNew<vtkPolyDataMapper> skinMapper;
+  vtkNew<vtkActor> skin;
+  vtkNew<vtkPolyDataMapper> boneMapper;
+  vtkNew<vtkActor> bone;
+  vtkNew<vtkOutlineFilter> outlineData;
+  vtkNew<vtkPolyDataMapper> mapOutline;
+  vtkNew<vtkActor> outline;
+  vtkNew<vtkCamera> camera;
+};
+
+void BuildScene(Scene& scene, vtkRenderer* aRenderer, vtkImageData* volume,
+                const std::vector<vtkSmartPointer<vtkPolyData>>& surfaces);
+std::shared_ptr<void> BuildBatchScene(const std::string& fileName,
+                                      vtkRenderer* renderer);
+} // namespace
 
 int main(int argc, char* argv[])
 {
-  if (argc < 2)
+  // Offscreen batch mode: render the camera views of every volume to PNG.
+  if (renderLotes::Pedido(argc, argv))
   {
-    cout << "Usage: " << argv[0] << " file.mhd e.g. FullHead.mhd" << endl;
-    return EXIT_FAILURE;
+    renderLotes::Opciones options;
+    if (!renderLotes::AnalizarArgumentos(argc, argv, options))
+    {
+      cout << "Usage: " << argv[0] << endl;
+      renderLotes::Uso(argv[0]);
+      return EXIT_FAILURE;
+    }
+    return renderLotes::Ejecutar(options, BuildBatchScene) > 0 ? EXIT_SUCCESS
+                                                                : EXIT_FAILURE;
   }
 
-  vtkNew<vtkNamedColors> colors;
+  // Options after the file name. --metrics writes the render time,
+  // triangle count, memory estimate and setup stage times of every frame to
+  // a CSV (or .json) file; --overlay draws them over the scene.
+  bool progressive = false;
+  bool overlay = false;
+  std::string metricsFile;
+  bool validOptions = argc >= 2;
+  for (int i = 2; i < argc && validOptions; ++i)
+  {
+    const std::string arg = argv[i];
+    if (arg == "--progressive")
+    {
+      progressive = true;
+    }
+    else if (arg == "--overlay")
+    {
+      overlay = true;
+    }
+    else if (arg == "--metrics" && i + 1 < argc)
+    {
+      metricsFile = argv[++i];
+    }
+    else
+    {
+      validOptions = false;
+    }
+  }
+  if (!validOptions)
+  {
+    cout << "Usage: " << argv[0]
+         << " file.mhd [--progressive] [--metrics log.csv|log.json]"
+            " [--overlay] e.g. FullHead.mhd"
+         << endl;
+    renderLotes::Uso(argv[0]);
+    return EXIT_FAILURE;
+  }
 
-  // Set the colors.
-  std::array<unsigned char, 4> skinColor{{240, 184, 160, 255}};
-  colors->SetColor("SkinColor", skinColor.data());
-  std::array<unsigned char, 4> bkg{{51, 77, 102, 255}};
-  colors->SetColor("BkgColor", bkg.data());
+  // With --progressive a 1/4 resolution copy of the volume (read with a
+  // strided pass over the file) is shown first, and the full resolution
+  // surfaces replace it once they have been read in the background.
+  vtkSmartPointer<vtkImageData> preview;
+  if (progressive)
+  {
+    preview = cargaProgresiva::LeerReducido(argv[1], 4);
+  }
 
   // Create the renderer, the render window, and the interactor. The renderer
   // draws into the render window, the interactor enables mouse- and
@@ -69,68 +136,133 @@ int main(int argc, char* argv[])
   reader->SetFileName(argv[1]);
 
   // An isosurface, or contour value of 500 is known to correspond to the
-  // skin of the patient.
+  // skin of the patient, and 1150 to the bone.
   // The triangle stripper is used to create triangle strips from the
-  // isosurface; these render much faster on many systems.
-#ifdef USE_FLYING_EDGES
-  vtkNew<vtkFlyingEdges3D> skinExtractor;
-#else
-  vtkNew<vtkMarchingCubes> skinExtractor;
-#endif
-  skinExtractor->SetInputConnection(reader->GetOutputPort());
-  skinExtractor->SetValue(0, 500);
-
-  vtkNew<vtkStripper> skinStripper;
-  skinStripper->SetInputConnection(skinExtractor->GetOutputPort());
+  // isosurfaces; these render much faster on many systems. The stripped
+  // surfaces come from the isosurface cache when this volume has been seen
+  // before; otherwise both come out of one marching-cubes pass over the
+  // volume (threaded over z blocks) and are stored. The preview is small
+  // enough to be contoured directly.
+  std::vector<vtkSmartPointer<vtkPolyData>> surfaces;
+  if (preview)
+  {
+    surfaces = isosuperficies::ExtraerVarias(preview, {500, 1150});
+    if (surfaces.empty())
+    {
+      // Nothing comes back for previews the single-pass contouring cannot
+      // handle (several components, an unknown scalar type, a flat
+      // volume): skip the preview and load the full volume now.
+      preview = nullptr;
+    }
+  }
+  if (!preview)
+  {
+    {
+      metricas::Cronometro readTime(metricas::Lectura);
+      reader->Update();
+    }
+    surfaces = isosuperficies::Obtener(reader->GetOutput(), {500, 1150},
+                                       isosuperficies::DirectorioCache(argv[1]));
+  }
 
-  vtkNew<vtkPolyDataMapper> skinMapper;
-  skinMapper->SetInputConnection(skinStripper->GetOutputPort());
-  skinMapper->ScalarVisibilityOff();
+  Scene scene;
+  BuildScene(scene, aRenderer,
+             preview ? preview.Get() : reader->GetOutput(), surfaces);
 
-  vtkNew<vtkActor> skin;
-  skin->SetMapper(skinMapper);
-  skin->GetProperty()->SetDiffuseColor(
-      colors->GetColor3d("SkinColor").GetData());
-  skin->GetProperty()->SetSpecular(0.3);
-  skin->GetProperty()->SetSpecularPower(20);
-  skin->GetProperty()->SetOpacity(0.5);
+  metricas::Monitor monitor;
+  if ((!metricsFile.empty() || overlay) &&
+      !monitor.Iniciar(aRenderer, metricsFile, overlay))
+  {
+    return EXIT_FAILURE;
+  }
 
-  // An isosurface, or contour value of 1150 is known to correspond to the
-  // bone of the patient.
-  // The triangle stripper is used to create triangle strips from the
-  // isosurface; these render much faster on may systems.
-  vtkNew<vtkFlyingEdges3D> boneExtractor;
-  boneExtractor->SetInputConnection(reader->GetOutputPort());
-  boneExtractor->SetValue(0, 1150);
+  // Set the size of the render window (expressed in pixels).
+  renWin->SetSize(640, 480);
+  renWin->SetWindowName("MedicalDemo2");
 
-  vtkNew<vtkStripper> boneStripper;
-  boneStripper->SetInputConnection(boneExtractor->GetOutputPort());
+  // Initialize the event loop and then start it. The decimated levels of
+  // the skin and bone are built in the background and used while the
+  // camera is moving. In progressive mode the full volume is read and
+  // contoured on a background thread and swapped in from a timer; the levels
+  // of detail are then built from the full resolution surfaces.
+  renWin->Render();
+  iren->Initialize();
+  nivelesDetalle::Conmutador lod;
+  std::vector<vtkSmartPointer<vtkPolyData>> fullSurfaces;
+  cargaProgresiva::Carga fullLoad;
+  if (preview)
+  {
+    const std::string cacheDir = isosuperficies::DirectorioCache(argv[1]);
+    fullLoad.Iniciar(
+      argv[1], iren,
+      [&fullSurfaces, cacheDir](vtkImageData* volume) {
+        fullSurfaces = isosuperficies::Obtener(volume, {500, 1150}, cacheDir);
+      },
+      [&](vtkImageData* volume) {
+        scene.skinMapper->SetInputData(fullSurfaces[0]);
+        scene.boneMapper->SetInputData(fullSurfaces[1]);
+        scene.outlineData->SetInputData(volume);
+        lod.Anadir(scene.skin, fullSurfaces[0]);
+        lod.Anadir(scene.bone, fullSurfaces[1]);
+        lod.Iniciar(aRenderer, iren);
+      });
+  }
+  else
+  {
+    lod.Anadir(scene.skin, surfaces[0]);
+    lod.Anadir(scene.bone, surfaces[1]);
+    lod.Iniciar(aRenderer, iren);
+  }
+  iren->Start();
 
-  vtkNew<vtkPolyDataMapper> boneMapper;
-  boneMapper->SetInputConnection(boneStripper->GetOutputPort());
-  boneMapper->ScalarVisibilityOff();
+  return EXIT_SUCCESS;
+}
 
-  vtkNew<vtkActor> bone;
-  bone->SetMapper(boneMapper);
-  bone->GetProperty()->SetDiffuseColor(colors->GetColor3d("Ivory").GetData());
+namespace {
+void BuildScene(Scene& scene, vtkRenderer* aRenderer, vtkImageData* volume,
+                const std::vector<vtkSmartPointer<vtkPolyData>>& surfaces)
+{
+  vtkNew<vtkNamedColors> colors;
+
+  // Set the colors.
+  std::array<unsigned char, 4> skinColor{{240, 184, 160, 255}};
+  colors->SetColor("SkinColor", skinColor.data());
+  std::array<unsigned char, 4> bkg{{51, 77, 102, 255}};
+  colors->SetColor("BkgColor", bkg.data());
+
+  scene.skinMapper->SetInputData(surfaces[0]);
+  scene.skinMapper->ScalarVisibilityOff();
+
+  scene.skin->SetMapper(scene.skinMapper);
+  scene.skin->GetProperty()->SetDiffuseColor(
+      colors->GetColor3d("SkinColor").GetData());
+  scene.skin->GetProperty()->SetSpecular(0.3);
+  scene.skin->GetProperty()->SetSpecularPower(20);
+  scene.skin->GetProperty()->SetOpacity(0.5);
+
+  // The bone isosurface (1150).
+  scene.boneMapper->SetInputData(surfaces[1]);
+  scene.boneMapper->ScalarVisibilityOff();
+
+  scene.bone->SetMapper(scene.boneMapper);
+  scene.bone->GetProperty()->SetDiffuseColor(
+      colors->GetColor3d("Ivory").GetData());
 
   // An outline provides context around the data.
   //
-  vtkNew<vtkOutlineFilter> outlineData;
-  outlineData->SetInputConnection(reader->GetOutputPort());
+  scene.outlineData->SetInputData(volume);
 
-  vtkNew<vtkPolyDataMapper> mapOutline;
-  mapOutline->SetInputConnection(outlineData->GetOutputPort());
+  scene.mapOutline->SetInputConnection(scene.outlineData->GetOutputPort());
 
-  vtkNew<vtkActor> outline;
-  outline->SetMapper(mapOutline);
-  outline->GetProperty()->SetColor(colors->GetColor3d("Black").GetData());
+  scene.outline->SetMapper(scene.mapOutline);
+  scene.outline->GetProperty()->SetColor(
+      colors->GetColor3d("Black").GetData());
 
   // It is convenient to create an initial view of the data. The FocalPoint
   // and Position form a vector direction. Later on (ResetCamera() method)
   // this vector is used to position the camera to look at the data in
   // this direction.
-  vtkNew<vtkCamera> aCamera;
+  vtkCamera* aCamera = scene.camera;
   aCamera->SetViewUp(0, 0, -1);
   aCamera->SetPosition(0, -1, 0);
   aCamera->SetFocalPoint(0, 0, 0);
@@ -141,18 +273,15 @@ int main(int argc, char* argv[])
   // Actors are added to the renderer. An initial camera view is created.
   // The Dolly() method moves the camera towards the FocalPoint,
   // thereby enlarging the image.
-  aRenderer->AddActor(outline);
-  aRenderer->AddActor(skin);
-  aRenderer->AddActor(bone);
+  aRenderer->AddActor(scene.outline);
+  aRenderer->AddActor(scene.skin);
+  aRenderer->AddActor(scene.bone);
   aRenderer->SetActiveCamera(aCamera);
   aRenderer->ResetCamera();
   aCamera->Dolly(1.5);
 
-  // Set a background color for the renderer and set the size of the
-  // render window (expressed in pixels).
+  // Set a background color for the renderer.
   aRenderer->SetBackground(colors->GetColor3d("BkgColor").GetData());
-  renWin->SetSize(640, 480);
-  renWin->SetWindowName("MedicalDemo2");
 
   // Note that when camera movement occurs (as it does in the Dolly()
   // method), the clipping planes often need adjusting. Clipping planes
@@ -161,11 +290,22 @@ int main(int argc, char* argv[])
   // clips out objects behind the plane. This way only what is drawn
   // between the planes is actually rendered.
   aRenderer->ResetCameraClippingRange();
+}
 
-  // Initialize the event loop and then start it.
-  renWin->Render();
-  iren->Initialize();
-  iren->Start();
+// Reads 'fileName' with its own reader and builds the scene in 'renderer';
+// called from the batch worker threads.
+std::shared_ptr<void> BuildBatchScene(const std::string& fileName,
+                                      vtkRenderer* renderer)
+{
+  vtkNew<vtkMetaImageReader> reader;
+  reader->SetFileName(fileName.c_str());
+  reader->Update();
+  auto surfaces =
+    isosuperficies::Obtener(reader->GetOutput(), {500, 1150},
+                            isosuperficies::DirectorioCache(fileName));
 
-  return EXIT_SUCCESS;
+  auto scene = std::make_shared<Scene>();
+  BuildScene(*scene, renderer, reader->GetOutput(), surfaces);
+  return scene;
 }
+} // namespace
@@ -3,11 +3,16 @@
 // represent the skin and bone, creates three orthogonal planes
 // (sagittal, axial, coronal), and displays them.
 //
+// The planes can be scrolled: x, y and z select the sagittal, coronal or
+// axial plane, Up/Down (or Ctrl + mouse wheel) move it one slice and
+// Page Up/Page Down ten slices.
+//
 #include <vtkActor.h>
+#include <vtkCallbackCommand.h>
 #include <vtkCamera.h>
+#include <vtkCommand.h>
 #include <vtkImageActor.h>
-#include <vtkImageMapToColors.h>
-#include <vtkImageMapper3D.h>
+#include <vtkImageData.h>
 #include <vtkLookupTable.h>
 #include <vtkMetaImageReader.h>
 #include <vtkNamedColors.h>
@@ -18,38 +23,193 @@
 #include <vtkRenderWindow.h>
 #include <vtkRenderWindowInteractor.h>
 #include <vtkRenderer.h>
-#include <vtkStripper.h>
-#include <vtkVersion.h>
-
-// vtkFlyingEdges3D was introduced in VTK >= 8.2
-#if VTK_MAJOR_VERSION >= 9 || (VTK_MAJOR_VERSION >= 8 && VTK_MINOR_VERSION >= 2)
-#define USE_FLYING_EDGES
-#else
-#undef USE_FLYING_EDGES
-#endif
-
-#ifdef USE_FLYING_EDGES
-#include <vtkFlyingEdges3D.h>
-#else
-#include <vtkMarchingCubes.h>
-#endif
+
+// Isosurfaces are extracted and cached by the shared isosuperficies.h helper:
+// one marching-cubes pass over the volume, split in z blocks across threads,
+// yields every isovalue at once (TVG_ISOSUPERFICIES=vtk switches to one
+// vtkFlyingEdges3D per isovalue instead).
+#include "isosuperficies.h"
+// Decimated levels of detail used while the camera moves.
+#include "nivelesDetalle.h"
+// Quarter-resolution preview read while the full volume loads.
+#include "cargaProgresiva.h"
+// Orthogonal planes coloured one slice at a time.
+#include "cortesColor.h"
+// Offscreen batch rendering of camera views to PNG.
+#include "renderLotes.h"
+// Per-frame render time, triangle count and memory log / overlay.
+#include "metricas.h"
 
 #include <array>
+#include <memory>
+#include <string>
+
+namespace {
+// Moves the selected plane from key presses and Ctrl + mouse wheel events.
+class SliceScroller
+{
+public:
+  SliceScroller(vtkRenderWindowInteractor* iren, cortesColor::Plano* planes[3])
+    : Interactor(iren)
+  {
+    for (int i = 0; i < 3; ++i)
+    {
+      this->Planes[i] = planes[i];
+    }
+    this->KeyCommand->SetCallback(&SliceScroller::OnKeyPress);
+    this->KeyCommand->SetClientData(this);
+    iren->AddObserver(vtkCommand::KeyPressEvent, this->KeyCommand);
+    // Observed before the interactor style so that Ctrl + wheel does not zoom
+    this->WheelCommand->SetCallback(&SliceScroller::OnWheel);
+    this->WheelCommand->SetClientData(this);
+    iren->AddObserver(vtkCommand::MouseWheelForwardEvent, this->WheelCommand, 1.0);
+    iren->AddObserver(vtkCommand::MouseWheelBackwardEvent, this->WheelCommand, 1.0);
+  }
+
+  ~SliceScroller()
+  {
+    this->Interactor->RemoveObserver(this->KeyCommand);
+    this->Interactor->RemoveObserver(this->WheelCommand);
+  }
+
+private:
+  void Scroll(int slices)
+  {
+    cortesColor::Plano* plane = this->Planes[this->Axis];
+    plane->Mostrar(plane->Indice() + slices);
+    this->Interactor->Render();
+  }
+
+  static void OnKeyPress(vtkObject*, unsigned long, void* clientData, void*)
+  {
+    auto* self = static_cast<SliceScroller*>(clientData);
+    const std::string key = self->Interactor->GetKeySym();
+    if (key == "x" || key == "y" || key == "z")
+    {
+      self->Axis = key[0] - 'x';
+      static const char* names[3] = {"Sagittal", "Coronal", "Axial"};
+      cout << names[self->Axis] << " plane selected" << endl;
+    }
+    else if (key == "Up" || key == "Down")
+    {
+      self->Scroll(key == "Up" ? 1 : -1);
+    }
+    else if (key == "Prior" || key == "Next")
+    {
+      self->Scroll(key == "Prior" ? 10 : -10);
+    }
+  }
+
+  static void OnWheel(vtkObject*, unsigned long event, void* clientData, void*)
+  {
+    auto* self = static_cast<SliceScroller*>(clientData);
+    if (!self->Interactor->GetControlKey())
+    {
+      return;
+    }
+    self->Scroll(event == vtkCommand::MouseWheelForwardEvent ? 1 : -1);
+    self->WheelCommand->AbortFlagOn();
+  }
+
+  vtkRenderWindowInteractor* Interactor;
+  cortesColor::Plano* Planes[3];
+  int Axis = 2;
+  vtkNew<vtkCallbackCommand> KeyCommand;
+  vtkNew<vtkCallbackCommand> WheelCommand;
+};
+
+// The pipeline objects of the scene, shared by the viewer and the batch mode.
+struct Scene
+{
+  vtkNew<vtkPolyDataMapper> skinMapper;
+  vtkNew<vtkActor> skin;
+  vtkNew<vtkPolyDataMapper> boneMapper;
+  vtkNew<vtkActor> bone;
+  vtkNew<vtkOutlineFilter> outlineData;
+  vtkNew<vtkPolyDataMapper> mapOutline;
+  vtkNew<vtkActor> outline;
+  vtkNew<vtkLookupTable> bwLut;
+  vtkNew<vtkLookupTable> hueLut;
+  vtkNew<vtkLookupTable> satLut;
+  vtkNew<vtkImageActor> sagittal;
+  vtkNew<vtkImageActor> axial;
+  vtkNew<vtkImageActor> coronal;
+  vtkNew<vtkCamera> camera;
+  // Declared after the actors and lookup tables they use.
+  cortesColor::Plano sagittalPlane{sagittal, bwLut, 0};
+  cortesColor::Plano axialPlane{axial, hueLut, 2};
+  cortesColor::Plano coronalPlane{coronal, satLut, 1};
+};
+
+void BuildScene(Scene& scene, vtkRenderer* aRenderer, vtkImageData* volume,
+                const std::vector<vtkSmartPointer<vtkPolyData>>& surfaces,
+                int factor);
+std::shared_ptr<void> BuildBatchScene(const std::string& fileName,
+                                      vtkRenderer* renderer);
+} // namespace
 
 int main(int argc, char* argv[])
 {
-  if (argc < 2)
+  // Offscreen batch mode: render the camera views of every volume to PNG.
+  if (renderLotes::Pedido(argc, argv))
   {
-    cout << "Usage: " << argv[0] << " file.mhd  e.g. FullHead.mhd" << endl;
-    return EXIT_FAILURE;
+    renderLotes::Opciones options;
+    if (!renderLotes::AnalizarArgumentos(argc, argv, options))
+    {
+      cout << "Usage: " << argv[0] << endl;
+      renderLotes::Uso(argv[0]);
+      return EXIT_FAILURE;
+    }
+    return renderLotes::Ejecutar(options, BuildBatchScene) > 0 ? EXIT_SUCCESS
+                                                                : EXIT_FAILURE;
   }
 
-  vtkNew<vtkNamedColors> colors;
+  // Options after the file name. --metrics writes the render time,
+  // triangle count, memory estimate and setup stage times of every frame to
+  // a CSV (or .json) file; --overlay draws them over the scene.
+  bool progressive = false;
+  bool overlay = false;
+  std::string metricsFile;
+  bool validOptions = argc >= 2;
+  for (int i = 2; i < argc && validOptions; ++i)
+  {
+    const std::string arg = argv[i];
+    if (arg == "--progressive")
+    {
+      progressive = true;
+    }
+    else if (arg == "--overlay")
+    {
+      overlay = true;
+    }
+    else if (arg == "--metrics" && i + 1 < argc)
+    {
+      metricsFile = argv[++i];
+    }
+    else
+    {
+      validOptions = false;
+    }
+  }
+  if (!validOptions)
+  {
+    cout << "Usage: " << argv[0]
+         << " file.mhd [--progressive] [--metrics log.csv|log.json]"
+            " [--overlay] e.g. FullHead.mhd"
+         << endl;
+    renderLotes::Uso(argv[0]);
+    return EXIT_FAILURE;
+  }
 
-  std::array<unsigned char, 4> skinColor{{240, 184, 160, 255}};
-  colors->SetColor("SkinColor", skinColor.data());
-  std::array<unsigned char, 4> bkg{{51, 77, 102, 255}};
-  colors->SetColor("BkgColor", bkg.data());
+  // With --progressive a 1/4 resolution copy of the volume (read with a
+  // strided pass over the file) is shown first, and the full resolution
+  // surfaces and planes replace it once they have been read in the
+  // background.
+  vtkSmartPointer<vtkImageData> preview;
+  if (progressive)
+  {
+    preview = cargaProgresiva::LeerReducido(argv[1], 4);
+  }
 
   // Create the renderer, the render window, and the interactor. The
   // renderer draws into the render window, the interactor enables
@@ -64,9 +224,7 @@ int main(int argc, char* argv[])
   vtkNew<vtkRenderWindowInteractor> iren;
   iren->SetRenderWindow(renWin);
 
-  // Set a background color for the renderer and set the size of the
-  // render window (expressed in pixels).
-  aRenderer->SetBackground(colors->GetColor3d("BkgColor").GetData());
+  // Set the size of the render window (expressed in pixels).
   renWin->SetSize(640, 480);
 
   // The following reader is used to read a series of 2D slices (images)
@@ -77,151 +235,193 @@ int main(int argc, char* argv[])
   // the FilePrefix is the root name of the file: quarter.)
   vtkNew<vtkMetaImageReader> reader;
   reader->SetFileName(argv[1]);
-  reader->Update();
 
   // An isosurface, or contour value of 500 is known to correspond to
-  // the skin of the patient.
+  // the skin of the patient, and 1150 to the bone.
   // The triangle stripper is used to create triangle
-  // strips from the isosurface; these render much faster on may
-  // systems.
-#ifdef USE_FLYING_EDGES
-  vtkNew<vtkFlyingEdges3D> skinExtractor;
-#else
-  vtkNew<vtkMarchingCubes> skinExtractor;
-#endif
-  skinExtractor->SetInputConnection(reader->GetOutputPort());
-  skinExtractor->SetValue(0, 500);
-  skinExtractor->Update();
-
-  vtkNew<vtkStripper> skinStripper;
-  skinStripper->SetInputConnection(skinExtractor->GetOutputPort());
-  skinStripper->Update();
+  // strips from the isosurfaces; these render much faster on may
+  // systems. The stripped surfaces come from the isosurface cache when
+  // this volume has been seen before; otherwise both come out of one
+  // marching-cubes pass over the volume (threaded over z blocks) and are
+  // stored. The preview is small enough to be contoured directly.
+  std::vector<vtkSmartPointer<vtkPolyData>> surfaces;
+  if (preview)
+  {
+    surfaces = isosuperficies::ExtraerVarias(preview, {500, 1150});
+    if (surfaces.empty())
+    {
+      // Nothing comes back for previews the single-pass contouring cannot
+      // handle (several components, an unknown scalar type, a flat
+      // volume): skip the preview and load the full volume now.
+      preview = nullptr;
+    }
+  }
+  if (!preview)
+  {
+    {
+      metricas::Cronometro readTime(metricas::Lectura);
+      reader->Update();
+    }
+    surfaces = isosuperficies::Obtener(reader->GetOutput(), {500, 1150},
+                                       isosuperficies::DirectorioCache(argv[1]));
+  }
+  vtkImageData* volume = preview ? preview.Get() : reader->GetOutput();
 
-  vtkNew<vtkPolyDataMapper> skinMapper;
-  skinMapper->SetInputConnection(skinStripper->GetOutputPort());
-  skinMapper->ScalarVisibilityOff();
+  // The initial slices are given for the full resolution volume; the
+  // preview has 1 of every 4 voxels along each axis.
+  Scene scene;
+  BuildScene(scene, aRenderer, volume, surfaces, preview ? 4 : 1);
 
-  vtkNew<vtkActor> skin;
-  skin->SetMapper(skinMapper);
-  skin->GetProperty()->SetDiffuseColor(
-      colors->GetColor3d("SkinColor").GetData());
-  skin->GetProperty()->SetSpecular(0.3);
-  skin->GetProperty()->SetSpecularPower(20);
+  metricas::Monitor monitor;
+  if ((!metricsFile.empty() || overlay) &&
+      !monitor.Iniciar(aRenderer, metricsFile, overlay))
+  {
+    return EXIT_FAILURE;
+  }
 
-  // An isosurface, or contour value of 1150 is known to correspond to
-  // the bone of the patient.
-  // The triangle stripper is used to create triangle
-  // strips from the isosurface; these render much faster on may
-  // systems.
-#ifdef USE_FLYING_EDGES
-  vtkNew<vtkFlyingEdges3D> boneExtractor;
-#else
-  vtkNew<vtkMarchingCubes> boneExtractor;
-#endif
-  boneExtractor->SetInputConnection(reader->GetOutputPort());
-  boneExtractor->SetValue(0, 1150);
-
-  vtkNew<vtkStripper> boneStripper;
-  boneStripper->SetInputConnection(boneExtractor->GetOutputPort());
+  // interact with data. The decimated levels of the skin and bone are
+  // built in the background and used while the camera is moving. In
+  // progressive mode the full volume is read and contoured on a background
+  // thread and swapped in from a timer; the levels of detail are then built
+  // from the full resolution surfaces.
+  iren->Initialize();
+  cortesColor::Plano* planes[3] = {&scene.sagittalPlane, &scene.coronalPlane,
+                                   &scene.axialPlane};
+  SliceScroller scroller(iren, planes);
+  nivelesDetalle::Conmutador lod;
+  std::vector<vtkSmartPointer<vtkPolyData>> fullSurfaces;
+  cargaProgresiva::Carga fullLoad;
+  if (preview)
+  {
+    const std::string cacheDir = isosuperficies::DirectorioCache(argv[1]);
+    fullLoad.Iniciar(
+      argv[1], iren,
+      [&fullSurfaces, cacheDir](vtkImageData* full) {
+        fullSurfaces = isosuperficies::Obtener(full, {500, 1150}, cacheDir);
+      },
+      [&](vtkImageData* full) {
+        scene.skinMapper->SetInputData(fullSurfaces[0]);
+        scene.boneMapper->SetInputData(fullSurfaces[1]);
+        scene.outlineData->SetInputData(full);
+        // Keep the slices the user scrolled to on the preview.
+        for (cortesColor::Plano* plane : planes)
+        {
+          const int slice = plane->Indice();
+          plane->FijarVolumen(full);
+          plane->Mostrar(slice * 4);
+        }
+        lod.Anadir(scene.skin, fullSurfaces[0]);
+        lod.Anadir(scene.bone, fullSurfaces[1]);
+        lod.Iniciar(aRenderer, iren);
+      });
+  }
+  else
+  {
+    lod.Anadir(scene.skin, surfaces[0]);
+    lod.Anadir(scene.bone, surfaces[1]);
+    lod.Iniciar(aRenderer, iren);
+  }
+  iren->Start();
 
-  vtkNew<vtkPolyDataMapper> boneMapper;
-  boneMapper->SetInputConnection(boneStripper->GetOutputPort());
-  boneMapper->ScalarVisibilityOff();
+  return EXIT_SUCCESS;
+}
 
-  vtkNew<vtkActor> bone;
-  bone->SetMapper(boneMapper);
-  bone->GetProperty()->SetDiffuseColor(colors->GetColor3d("Ivory").GetData());
+namespace {
+void BuildScene(Scene& scene, vtkRenderer* aRenderer, vtkImageData* volume,
+                const std::vector<vtkSmartPointer<vtkPolyData>>& surfaces,
+                int factor)
+{
+  vtkNew<vtkNamedColors> colors;
+
+  std::array<unsigned char, 4> skinColor{{240, 184, 160, 255}};
+  colors->SetColor("SkinColor", skinColor.data());
+  std::array<unsigned char, 4> bkg{{51, 77, 102, 255}};
+  colors->SetColor("BkgColor", bkg.data());
+
+  // Set a background color for the renderer.
+  aRenderer->SetBackground(colors->GetColor3d("BkgColor").GetData());
+
+  scene.skinMapper->SetInputData(surfaces[0]);
+  scene.skinMapper->ScalarVisibilityOff();
+
+  scene.skin->SetMapper(scene.skinMapper);
+  scene.skin->GetProperty()->SetDiffuseColor(
+      colors->GetColor3d("SkinColor").GetData());
+  scene.skin->GetProperty()->SetSpecular(0.3);
+  scene.skin->GetProperty()->SetSpecularPower(20);
+
+  // The bone isosurface (1150).
+  scene.boneMapper->SetInputData(surfaces[1]);
+  scene.boneMapper->ScalarVisibilityOff();
+
+  scene.bone->SetMapper(scene.boneMapper);
+  scene.bone->GetProperty()->SetDiffuseColor(
+      colors->GetColor3d("Ivory").GetData());
 
   // An outline provides context around the data.
   //
-  vtkNew<vtkOutlineFilter> outlineData;
-  outlineData->SetInputConnection(reader->GetOutputPort());
-  outlineData->Update();
+  scene.outlineData->SetInputData(volume);
+  scene.outlineData->Update();
 
-  vtkNew<vtkPolyDataMapper> mapOutline;
-  mapOutline->SetInputConnection(outlineData->GetOutputPort());
+  scene.mapOutline->SetInputConnection(scene.outlineData->GetOutputPort());
 
-  vtkNew<vtkActor> outline;
-  outline->SetMapper(mapOutline);
-  outline->GetProperty()->SetColor(colors->GetColor3d("Black").GetData());
+  scene.outline->SetMapper(scene.mapOutline);
+  scene.outline->GetProperty()->SetColor(
+      colors->GetColor3d("Black").GetData());
 
   // Now we are creating three orthogonal planes passing through the
   // volume. Each plane uses a different texture map and therefore has
   // different coloration.
 
   // Start by creating a black/white lookup table.
-  vtkNew<vtkLookupTable> bwLut;
-  bwLut->SetTableRange(0, 2000);
-  bwLut->SetSaturationRange(0, 0);
-  bwLut->SetHueRange(0, 0);
-  bwLut->SetValueRange(0, 1);
-  bwLut->Build(); // effective built
+  scene.bwLut->SetTableRange(0, 2000);
+  scene.bwLut->SetSaturationRange(0, 0);
+  scene.bwLut->SetHueRange(0, 0);
+  scene.bwLut->SetValueRange(0, 1);
+  scene.bwLut->Build(); // effective built
 
   // Now create a lookup table that consists of the full hue circle
   // (from HSV).
-  vtkNew<vtkLookupTable> hueLut;
-  hueLut->SetTableRange(0, 2000);
-  hueLut->SetHueRange(0, 1);
-  hueLut->SetSaturationRange(1, 1);
-  hueLut->SetValueRange(1, 1);
-  hueLut->Build(); // effective built
+  scene.hueLut->SetTableRange(0, 2000);
+  scene.hueLut->SetHueRange(0, 1);
+  scene.hueLut->SetSaturationRange(1, 1);
+  scene.hueLut->SetValueRange(1, 1);
+  scene.hueLut->Build(); // effective built
 
   // Finally, create a lookup table with a single hue but having a range
   // in the saturation of the hue.
-  vtkNew<vtkLookupTable> satLut;
-  satLut->SetTableRange(0, 2000);
-  satLut->SetHueRange(0.6, 0.6);
-  satLut->SetSaturationRange(0, 1);
-  satLut->SetValueRange(1, 1);
-  satLut->Build(); // effective built
-
-  // Create the first of the three planes. The filter vtkImageMapToColors
-  // maps the data through the corresponding lookup table created above. The
-  // vtkImageActor is a type of vtkProp and conveniently displays an image on
-  // a single quadrilateral plane. It does this using texture mapping and as
-  // a result is quite fast. (Note: the input image has to be unsigned char
-  // values, which the vtkImageMapToColors produces.) Note also that by
-  // specifying the DisplayExtent, the pipeline requests data of this extent
-  // and the vtkImageMapToColors only processes a slice of data.
-  vtkNew<vtkImageMapToColors> sagittalColors;
-  sagittalColors->SetInputConnection(reader->GetOutputPort());
-  sagittalColors->SetLookupTable(bwLut);
-  sagittalColors->Update();
-
-  vtkNew<vtkImageActor> sagittal;
-  sagittal->GetMapper()->SetInputConnection(sagittalColors->GetOutputPort());
-  sagittal->SetDisplayExtent(128, 128, 0, 255, 0, 92);
-  sagittal->ForceOpaqueOn();
-
-  // Create the second (axial) plane of the three planes. We use the
-  // same approach as before except that the extent differs.
-  vtkNew<vtkImageMapToColors> axialColors;
-  axialColors->SetInputConnection(reader->GetOutputPort());
-  axialColors->SetLookupTable(hueLut);
-  axialColors->Update();
-
-  vtkNew<vtkImageActor> axial;
-  axial->GetMapper()->SetInputConnection(axialColors->GetOutputPort());
-  axial->SetDisplayExtent(0, 255, 0, 255, 46, 46);
-  axial->ForceOpaqueOn();
-
-  // Create the third (coronal) plane of the three planes. We use
-  // the same approach as before except that the extent differs.
-  vtkNew<vtkImageMapToColors> coronalColors;
-  coronalColors->SetInputConnection(reader->GetOutputPort());
-  coronalColors->SetLookupTable(satLut);
-  coronalColors->Update();
-
-  vtkNew<vtkImageActor> coronal;
-  coronal->GetMapper()->SetInputConnection(coronalColors->GetOutputPort());
-  coronal->SetDisplayExtent(0, 255, 128, 128, 0, 92);
-  coronal->ForceOpaqueOn();
+  scene.satLut->SetTableRange(0, 2000);
+  scene.satLut->SetHueRange(0.6, 0.6);
+  scene.satLut->SetSaturationRange(0, 1);
+  scene.satLut->SetValueRange(1, 1);
+  scene.satLut->Build(); // effective built
+
+  // Show the three planes. Each plane colours only the slice it shows:
+  // the values of the lookup table are precomputed for every 16 bit scalar
+  // and the slice is mapped with one table lookup per voxel, instead of
+  // running vtkImageMapToColors over the whole volume. The vtkImageActor is
+  // a type of vtkProp and conveniently displays an image on a single
+  // quadrilateral plane. It does this using texture mapping and as a result
+  // is quite fast. Moving a plane maps only the new slice, and the mapped
+  // slices are kept in a small cache filled ahead of the scroll direction by
+  // a background thread. The sagittal plane uses the black/white lookup
+  // table, the axial plane the hue one and the coronal plane the saturation
+  // one.
+  scene.sagittal->ForceOpaqueOn();
+  scene.axial->ForceOpaqueOn();
+  scene.coronal->ForceOpaqueOn();
+  scene.sagittalPlane.FijarVolumen(volume);
+  scene.sagittalPlane.Mostrar(128 / factor);
+  scene.axialPlane.FijarVolumen(volume);
+  scene.axialPlane.Mostrar(46 / factor);
+  scene.coronalPlane.FijarVolumen(volume);
+  scene.coronalPlane.Mostrar(128 / factor);
 
   // It is convenient to create an initial view of the data. The
   // FocalPoint and Position form a vector direction. Later on
   // (ResetCamera() method) this vector is used to position the camera
   // to look at the data in this direction.
-  vtkNew<vtkCamera> aCamera;
+  vtkCamera* aCamera = scene.camera;
   aCamera->SetViewUp(0, 0, -1);
   aCamera->SetPosition(0, -1, 0);
   aCamera->SetFocalPoint(0, 0, 0);
@@ -230,18 +430,18 @@ int main(int argc, char* argv[])
   aCamera->Elevation(30.0);
 
   // Actors are added to the renderer.
-  aRenderer->AddActor(outline);
-  aRenderer->AddActor(sagittal);
-  aRenderer->AddActor(axial);
-  aRenderer->AddActor(coronal);
-  aRenderer->AddActor(skin);
-  aRenderer->AddActor(bone);
+  aRenderer->AddActor(scene.outline);
+  aRenderer->AddActor(scene.sagittal);
+  aRenderer->AddActor(scene.axial);
+  aRenderer->AddActor(scene.coronal);
+  aRenderer->AddActor(scene.skin);
+  aRenderer->AddActor(scene.bone);
 
   // Turn off bone for this example.
-  bone->VisibilityOff();
+  scene.bone->VisibilityOff();
 
   // Set skin to semi-transparent.
-  skin->GetProperty()->SetOpacity(0.5);
+  scene.skin->GetProperty()->SetOpacity(0.5);
 
   // An initial camera view is created. The Dolly() method moves
   // the camera towards the FocalPoint, thereby enlarging the image.
@@ -249,7 +449,7 @@ int main(int argc, char* argv[])
 
   // Calling Render() directly on a vtkRenderer is strictly forbidden.
   // Only calling Render() on the vtkRenderWindow is a valid call.
-  renWin->Render();
+  aRenderer->GetRenderWindow()->Render();
 
   aRenderer->ResetCamera();
   aCamera->Dolly(1.5);
@@ -261,10 +461,22 @@ int main(int argc, char* argv[])
   // clips out objects behind the plane. This way only what is drawn
   // between the planes is actually rendered.
   aRenderer->ResetCameraClippingRange();
+}
 
-  // interact with data
-  iren->Initialize();
-  iren->Start();
+// Reads 'fileName' with its own reader and builds the scene in 'renderer';
+// called from the batch worker threads.
+std::shared_ptr<void> BuildBatchScene(const std::string& fileName,
+                                      vtkRenderer* renderer)
+{
+  vtkNew<vtkMetaImageReader> reader;
+  reader->SetFileName(fileName.c_str());
+  reader->Update();
+  auto surfaces =
+    isosuperficies::Obtener(reader->GetOutput(), {500, 1150},
+                            isosuperficies::DirectorioCache(fileName));
 
-  return EXIT_SUCCESS;
+  auto scene = std::make_shared<Scene>();
+  BuildScene(*scene, renderer, reader->GetOutput(), surfaces, 1);
+  return scene;
 }
+} // namespace
@@ -1,10 +1,44 @@
 // Derived from VTK/Examples/Cxx/Medical4.cxx
 // This example reads a volume dataset and displays it via volume rendering.
 //
+// Usage: MedicalDemo4 file.mhd [options]
+//   --threads N[,N...]                 ray casting threads
+//   --sample-distance D[,D...]         distance between samples along a ray
+//   --image-sample-distance D[,D...]   distance between rays on the image
+//   --auto-adjust on|off               let the mapper trade quality for speed
+//   --fps F                            desired update rate (default 30)
+//   --size WxH                         window size (default 640x480)
+//   --skip-empty on|off                clip rays to the blocks that can be
+//                                      visible under the opacity function
+//                                      (default on). The opacity ramp starts
+//                                      at 0, so only blocks that are exactly
+//                                      0 are skipped
+//   --skip-threshold V                 also skip blocks whose maximum is
+//                                      below V (e.g. 300 for the air of a
+//                                      noisy CT). Changes the image: the
+//                                      faint opacity of those blocks is lost
+//   --progressive                      show a 1/4 resolution preview while
+//                                      the full volume loads in the
+//                                      background
+//   --benchmark [N]                    render N frames (default 36) offscreen
+//                                      along an orbit for every combination
+//                                      of the lists above and report timings
+//   --metrics log.csv|log.json         write the render time, memory estimate
+//                                      and read time of every frame
+//   --overlay                          draw those figures over the volume
+//
+// Without --benchmark the first value of each list is used interactively.
+//
+// Batch mode: MedicalDemo4 --batch <N|views.txt> <outputDir> [--threads N]
+//                           [--size WxH] file.mhd [file.mhd ...]
+// renders N orbit views (or the "azimuth elevation [zoom]" lines of
+// views.txt) of every volume offscreen to PNG files.
+//
 
 #include <vtkCamera.h>
 #include <vtkColorTransferFunction.h>
 #include <vtkFixedPointVolumeRayCastMapper.h>
+#include <vtkImageData.h>
 #include <vtkMetaImageReader.h>
 #include <vtkNamedColors.h>
 #include <vtkNew.h>
@@ -15,20 +49,100 @@
 #include <vtkVolume.h>
 #include <vtkVolumeProperty.h>
 
+// Quarter-resolution preview read while the full volume loads.
+#include "cargaProgresiva.h"
+// Offscreen batch rendering of camera views to PNG.
+#include "renderLotes.h"
+// Per-frame render time, triangle count and memory log / overlay.
+#include "metricas.h"
+
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+struct Options
+{
+  std::vector<int> threads;
+  std::vector<double> sampleDistances;
+  std::vector<double> imageSampleDistances;
+  int autoAdjust = -1; // -1: mapper default
+  double fps = 30.0;
+  int width = 640;
+  int height = 480;
+  int benchmarkFrames = 0; // 0: interactive
+  bool skipEmpty = true;
+  double skipThreshold = 0.0; // 0: skip only fully transparent blocks
+  bool progressive = false;
+  std::string metricsFile; // empty: no per-frame log
+  bool overlay = false;
+};
+
+// The pipeline objects of the scene, shared by the viewer and the batch mode.
+struct Scene
+{
+  vtkNew<vtkFixedPointVolumeRayCastMapper> volumeMapper;
+  vtkNew<vtkColorTransferFunction> volumeColor;
+  vtkNew<vtkPiecewiseFunction> volumeScalarOpacity;
+  vtkNew<vtkPiecewiseFunction> volumeGradientOpacity;
+  vtkNew<vtkVolumeProperty> volumeProperty;
+  vtkNew<vtkVolume> volume;
+};
+
+template <typename T> bool ParseList(const std::string& text, std::vector<T>& values);
+bool ParseOptions(int argc, char* argv[], Options& options);
+void RunBenchmark(vtkRenderWindow* renWin, vtkRenderer* ren,
+                  vtkFixedPointVolumeRayCastMapper* mapper,
+                  const Options& options);
+bool SetupEmptySpaceSkipping(vtkImageData* image,
+                             vtkPiecewiseFunction* opacity,
+                             vtkFixedPointVolumeRayCastMapper* mapper,
+                             int blockSize, double threshold);
+void BuildScene(Scene& scene, vtkRenderer* ren, vtkImageData* image,
+                const Options& options);
+std::shared_ptr<void> BuildBatchScene(const std::string& fileName,
+                                      vtkRenderer* renderer);
+} // namespace
 
 int main(int argc, char* argv[])
 {
-  if (argc < 2)
+  // Offscreen batch mode: render the camera views of every volume to PNG.
+  if (renderLotes::Pedido(argc, argv))
   {
-    cout << "Usage: " << argv[0] << "file.mhd e.g. FullHead.mhd" << endl;
-    return EXIT_FAILURE;
+    renderLotes::Opciones batchOptions;
+    if (!renderLotes::AnalizarArgumentos(argc, argv, batchOptions))
+    {
+      cout << "Usage: " << argv[0] << endl;
+      renderLotes::Uso(argv[0]);
+      return EXIT_FAILURE;
+    }
+    return renderLotes::Ejecutar(batchOptions, BuildBatchScene) > 0
+      ? EXIT_SUCCESS
+      : EXIT_FAILURE;
   }
 
-  vtkNew<vtkNamedColors> colors;
-
-  std::array<unsigned char, 4> bkg{{51, 77, 102, 255}};
-  colors->SetColor("BkgColor", bkg.data());
+  Options options;
+  if (argc < 2 || !ParseOptions(argc, argv, options))
+  {
+    cout << "Usage: " << argv[0]
+         << " file.mhd e.g. FullHead.mhd [--threads N[,N...]]"
+            " [--sample-distance D[,D...]] [--image-sample-distance D[,D...]]"
+            " [--auto-adjust on|off] [--fps F] [--size WxH]"
+            " [--skip-empty on|off] [--skip-threshold V] [--progressive]"
+            " [--benchmark [N]]"
+            " [--metrics log.csv|log.json] [--overlay]"
+         << endl;
+    renderLotes::Uso(argv[0]);
+    return EXIT_FAILURE;
+  }
 
   // Create the renderer, the render window, and the interactor. The renderer
   // draws into the render window, the interactor enables mouse- and
@@ -48,16 +162,109 @@ int main(int argc, char* argv[])
   vtkNew<vtkMetaImageReader> reader;
   reader->SetFileName(argv[1]);
 
+  // With --progressive (and not benchmarking) a 1/4 resolution copy of the
+  // volume, read with a strided pass over the file, is rendered first and
+  // the full volume replaces it once it has been read in the background.
+  vtkSmartPointer<vtkImageData> preview;
+  if (options.progressive && options.benchmarkFrames == 0)
+  {
+    preview = cargaProgresiva::LeerReducido(argv[1], 4);
+  }
+  else
+  {
+    auto start = std::chrono::steady_clock::now();
+    reader->Update();
+    const double readMs = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+    metricas::Anotar(metricas::Lectura, readMs);
+    std::cout << "Read: " << readMs << " ms" << std::endl;
+  }
+
+  Scene scene;
+  BuildScene(scene, ren, preview ? preview.Get() : reader->GetOutput(),
+             options);
+
+  // Benchmark frames are logged too.
+  metricas::Monitor monitor;
+  if ((!options.metricsFile.empty() || options.overlay) &&
+      !monitor.Iniciar(ren, options.metricsFile, options.overlay))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Increase the size of the render window
+  renWin->SetSize(options.width, options.height);
+  renWin->SetWindowName("MedicalDemo4");
+
+  if (options.benchmarkFrames > 0)
+  {
+    RunBenchmark(renWin, ren, scene.volumeMapper, options);
+    return EXIT_SUCCESS;
+  }
+
+  // Interact with the data. While the camera moves the mapper aims for the
+  // desired update rate (when auto-adjust is on). In progressive mode the
+  // full volume is swapped in from a timer once it has been read, and the
+  // empty space bounds are recomputed from it.
+  iren->SetDesiredUpdateRate(options.fps);
+  renWin->Render();
+  iren->Initialize();
+  cargaProgresiva::Carga fullLoad;
+  if (preview)
+  {
+    fullLoad.Iniciar(argv[1], iren, nullptr, [&](vtkImageData* full) {
+      scene.volumeMapper->SetInputData(full);
+      if (options.skipEmpty)
+      {
+        SetupEmptySpaceSkipping(full, scene.volumeScalarOpacity,
+                                scene.volumeMapper, 8, options.skipThreshold);
+      }
+    });
+  }
+  iren->Start();
+
+  return EXIT_SUCCESS;
+}
+
+namespace {
+// Sets up the volume rendering of 'image' in 'ren', with the first value of
+// each list in 'options', and the initial camera.
+void BuildScene(Scene& scene, vtkRenderer* ren, vtkImageData* image,
+                const Options& options)
+{
+  vtkNew<vtkNamedColors> colors;
+
+  std::array<unsigned char, 4> bkg{{51, 77, 102, 255}};
+  colors->SetColor("BkgColor", bkg.data());
+
   // The volume will be displayed by ray-cast alpha compositing.
   // A ray-cast mapper is needed to do the ray-casting.
-  vtkNew<vtkFixedPointVolumeRayCastMapper> volumeMapper;
-  volumeMapper->SetInputConnection(reader->GetOutputPort());
+  vtkFixedPointVolumeRayCastMapper* volumeMapper = scene.volumeMapper;
+  volumeMapper->SetInputData(image);
+  if (!options.threads.empty())
+  {
+    volumeMapper->SetNumberOfThreads(options.threads.front());
+  }
+  if (!options.sampleDistances.empty())
+  {
+    volumeMapper->SetSampleDistance(options.sampleDistances.front());
+  }
+  if (!options.imageSampleDistances.empty())
+  {
+    volumeMapper->SetImageSampleDistance(
+      options.imageSampleDistances.front());
+  }
+  if (options.autoAdjust >= 0)
+  {
+    volumeMapper->SetAutoAdjustSampleDistances(options.autoAdjust);
+  }
 
   // The color transfer function maps voxel intensities to colors.
   // It is modality-specific, and often anatomy-specific as well.
   // The goal is to one color for flesh (between 500 and 1000)
   // and another color for bone (1150 and over).
-  vtkNew<vtkColorTransferFunction> volumeColor;
+  vtkColorTransferFunction* volumeColor = scene.volumeColor;
   volumeColor->AddRGBPoint(0, 0.0, 0.0, 0.0);
   volumeColor->AddRGBPoint(500, 240.0 / 255.0, 184.0 / 255.0, 160.0 / 255.0);
   volumeColor->AddRGBPoint(1000, 240.0 / 255.0, 184.0 / 255.0, 160.0 / 255.0);
@@ -65,7 +272,7 @@ int main(int argc, char* argv[])
 
   // The opacity transfer function is used to control the opacity
   // of different tissue types.
-  vtkNew<vtkPiecewiseFunction> volumeScalarOpacity;
+  vtkPiecewiseFunction* volumeScalarOpacity = scene.volumeScalarOpacity;
   volumeScalarOpacity->AddPoint(0, 0.00);
   volumeScalarOpacity->AddPoint(500, 0.15);
   volumeScalarOpacity->AddPoint(1000, 0.15);
@@ -76,7 +283,7 @@ int main(int argc, char* argv[])
   // at the boundaries between tissue types. The gradient is measured
   // as the amount by which the intensity changes over unit distance.
   // For most medical data, the unit distance is 1mm.
-  vtkNew<vtkPiecewiseFunction> volumeGradientOpacity;
+  vtkPiecewiseFunction* volumeGradientOpacity = scene.volumeGradientOpacity;
   volumeGradientOpacity->AddPoint(0, 0.0);
   volumeGradientOpacity->AddPoint(90, 0.5);
   volumeGradientOpacity->AddPoint(100, 1.0);
@@ -92,7 +299,7 @@ int main(int argc, char* argv[])
   // decreased by increasing the Ambient coefficient while decreasing
   // the Diffuse and Specular coefficient. To increase the impact
   // of shading, decrease the Ambient and increase the Diffuse and Specular.
-  vtkNew<vtkVolumeProperty> volumeProperty;
+  vtkVolumeProperty* volumeProperty = scene.volumeProperty;
   volumeProperty->SetColor(volumeColor);
   volumeProperty->SetScalarOpacity(volumeScalarOpacity);
   volumeProperty->SetGradientOpacity(volumeGradientOpacity);
@@ -104,10 +311,22 @@ int main(int argc, char* argv[])
 
   // The vtkVolume is a vtkProp3D (like a vtkActor) and controls the position
   // and orientation of the volume in world coordinates.
-  vtkNew<vtkVolume> volume;
+  vtkVolume* volume = scene.volume;
   volume->SetMapper(volumeMapper);
   volume->SetProperty(volumeProperty);
 
+  // Find the blocks whose value range has some opacity and restrict the
+  // rays to their bounding box. The scalar opacity ramps up from 0, so only
+  // blocks that are exactly 0 are transparent; the noisy air around a CT is
+  // only skipped with --skip-threshold, which drops its faint opacity. The
+  // mapper itself still leaps over transparent regions inside the box and
+  // stops each ray once its opacity saturates.
+  if (options.skipEmpty)
+  {
+    SetupEmptySpaceSkipping(image, volumeScalarOpacity, volumeMapper, 8,
+                            options.skipThreshold);
+  }
+
   // Finally, add the volume to the renderer
   ren->AddViewProp(volume);
 
@@ -124,14 +343,466 @@ int main(int argc, char* argv[])
 
   // Set a background color for the renderer
   ren->SetBackground(colors->GetColor3d("BkgColor").GetData());
+}
 
-  // Increase the size of the render window
-  renWin->SetSize(640, 480);
-  renWin->SetWindowName("MedicalDemo4");
+// Reads 'fileName' with its own reader and builds the scene in 'renderer'
+// with the default options; called from the batch worker threads.
+std::shared_ptr<void> BuildBatchScene(const std::string& fileName,
+                                      vtkRenderer* renderer)
+{
+  vtkNew<vtkMetaImageReader> reader;
+  reader->SetFileName(fileName.c_str());
+  reader->Update();
+
+  auto scene = std::make_shared<Scene>();
+  BuildScene(*scene, renderer, reader->GetOutput(), Options());
+  return scene;
+}
+
+template <typename T> bool ParseList(const std::string& text, std::vector<T>& values)
+{
+  values.clear();
+  std::istringstream is(text);
+  std::string item;
+  while (std::getline(is, item, ','))
+  {
+    std::istringstream itemStream(item);
+    T value;
+    if (!(itemStream >> value) || value <= 0)
+    {
+      return false;
+    }
+    values.push_back(value);
+  }
+  return !values.empty();
+}
+
+bool ParseOptions(int argc, char* argv[], Options& options)
+{
+  for (int i = 2; i < argc; ++i)
+  {
+    const std::string arg = argv[i];
+    const bool hasValue = i + 1 < argc && argv[i + 1][0] != '-';
+    if (arg == "--progressive")
+    {
+      options.progressive = true;
+    }
+    else if (arg == "--overlay")
+    {
+      options.overlay = true;
+    }
+    else if (arg == "--benchmark")
+    {
+      options.benchmarkFrames = hasValue ? std::atoi(argv[++i]) : 36;
+      if (options.benchmarkFrames <= 0)
+      {
+        return false;
+      }
+    }
+    else if (!hasValue)
+    {
+      return false;
+    }
+    else if (arg == "--metrics")
+    {
+      options.metricsFile = argv[++i];
+    }
+    else if (arg == "--threads")
+    {
+      if (!ParseList(argv[++i], options.threads))
+      {
+        return false;
+      }
+    }
+    else if (arg == "--sample-distance")
+    {
+      if (!ParseList(argv[++i], options.sampleDistances))
+      {
+        return false;
+      }
+    }
+    else if (arg == "--image-sample-distance")
+    {
+      if (!ParseList(argv[++i], options.imageSampleDistances))
+      {
+        return false;
+      }
+    }
+    else if (arg == "--auto-adjust")
+    {
+      const std::string value = argv[++i];
+      if (value != "on" && value != "off")
+      {
+        return false;
+      }
+      options.autoAdjust = value == "on" ? 1 : 0;
+    }
+    else if (arg == "--skip-empty")
+    {
+      const std::string value = argv[++i];
+      if (value != "on" && value != "off")
+      {
+        return false;
+      }
+      options.skipEmpty = value == "on";
+    }
+    else if (arg == "--skip-threshold")
+    {
+      char* end = nullptr;
+      options.skipThreshold = std::strtod(argv[++i], &end);
+      if (*end != '\0')
+      {
+        return false;
+      }
+    }
+    else if (arg == "--fps")
+    {
+      options.fps = std::atof(argv[++i]);
+      if (options.fps <= 0.0)
+      {
+        return false;
+      }
+    }
+    else if (arg == "--size")
+    {
+      const std::string value = argv[++i];
+      const auto x = value.find('x');
+      if (x == std::string::npos)
+      {
+        return false;
+      }
+      options.width = std::atoi(value.substr(0, x).c_str());
+      options.height = std::atoi(value.substr(x + 1).c_str());
+      if (options.width <= 0 || options.height <= 0)
+      {
+        return false;
+      }
+    }
+    else
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Renders options.benchmarkFrames frames along a full orbit around the
+// volume center for every combination of threads, sample distance and image
+// sample distance, and prints per-frame times plus a summary per setting.
+// With auto-adjust on the requested image sample distance is only a starting
+// point; the image column shows the mean distance the mapper actually used.
+void RunBenchmark(vtkRenderWindow* renWin, vtkRenderer* ren,
+                  vtkFixedPointVolumeRayCastMapper* mapper,
+                  const Options& options)
+{
+  using Clock = std::chrono::steady_clock;
+  const auto ms = [](Clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+  };
 
-  // Interact with the data.
+  renWin->SetOffScreenRendering(1);
+
+  // The first render (which computes the gradients used for shading and
+  // gradient opacity) is reported separately.
+  auto start = Clock::now();
   renWin->Render();
-  iren->Start();
+  std::cout << "First render: " << ms(Clock::now() - start) << " ms"
+            << std::endl;
 
-  return EXIT_SUCCESS;
+  const std::vector<int> threads = options.threads.empty()
+    ? std::vector<int>{mapper->GetNumberOfThreads()}
+    : options.threads;
+  const std::vector<double> sampleDistances = options.sampleDistances.empty()
+    ? std::vector<double>{mapper->GetSampleDistance()}
+    : options.sampleDistances;
+  const std::vector<double> imageSampleDistances =
+    options.imageSampleDistances.empty()
+    ? std::vector<double>{mapper->GetImageSampleDistance()}
+    : options.imageSampleDistances;
+  const int autoAdjust =
+    options.autoAdjust >= 0 ? options.autoAdjust : 0;
+
+  // With auto-adjust the mapper sizes its image sample distance to meet the
+  // render window's desired update rate.
+  mapper->SetAutoAdjustSampleDistances(autoAdjust);
+  renWin->SetDesiredUpdateRate(autoAdjust ? options.fps : 0.0001);
+
+  vtkCamera* camera = ren->GetActiveCamera();
+  double position[3], focalPoint[3], viewUp[3];
+  camera->GetPosition(position);
+  camera->GetFocalPoint(focalPoint);
+  camera->GetViewUp(viewUp);
+
+  const int frames = options.benchmarkFrames;
+  const double pixels = static_cast<double>(options.width) * options.height;
+
+  struct Result
+  {
+    int threads;
+    double sampleDistance, imageSampleDistance, meanMs;
+  };
+  std::vector<Result> results;
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "threads  sample  image  auto   mean ms    min ms    max ms"
+               "      fps   Mrays/s"
+            << std::endl;
+  for (int t : threads)
+  {
+    for (double sd : sampleDistances)
+    {
+      for (double isd : imageSampleDistances)
+      {
+        mapper->SetNumberOfThreads(t);
+        mapper->SetSampleDistance(sd);
+        mapper->SetImageSampleDistance(isd);
+        camera->SetPosition(position);
+        camera->SetFocalPoint(focalPoint);
+        camera->SetViewUp(viewUp);
+        ren->ResetCameraClippingRange();
+        renWin->Render(); // warm up with the new settings
+
+        std::vector<double> frameMs(frames);
+        double rays = 0.0;
+        double usedTotal = 0.0;
+        for (int f = 0; f < frames; ++f)
+        {
+          camera->Azimuth(360.0 / frames);
+          ren->ResetCameraClippingRange();
+          start = Clock::now();
+          renWin->Render();
+          frameMs[f] = ms(Clock::now() - start);
+          // One ray per image sample (an upper bound: rays that miss the
+          // volume bounds are not cast).
+          const double used = mapper->GetImageSampleDistance();
+          rays += pixels / (used * used);
+          usedTotal += used;
+        }
+        const double usedIsd = usedTotal / frames;
+
+        double total = 0.0;
+        for (double v : frameMs)
+        {
+          total += v;
+        }
+        const double mean = total / frames;
+        std::cout << std::setw(7) << t << std::setw(8) << sd << std::setw(7)
+                  << usedIsd << std::setw(6) << (autoAdjust ? "on" : "off")
+                  << std::setw(10) << mean << std::setw(10)
+                  << *std::min_element(frameMs.begin(), frameMs.end())
+                  << std::setw(10)
+                  << *std::max_element(frameMs.begin(), frameMs.end())
+                  << std::setw(9) << 1000.0 / mean << std::setw(10)
+                  << rays / (total / 1000.0) / 1e6 << std::endl;
+        std::cout << "  frames ms:";
+        for (double v : frameMs)
+        {
+          std::cout << " " << v;
+        }
+        std::cout << std::endl;
+        results.push_back({t, sd, usedIsd, mean});
+      }
+    }
+  }
+
+  // Best quality (smallest sampling distances) that keeps the target rate.
+  const Result* best = nullptr;
+  for (const Result& r : results)
+  {
+    if (1000.0 / r.meanMs < options.fps)
+    {
+      continue;
+    }
+    if (!best ||
+        r.sampleDistance * r.imageSampleDistance <
+          best->sampleDistance * best->imageSampleDistance ||
+        (r.sampleDistance * r.imageSampleDistance ==
+           best->sampleDistance * best->imageSampleDistance &&
+         r.meanMs < best->meanMs))
+    {
+      best = &r;
+    }
+  }
+  if (best)
+  {
+    std::cout << "Best quality at " << options.fps << " fps: --threads "
+              << best->threads << " --sample-distance " << best->sampleDistance
+              << " --image-sample-distance " << best->imageSampleDistance
+              << std::endl;
+  }
+  else
+  {
+    std::cout << "No setting reached " << options.fps << " fps" << std::endl;
+  }
+}
+} // namespace
+
+namespace {
+// Minimum and maximum of every blockSize^3 block of a single-component volume.
+template <typename T>
+void ComputeBlockRanges(const T* data, const int dims[3], int blockSize,
+                        const int blocks[3], std::vector<double>& minima,
+                        std::vector<double>& maxima)
+{
+  const size_t count = static_cast<size_t>(blocks[0]) * blocks[1] * blocks[2];
+  minima.assign(count, 0.0);
+  maxima.assign(count, 0.0);
+  std::vector<bool> seen(count, false);
+  for (int z = 0; z < dims[2]; ++z)
+  {
+    for (int y = 0; y < dims[1]; ++y)
+    {
+      const T* row = data + (static_cast<size_t>(z) * dims[1] + y) * dims[0];
+      const size_t rowBlock =
+        (static_cast<size_t>(z / blockSize) * blocks[1] + y / blockSize) *
+        blocks[0];
+      for (int bx = 0; bx < blocks[0]; ++bx)
+      {
+        const int x0 = bx * blockSize;
+        const int x1 = std::min(dims[0], x0 + blockSize);
+        T lo = row[x0];
+        T hi = row[x0];
+        for (int x = x0 + 1; x < x1; ++x)
+        {
+          lo = row[x] < lo ? row[x] : lo;
+          hi = row[x] > hi ? row[x] : hi;
+        }
+        const size_t b = rowBlock + bx;
+        if (!seen[b])
+        {
+          minima[b] = lo;
+          maxima[b] = hi;
+          seen[b] = true;
+        }
+        else
+        {
+          minima[b] = std::min(minima[b], static_cast<double>(lo));
+          maxima[b] = std::max(maxima[b], static_cast<double>(hi));
+        }
+      }
+    }
+  }
+}
+
+// True when the opacity function is zero over the whole [low, high] range.
+// The function is piecewise between its nodes, so it is enough to look at
+// the ends of the range and at the nodes inside it.
+bool IsTransparent(vtkPiecewiseFunction* opacity, double low, double high)
+{
+  if (opacity->GetValue(low) > 0.0 || opacity->GetValue(high) > 0.0)
+  {
+    return false;
+  }
+  double node[4];
+  for (int i = 0; i < opacity->GetSize(); ++i)
+  {
+    opacity->GetNodeValue(i, node);
+    if (node[0] > low && node[0] < high && node[1] > 0.0)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Builds a min/max block grid for the volume and crops the mapper to the
+// bounding box of the blocks that can have non-zero opacity (padded by one
+// voxel for trilinear interpolation). Blocks whose maximum is below
+// 'threshold' are dropped as well, even if they have some opacity. Must be
+// called again if the volume or the opacity function change.
+bool SetupEmptySpaceSkipping(vtkImageData* image,
+                             vtkPiecewiseFunction* opacity,
+                             vtkFixedPointVolumeRayCastMapper* mapper,
+                             int blockSize, double threshold)
+{
+  const auto start = std::chrono::steady_clock::now();
+  if (image->GetNumberOfScalarComponents() != 1)
+  {
+    return false;
+  }
+  int dims[3];
+  image->GetDimensions(dims);
+  int blocks[3];
+  for (int i = 0; i < 3; ++i)
+  {
+    blocks[i] = (dims[i] + blockSize - 1) / blockSize;
+  }
+
+  std::vector<double> minima, maxima;
+  switch (image->GetScalarType())
+  {
+    vtkTemplateMacro(ComputeBlockRanges(
+      static_cast<const VTK_TT*>(image->GetScalarPointer()), dims, blockSize,
+      blocks, minima, maxima));
+    default:
+      return false;
+  }
+
+  int first[3] = {blocks[0], blocks[1], blocks[2]};
+  int last[3] = {-1, -1, -1};
+  size_t transparent = 0;
+  size_t belowThreshold = 0;
+  for (int bz = 0; bz < blocks[2]; ++bz)
+  {
+    for (int by = 0; by < blocks[1]; ++by)
+    {
+      for (int bx = 0; bx < blocks[0]; ++bx)
+      {
+        const size_t b =
+          (static_cast<size_t>(bz) * blocks[1] + by) * blocks[0] + bx;
+        if (IsTransparent(opacity, minima[b], maxima[b]))
+        {
+          ++transparent;
+          continue;
+        }
+        if (maxima[b] < threshold)
+        {
+          ++belowThreshold;
+          continue;
+        }
+        const int index[3] = {bx, by, bz};
+        for (int i = 0; i < 3; ++i)
+        {
+          first[i] = std::min(first[i], index[i]);
+          last[i] = std::max(last[i], index[i]);
+        }
+      }
+    }
+  }
+  if (last[0] < 0)
+  {
+    std::cout << "Empty-space skipping: the whole volume is transparent or "
+                 "below the threshold"
+              << std::endl;
+    return false;
+  }
+
+  double origin[3], spacing[3], planes[6];
+  image->GetOrigin(origin);
+  image->GetSpacing(spacing);
+  double kept = 1.0;
+  for (int i = 0; i < 3; ++i)
+  {
+    const int low = std::max(0, first[i] * blockSize - 1);
+    const int high = std::min(dims[i] - 1, (last[i] + 1) * blockSize);
+    planes[2 * i] = origin[i] + low * spacing[i];
+    planes[2 * i + 1] = origin[i] + high * spacing[i];
+    kept *= static_cast<double>(high - low + 1) / dims[i];
+  }
+  mapper->SetCroppingRegionPlanes(planes);
+  mapper->SetCroppingRegionFlagsToSubVolume();
+  mapper->CroppingOn();
+
+  const size_t total = minima.size();
+  std::cout << "Empty-space skipping: " << transparent << " of " << total
+            << " blocks of " << blockSize << "^3 transparent, "
+            << belowThreshold << " below " << threshold
+            << ", rays limited to " << 100.0 * kept << "% of the volume ("
+            << 100.0 * (1.0 - kept) << "% cropped, "
+            << std::chrono::duration<double, std::milli>(
+                 std::chrono::steady_clock::now() - start)
+                 .count()
+            << " ms)" << std::endl;
+  return true;
 }
+} // namespace
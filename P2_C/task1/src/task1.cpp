@@ -11,7 +11,10 @@
 #include "itkConnectedThresholdImageFilter.h"
 #include "itkNeighborhoodConnectedImageFilter.h"
 #include "itkConfidenceConnectedImageFilter.h"
-#include "itkRescaleIntensityImageFilter.h"
+
+#include "cacheSuavizado.h"
+#include "medianaHistograma.h"
+#include "salidaUchar.h"
 
 int main(int argc, char* argv[])
 {
@@ -27,8 +30,6 @@ int main(int argc, char* argv[])
     constexpr unsigned int Dimension = 2;
     using PixelType = float;
     using ImageType = itk::Image<PixelType, Dimension>;
-    using OutputPixelType = unsigned char;
-    using OutputImageType = itk::Image<OutputPixelType, Dimension>;
 
     // Lector
     auto lector = itk::ImageFileReader<ImageType>::New();
@@ -59,23 +60,24 @@ int main(int argc, char* argv[])
         // Aplicar suavizado
         if (modo == 1) // CurvatureFlow
         {
-            auto suavizado = itk::CurvatureFlowImageFilter<ImageType, ImageType>::New();
-            suavizado->SetInput(imagenFiltrada);
-            suavizado->SetTimeStep(0.125);
-            suavizado->SetNumberOfIterations(5);
-            suavizado->Update();
-            imagenFiltrada = suavizado->GetOutput();
+            imagenFiltrada = cacheSuavizado::obtener<ImageType>(
+                nombreArchivoEntrada, "curvatureFlow_it5_ts0.125", [&]() {
+                    auto suavizado = itk::CurvatureFlowImageFilter<ImageType, ImageType>::New();
+                    suavizado->SetInput(lector->GetOutput());
+                    suavizado->SetTimeStep(0.125);
+                    suavizado->SetNumberOfIterations(5);
+                    suavizado->Update();
+                    return ImageType::Pointer(suavizado->GetOutput());
+                });
             tagSuavizado = "_curvflow";
         }
         else if (modo == 2) // Mediana 5x5
         {
-            auto mediana = itk::MedianImageFilter<ImageType, ImageType>::New();
-            ImageType::SizeType radio;
-            radio.Fill(2); // 5x5
-            mediana->SetRadius(radio);
-            mediana->SetInput(imagenFiltrada);
-            mediana->Update();
-            imagenFiltrada = mediana->GetOutput();
+            imagenFiltrada = cacheSuavizado::obtener<ImageType>(
+                nombreArchivoEntrada, "median_r2", [&]() {
+                    // Radio 2 = 5x5; por histogramas o con MedianImageFilter según TVG_MEDIANA
+                    return medianaHistograma::Mediana<ImageType>(lector->GetOutput(), 2);
+                });
             tagSuavizado = "_median5x5";
         }
         else
@@ -93,20 +95,10 @@ int main(int argc, char* argv[])
             filtro->SetUpper(ctSuperior[i]);
             filtro->Update();
 
-            auto rescale = itk::RescaleIntensityImageFilter<ImageType, OutputImageType>::New();
-            rescale->SetInput(filtro->GetOutput());
-            rescale->SetOutputMinimum(0);
-            rescale->SetOutputMaximum(255);
-            rescale->Update();
-
             std::ostringstream outName;
             outName << prefijoSalida << "_CT" << tagSuavizado
                     << "_L" << ctInferior[i] << "_U" << ctSuperior[i] << ".png";
-
-            auto writer = itk::ImageFileWriter<OutputImageType>::New();
-            writer->SetInput(rescale->GetOutput());
-            writer->SetFileName(outName.str());
-            writer->Update();
+            salidaUchar::Escribir(filtro->GetOutput(), outName.str());
         }
 
         // --- NeighborhoodConnected ---
@@ -120,19 +112,9 @@ int main(int argc, char* argv[])
             filtro->SetReplaceValue(255.0f);
             filtro->Update();
 
-            auto rescale = itk::RescaleIntensityImageFilter<ImageType, OutputImageType>::New();
-            rescale->SetInput(filtro->GetOutput());
-            rescale->SetOutputMinimum(0);
-            rescale->SetOutputMaximum(255);
-            rescale->Update();
-
             std::ostringstream outName;
             outName << prefijoSalida << "_NC" << tagSuavizado << "_R" << radio << ".png";
-
-            auto writer = itk::ImageFileWriter<OutputImageType>::New();
-            writer->SetInput(rescale->GetOutput());
-            writer->SetFileName(outName.str());
-            writer->Update();
+            salidaUchar::Escribir(filtro->GetOutput(), outName.str());
         }
 
         // --- ConfidenceConnected ---
@@ -151,20 +133,10 @@ int main(int argc, char* argv[])
                     filtro->SetReplaceValue(255.0f);
                     filtro->Update();
 
-                    auto rescale = itk::RescaleIntensityImageFilter<ImageType, OutputImageType>::New();
-                    rescale->SetInput(filtro->GetOutput());
-                    rescale->SetOutputMinimum(0);
-                    rescale->SetOutputMaximum(255);
-                    rescale->Update();
-
                     std::ostringstream outName;
                     outName << prefijoSalida << "_CC" << tagSuavizado
                             << "_R" << radio << "_M" << mult << "_It" << it << ".png";
-
-                    auto writer = itk::ImageFileWriter<OutputImageType>::New();
-                    writer->SetInput(rescale->GetOutput());
-                    writer->SetFileName(outName.str());
-                    writer->Update();
+                    salidaUchar::Escribir(filtro->GetOutput(), outName.str());
                 }
             }
         }
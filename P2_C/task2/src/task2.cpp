@@ -4,19 +4,204 @@
 #include "itkMeanImageFilter.h"
 #include "itkMedianImageFilter.h"
 
+#include "procesadoLotes.h"
+#include "mediaSeparable.h"
+#include "medianaHistograma.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <sstream>
 
+// Modo lote: un lector, los cuatro filtros y un escritor que se reutilizan para
+// todas las imágenes; lectura, filtrado y escritura van en hilos distintos.
+int procesarLote(const std::string & entradas, std::string outputDir)
+{
+  typedef itk::Image<unsigned char, 2>                 ImageType;
+  typedef itk::ImageFileReader<ImageType>              ReaderType;
+  typedef itk::ImageFileWriter<ImageType>              WriterType;
+  typedef itk::MeanImageFilter<ImageType, ImageType>   MeanFilterType;
+  typedef itk::MedianImageFilter<ImageType, ImageType> MedianFilterType;
+  typedef std::vector<std::pair<std::string, ImageType::Pointer>> SalidasType;
+
+  if (!outputDir.empty() && outputDir.back() != '/' && outputDir.back() != '\\')
+    outputDir += '/';
+
+  const std::vector<std::string> ficheros = procesadoLotes::listarEntradas(entradas);
+  if (ficheros.empty())
+  {
+    std::cerr << "No hay imágenes en: " << entradas << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  ReaderType::Pointer reader = ReaderType::New();
+  WriterType::Pointer writer = WriterType::New();
+
+  // Mismos filtros que en el modo de una imagen (3x3 -> radio 1, 5x5 -> radio 2)
+  std::vector<std::pair<std::string, unsigned int>> radios = {
+    { "3x3", 1 }, { "5x5", 2 }
+  };
+  std::vector<std::pair<std::string, MeanFilterType::Pointer>>   meanFilters;
+  std::vector<std::pair<std::string, MedianFilterType::Pointer>> medianFilters;
+  for (const auto & r : radios)
+  {
+    ImageType::SizeType radius;
+    radius.Fill(r.second);
+    MeanFilterType::Pointer mean = MeanFilterType::New();
+    mean->SetRadius(radius);
+    meanFilters.emplace_back("mean_" + r.first, mean);
+    MedianFilterType::Pointer median = MedianFilterType::New();
+    median->SetRadius(radius);
+    medianFilters.emplace_back("median_" + r.first, median);
+  }
+
+  auto leer = [&](const std::string & ruta) {
+    reader->SetFileName(ruta);
+    reader->Update();
+    ImageType::Pointer imagen = reader->GetOutput();
+    imagen->DisconnectPipeline();
+    return imagen;
+  };
+
+  // Tras cada Update se desconecta la salida para que el escritor pueda usarla
+  // mientras el filtro ya trabaja sobre la imagen siguiente
+  auto filtrar = [&](ImageType * imagen) {
+    SalidasType salidas;
+    for (auto & f : meanFilters)
+    {
+      f.second->SetInput(imagen);
+      f.second->Update();
+      ImageType::Pointer salida = f.second->GetOutput();
+      salida->DisconnectPipeline();
+      salidas.emplace_back(f.first, salida);
+    }
+    for (auto & f : medianFilters)
+    {
+      f.second->SetInput(imagen);
+      f.second->Update();
+      ImageType::Pointer salida = f.second->GetOutput();
+      salida->DisconnectPipeline();
+      salidas.emplace_back(f.first, salida);
+    }
+    return salidas;
+  };
+
+  auto escribir = [&](const std::string & ruta, const std::string & sufijo, ImageType * imagen) {
+    writer->SetFileName(outputDir + procesadoLotes::nombreBase(ruta) + "_" + sufijo +
+                        procesadoLotes::extension(ruta, ".jpg"));
+    writer->SetInput(imagen);
+    writer->Update();
+  };
+
+  const unsigned int errores =
+    procesadoLotes::ejecutar<ImageType, ImageType>(ficheros, leer, filtrar, escribir);
+  return errores == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Cuenta los píxeles distintos entre dos imágenes del mismo tamaño y la
+// diferencia máxima entre ellos.
+template <typename TImage>
+size_t contarDistintos(const TImage * a, const TImage * b, double & maxDif)
+{
+  const auto * pa = a->GetBufferPointer();
+  const auto * pb = b->GetBufferPointer();
+  const size_t n = a->GetBufferedRegion().GetNumberOfPixels();
+  size_t distintos = 0;
+  maxDif = 0.0;
+  for (size_t i = 0; i < n; ++i)
+  {
+    if (pa[i] != pb[i])
+    {
+      ++distintos;
+      maxDif = std::max(maxDif, std::abs(static_cast<double>(pa[i]) - static_cast<double>(pb[i])));
+    }
+  }
+  return distintos;
+}
+
+// Compara la media de ITK con la media separable para un radio: píxeles que
+// difieren, diferencia máxima y tiempo de cada una.
+template <typename TImage>
+bool compararMedia(const TImage * imagen, unsigned int r)
+{
+  typename TImage::SizeType radius;
+  radius.Fill(r);
+
+  auto t0 = std::chrono::steady_clock::now();
+  auto meanITK = itk::MeanImageFilter<TImage, TImage>::New();
+  meanITK->SetRadius(radius);
+  meanITK->SetInput(imagen);
+  meanITK->Update();
+  const std::chrono::duration<double, std::milli> msITK = std::chrono::steady_clock::now() - t0;
+
+  t0 = std::chrono::steady_clock::now();
+  typename TImage::Pointer rapida = mediaSeparable::Filtrar<TImage>(imagen, radius);
+  const std::chrono::duration<double, std::milli> msRapida = std::chrono::steady_clock::now() - t0;
+
+  double maxDif = 0.0;
+  const size_t distintos = contarDistintos<TImage>(meanITK->GetOutput(), rapida, maxDif);
+
+  std::cout << "Media radio " << r << ": ITK " << msITK.count() << " ms, separable "
+            << msRapida.count() << " ms, píxeles distintos " << distintos
+            << " (dif. máx. " << maxDif << ")" << std::endl;
+  return distintos == 0;
+}
+
+// Igual para la mediana de ITK frente a la mediana por histogramas.
+template <typename TImage>
+bool compararMediana(const TImage * imagen, unsigned int r)
+{
+  typename TImage::SizeType radius;
+  radius.Fill(r);
+
+  auto t0 = std::chrono::steady_clock::now();
+  auto medianITK = itk::MedianImageFilter<TImage, TImage>::New();
+  medianITK->SetRadius(radius);
+  medianITK->SetInput(imagen);
+  medianITK->Update();
+  const std::chrono::duration<double, std::milli> msITK = std::chrono::steady_clock::now() - t0;
+
+  t0 = std::chrono::steady_clock::now();
+  typename TImage::Pointer rapida = medianaHistograma::Filtrar<TImage>(imagen, r);
+  const std::chrono::duration<double, std::milli> msRapida = std::chrono::steady_clock::now() - t0;
+
+  double maxDif = 0.0;
+  const size_t distintos = contarDistintos<TImage>(medianITK->GetOutput(), rapida, maxDif);
+
+  std::cout << "Mediana radio " << r << ": ITK " << msITK.count() << " ms, histograma "
+            << msRapida.count() << " ms, píxeles distintos " << distintos
+            << " (dif. máx. " << maxDif << ")" << std::endl;
+  return distintos == 0;
+}
+
 int main(int argc, char * argv[])
 {
-  if(argc != 2)
+  if(argc >= 3 && std::string(argv[1]) == "--lote")
+  {
+    return procesarLote(argv[2], argc > 3 ? argv[3] : "../../../images/images_generated/");
+  }
+
+  if(argc != 2 && argc != 3)
   {
-    std::cerr << "USAGE:\n" << argv[0] << " <Image Filename>" << std::endl;
+    std::cerr << "USAGE:\n" << argv[0] << " <Image Filename> [itk|rapida|comparar]" << std::endl;
+    std::cerr << argv[0] << " --lote <directorio|listado.txt> [directorioSalida]" << std::endl;
     return EXIT_FAILURE;
   }
 
   const char * inputFile = argv[1];
 
+  // Implementación de media y mediana: "itk" (MeanImageFilter/MedianImageFilter),
+  // "rapida" (media con sumas separables vectorizadas, mediana por histogramas)
+  // o "comparar" (las dos, comprobando que coinciden bit a bit)
+  const std::string modoMedia = (argc == 3) ? argv[2] : "itk";
+  if (modoMedia != "itk" && modoMedia != "rapida" && modoMedia != "comparar")
+  {
+    std::cerr << "Modo desconocido: " << modoMedia << std::endl;
+    return EXIT_FAILURE;
+  }
+
   // Definir tipo de píxel e imagen (2D)
   typedef unsigned char                    PixelType;
   const unsigned int                       Dimension = 2;
@@ -70,12 +255,44 @@ int main(int argc, char * argv[])
   medianFilter5x5->SetRadius(radius);
   medianFilter5x5->SetInput(reader->GetOutput());
 
+  ImageType::Pointer mean3x3;
+  ImageType::Pointer mean5x5;
+  ImageType::Pointer median3x3;
+  ImageType::Pointer median5x5;
+  // En modo comparar, false si alguna versión rápida difiere de ITK
+  bool iguales = true;
   try
   {
-    meanFilter3x3->Update();
-    meanFilter5x5->Update();
-    medianFilter3x3->Update();
-    medianFilter5x5->Update();
+    if (modoMedia == "rapida")
+    {
+      radius.Fill(1);
+      mean3x3 = mediaSeparable::Filtrar<ImageType>(reader->GetOutput(), radius);
+      radius.Fill(2);
+      mean5x5 = mediaSeparable::Filtrar<ImageType>(reader->GetOutput(), radius);
+      median3x3 = medianaHistograma::Filtrar<ImageType>(reader->GetOutput(), 1);
+      median5x5 = medianaHistograma::Filtrar<ImageType>(reader->GetOutput(), 2);
+    }
+    else
+    {
+      meanFilter3x3->Update();
+      meanFilter5x5->Update();
+      medianFilter3x3->Update();
+      medianFilter5x5->Update();
+      mean3x3 = meanFilter3x3->GetOutput();
+      mean5x5 = meanFilter5x5->GetOutput();
+      median3x3 = medianFilter3x3->GetOutput();
+      median5x5 = medianFilter5x5->GetOutput();
+    }
+
+    if (modoMedia == "comparar")
+    {
+      for (unsigned int r : { 1u, 2u, 5u, 10u })
+        iguales = compararMedia<ImageType>(reader->GetOutput(), r) && iguales;
+      for (unsigned int r = 1; r <= 10; ++r)
+        iguales = compararMediana<ImageType>(reader->GetOutput(), r) && iguales;
+      std::cout << (iguales ? "Media y mediana rápidas idénticas a las de ITK."
+                            : "ATENCIÓN: las versiones rápidas difieren de ITK.") << std::endl;
+    }
   }
   catch(itk::ExceptionObject & error)
   {
@@ -91,19 +308,19 @@ int main(int argc, char * argv[])
 
   WriterType::Pointer writerMean3x3 = WriterType::New();
   writerMean3x3->SetFileName(outputDir + "mean_3x3.jpg");
-  writerMean3x3->SetInput(meanFilter3x3->GetOutput());
+  writerMean3x3->SetInput(mean3x3);
 
   WriterType::Pointer writerMean5x5 = WriterType::New();
   writerMean5x5->SetFileName(outputDir + "mean_5x5.jpg");
-  writerMean5x5->SetInput(meanFilter5x5->GetOutput());
+  writerMean5x5->SetInput(mean5x5);
 
   WriterType::Pointer writerMedian3x3 = WriterType::New();
   writerMedian3x3->SetFileName(outputDir + "median_3x3.jpg");
-  writerMedian3x3->SetInput(medianFilter3x3->GetOutput());
+  writerMedian3x3->SetInput(median3x3);
 
   WriterType::Pointer writerMedian5x5 = WriterType::New();
   writerMedian5x5->SetFileName(outputDir + "median_5x5.jpg");
-  writerMedian5x5->SetInput(medianFilter5x5->GetOutput());
+  writerMedian5x5->SetInput(median5x5);
 
   try
   {
@@ -119,5 +336,5 @@ int main(int argc, char * argv[])
   }
 
   std::cout << "Imágenes filtradas guardadas en: " << outputDir << std::endl;
-  return EXIT_SUCCESS;
+  return iguales ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -4,18 +4,126 @@
 #include "itkDiscreteGaussianImageFilter.h"
 #include "itkBinomialBlurImageFilter.h"
 #include "itkRecursiveGaussianImageFilter.h"
-#include "itkRescaleIntensityImageFilter.h"
+
+#include "procesadoLotes.h"
+#include "salidaUchar.h"
 
 #include <iostream>
 #include <sstream>
 #include <string>
 
+// Modo lote: el lector, los filtros y el reescalado+escritor se crean una vez y
+// se reutilizan; lectura, filtrado y escritura van en hilos distintos.
+int procesarLote(const std::string & entradas, std::string outputDir)
+{
+  typedef itk::Image<float, 2>                                                   InternalImageType;
+  typedef itk::Image<unsigned char, 2>                                           WriteImageType;
+  typedef itk::ImageFileReader<InternalImageType>                                ReaderType;
+  typedef itk::DiscreteGaussianImageFilter<InternalImageType, InternalImageType> DiscreteGaussianFilterType;
+  typedef itk::BinomialBlurImageFilter<InternalImageType, InternalImageType>     BinomialBlurFilterType;
+  typedef itk::RecursiveGaussianImageFilter<InternalImageType, InternalImageType> RecursiveGaussianFilterType;
+  typedef itk::ImageFileWriter<WriteImageType>                                   WriterType;
+  typedef std::vector<std::pair<std::string, InternalImageType::Pointer>>        SalidasType;
+
+  if (!outputDir.empty() && outputDir.back() != '/' && outputDir.back() != '\\')
+    outputDir += '/';
+
+  const std::vector<std::string> ficheros = procesadoLotes::listarEntradas(entradas);
+  if (ficheros.empty())
+  {
+    std::cerr << "No hay imágenes en: " << entradas << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Mismos parámetros que en el modo de una imagen
+  const int discreteGaussianVariance = 4;
+  const int discreteGaussianMaximumKernelWidth = 3;
+  const int binomialBlurRepetitions = 5;
+  const int sigma = 3;
+
+  ReaderType::Pointer reader = ReaderType::New();
+
+  DiscreteGaussianFilterType::Pointer discreteGaussian = DiscreteGaussianFilterType::New();
+  discreteGaussian->SetVariance(discreteGaussianVariance);
+  discreteGaussian->SetMaximumKernelWidth(discreteGaussianMaximumKernelWidth);
+
+  BinomialBlurFilterType::Pointer binomialBlur = BinomialBlurFilterType::New();
+  binomialBlur->SetRepetitions(binomialBlurRepetitions);
+
+  RecursiveGaussianFilterType::Pointer filterX = RecursiveGaussianFilterType::New();
+  RecursiveGaussianFilterType::Pointer filterY = RecursiveGaussianFilterType::New();
+  filterX->SetDirection(0); // dirección X
+  filterY->SetDirection(1); // dirección Y
+  filterX->SetOrder(RecursiveGaussianFilterType::ZeroOrder);
+  filterY->SetOrder(RecursiveGaussianFilterType::ZeroOrder);
+  filterX->SetNormalizeAcrossScale(false);
+  filterY->SetNormalizeAcrossScale(false);
+  filterX->SetSigma(sigma);
+  filterY->SetSigma(sigma);
+  // La imagen leída se comparte entre filtros y con la salida "original"
+  filterX->InPlaceOff();
+  filterY->InPlaceOff();
+
+  WriterType::Pointer writer = WriterType::New();
+
+  std::ostringstream sufijoDG, sufijoBB;
+  sufijoDG << "discreteGaussian_V" << discreteGaussianVariance << "_K" << discreteGaussianMaximumKernelWidth;
+  sufijoBB << "binomialBlur_R" << binomialBlurRepetitions;
+
+  auto leer = [&](const std::string & ruta) {
+    reader->SetFileName(ruta);
+    reader->Update();
+    InternalImageType::Pointer imagen = reader->GetOutput();
+    imagen->DisconnectPipeline();
+    return imagen;
+  };
+
+  // Ejecuta un filtro y se queda con su salida desconectada del pipeline, para
+  // que el escritor la use mientras el filtro procesa la imagen siguiente
+  auto ejecutarFiltro = [](itk::ImageToImageFilter<InternalImageType, InternalImageType> * filtro,
+                           InternalImageType * entrada) {
+    filtro->SetInput(entrada);
+    filtro->Update();
+    InternalImageType::Pointer salida = filtro->GetOutput();
+    salida->DisconnectPipeline();
+    return salida;
+  };
+
+  auto filtrar = [&](InternalImageType * imagen) {
+    SalidasType salidas;
+    salidas.emplace_back("original", imagen);
+    salidas.emplace_back(sufijoDG.str(), ejecutarFiltro(discreteGaussian, imagen));
+    salidas.emplace_back(sufijoBB.str(), ejecutarFiltro(binomialBlur, imagen));
+    InternalImageType::Pointer suavizadaX = ejecutarFiltro(filterX, imagen);
+    salidas.emplace_back("recursiveGaussianX_S" + std::to_string(sigma), suavizadaX);
+    salidas.emplace_back("recursiveGaussianXY_S" + std::to_string(sigma), ejecutarFiltro(filterY, suavizadaX));
+    return salidas;
+  };
+
+  auto escribir = [&](const std::string & ruta, const std::string & sufijo, InternalImageType * imagen) {
+    writer->SetInput(salidaUchar::Convertir(imagen));
+    writer->SetFileName(outputDir + procesadoLotes::nombreBase(ruta) + "_" + sufijo +
+                        procesadoLotes::extension(ruta, ".jpg"));
+    writer->Update();
+  };
+
+  const unsigned int errores =
+    procesadoLotes::ejecutar<InternalImageType, InternalImageType>(ficheros, leer, filtrar, escribir);
+  return errores == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int main(int argc, char * argv[])
 {
+  if(argc >= 3 && std::string(argv[1]) == "--lote")
+  {
+    return procesarLote(argv[2], argc > 3 ? argv[3] : "../../../images/images_generated/");
+  }
+
   if(argc < 2)
   {
     std::cerr << "Usage:" << std::endl;
     std::cerr << argv[0] << " inputImageFile" << std::endl;
+    std::cerr << argv[0] << " --lote <directorio|listado.txt> [directorioSalida]" << std::endl;
     return EXIT_FAILURE;
   }
   
@@ -88,22 +196,15 @@ int main(int argc, char * argv[])
   filterY->Update();
   
   // Función lambda para convertir la imagen de float a unsigned char y escribirla
-  typedef itk::RescaleIntensityImageFilter<InternalImageType, WriteImageType> RescaleFilterType;
   typedef itk::ImageFileWriter<WriteImageType> WriterType;
   
   auto writeImage = [&](const std::string & suffix, InternalImageType::Pointer image) {
     // Convertir la imagen de float a unsigned char (0-255)
-    RescaleFilterType::Pointer rescaler = RescaleFilterType::New();
-    rescaler->SetInput(image);
-    rescaler->SetOutputMinimum(0);
-    rescaler->SetOutputMaximum(255);
-    rescaler->Update();
-    
     WriterType::Pointer writer = WriterType::New();
     std::ostringstream oss;
     oss << outputDir << baseName << "_" << suffix << ext;
     writer->SetFileName(oss.str());
-    writer->SetInput(rescaler->GetOutput());
+    writer->SetInput(salidaUchar::Convertir(image.GetPointer()));
     try {
       writer->Update();
       std::cout << "Guardado: " << oss.str() << std::endl;
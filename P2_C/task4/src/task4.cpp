@@ -1,22 +1,117 @@
 #include "itkImage.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
-#include "itkRescaleIntensityImageFilter.h"
 
 #include "itkGradientAnisotropicDiffusionImageFilter.h"
 #include "itkCurvatureAnisotropicDiffusionImageFilter.h"
 #include "itkCurvatureFlowImageFilter.h"
 
+#include "procesadoLotes.h"
+#include "salidaUchar.h"
+
 #include <iostream>
 #include <sstream>
 #include <string>
 
+// Modo lote: el lector, los tres filtros de difusión y el reescalado+escritor se
+// crean una vez y se reutilizan; lectura, filtrado y escritura van en hilos distintos.
+int procesarLote(const std::string & entradas, std::string outputDir)
+{
+  typedef itk::Image<float, 2>                                                            ImageType;
+  typedef itk::Image<unsigned char, 2>                                                    WriteImageType;
+  typedef itk::ImageFileReader<ImageType>                                                 ReaderType;
+  typedef itk::GradientAnisotropicDiffusionImageFilter<ImageType, ImageType>              GradientAnisotropicFilterType;
+  typedef itk::CurvatureAnisotropicDiffusionImageFilter<ImageType, ImageType>             CurvatureAnisotropicFilterType;
+  typedef itk::CurvatureFlowImageFilter<ImageType, ImageType>                             CurvatureFlowFilterType;
+  typedef itk::ImageFileWriter<WriteImageType>                                            WriterType;
+  typedef std::vector<std::pair<std::string, ImageType::Pointer>>                         SalidasType;
+
+  if (!outputDir.empty() && outputDir.back() != '/' && outputDir.back() != '\\')
+    outputDir += '/';
+
+  const std::vector<std::string> ficheros = procesadoLotes::listarEntradas(entradas);
+  if (ficheros.empty())
+  {
+    std::cerr << "No hay imágenes en: " << entradas << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  ReaderType::Pointer reader = ReaderType::New();
+
+  // Mismos parámetros que en el modo de una imagen
+  GradientAnisotropicFilterType::Pointer gradientAnisotropicFilter = GradientAnisotropicFilterType::New();
+  gradientAnisotropicFilter->SetNumberOfIterations(24);
+  gradientAnisotropicFilter->SetTimeStep(0.01);
+  gradientAnisotropicFilter->SetConductanceParameter(3);
+
+  CurvatureAnisotropicFilterType::Pointer curvatureAnisotropicFilter = CurvatureAnisotropicFilterType::New();
+  curvatureAnisotropicFilter->SetNumberOfIterations(24);
+  curvatureAnisotropicFilter->SetTimeStep(0.01);
+  curvatureAnisotropicFilter->SetConductanceParameter(3);
+  curvatureAnisotropicFilter->UseImageSpacingOn();
+
+  CurvatureFlowFilterType::Pointer curvatureFlowFilter = CurvatureFlowFilterType::New();
+  curvatureFlowFilter->SetNumberOfIterations(8);
+  curvatureFlowFilter->SetTimeStep(0.0025);
+
+  // La imagen leída se comparte entre los tres filtros y con la salida "original"
+  gradientAnisotropicFilter->InPlaceOff();
+  curvatureAnisotropicFilter->InPlaceOff();
+  curvatureFlowFilter->InPlaceOff();
+
+  WriterType::Pointer writer = WriterType::New();
+
+  auto leer = [&](const std::string & ruta) {
+    reader->SetFileName(ruta);
+    reader->Update();
+    ImageType::Pointer imagen = reader->GetOutput();
+    imagen->DisconnectPipeline();
+    return imagen;
+  };
+
+  // Ejecuta un filtro y se queda con su salida desconectada del pipeline, para
+  // que el escritor la use mientras el filtro procesa la imagen siguiente
+  auto ejecutarFiltro = [](itk::ImageToImageFilter<ImageType, ImageType> * filtro, ImageType * entrada) {
+    filtro->SetInput(entrada);
+    filtro->Update();
+    ImageType::Pointer salida = filtro->GetOutput();
+    salida->DisconnectPipeline();
+    return salida;
+  };
+
+  auto filtrar = [&](ImageType * imagen) {
+    SalidasType salidas;
+    salidas.emplace_back("original", imagen);
+    salidas.emplace_back("gradientAnisotropicDiffusion", ejecutarFiltro(gradientAnisotropicFilter, imagen));
+    salidas.emplace_back("curvatureAnisotropicDiffusion", ejecutarFiltro(curvatureAnisotropicFilter, imagen));
+    salidas.emplace_back("curvatureFlow", ejecutarFiltro(curvatureFlowFilter, imagen));
+    return salidas;
+  };
+
+  auto escribir = [&](const std::string & ruta, const std::string & sufijo, ImageType * imagen) {
+    writer->SetInput(salidaUchar::Convertir(imagen));
+    writer->SetFileName(outputDir + procesadoLotes::nombreBase(ruta) + "_" + sufijo +
+                        procesadoLotes::extension(ruta, ".jpg"));
+    writer->Update();
+  };
+
+  const unsigned int errores =
+    procesadoLotes::ejecutar<ImageType, ImageType>(ficheros, leer, filtrar, escribir);
+  return errores == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int main(int argc, char ** argv)
 {
+  if(argc >= 3 && std::string(argv[1]) == "--lote")
+  {
+    return procesarLote(argv[2], argc > 3 ? argv[3] : "../../../images/images_generated/");
+  }
+
   if(argc < 2)
   {
     std::cerr << "Usage: " << std::endl;
     std::cerr << argv[0] << " inputImageFile" << std::endl;
+    std::cerr << argv[0] << " --lote <directorio|listado.txt> [directorioSalida]" << std::endl;
     return EXIT_FAILURE;
   }
 
@@ -118,21 +213,14 @@ int main(int argc, char ** argv)
   }
 
   // Función lambda para convertir (rescalar) una imagen float a unsigned char y escribirla
-  typedef itk::RescaleIntensityImageFilter<OutputImageType, WriteImageType> RescaleFilterType;
   typedef itk::ImageFileWriter<WriteImageType> WriterType;
   auto writeImage = [&](const std::string & suffix, OutputImageType::Pointer image)
   {
-    RescaleFilterType::Pointer rescaler = RescaleFilterType::New();
-    rescaler->SetInput(image);
-    rescaler->SetOutputMinimum(0);
-    rescaler->SetOutputMaximum(255);
-    rescaler->Update();
-
     WriterType::Pointer writer = WriterType::New();
     std::ostringstream oss;
     oss << outputDir << baseName << "_" << suffix << ext;
     writer->SetFileName(oss.str());
-    writer->SetInput(rescaler->GetOutput());
+    writer->SetInput(salidaUchar::Convertir(image.GetPointer()));
     try {
       writer->Update();
       std::cout << "Guardado: " << oss.str() << std::endl;
@@ -145,16 +233,11 @@ int main(int argc, char ** argv)
 
   // Guardar la imagen original (convertida a unsigned char)
   {
-    RescaleFilterType::Pointer rescaler = RescaleFilterType::New();
-    rescaler->SetInput(reader->GetOutput());
-    rescaler->SetOutputMinimum(0);
-    rescaler->SetOutputMaximum(255);
-    rescaler->Update();
     WriterType::Pointer writer = WriterType::New();
     std::ostringstream oss;
     oss << outputDir << baseName << "_original" << ext;
     writer->SetFileName(oss.str());
-    writer->SetInput(rescaler->GetOutput());
+    writer->SetInput(salidaUchar::Convertir(reader->GetOutput()));
     try {
       writer->Update();
       std::cout << "Guardado: " << oss.str() << std::endl;
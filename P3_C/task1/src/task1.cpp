@@ -4,9 +4,10 @@
 #include "itkMeanImageFilter.h"
 #include "itkGradientMagnitudeImageFilter.h"
 #include "itkGradientMagnitudeRecursiveGaussianImageFilter.h"
-#include "itkRescaleIntensityImageFilter.h"
 #include "itkImageFileWriter.h"
 
+#include "salidaUchar.h"
+
 #include <string>
 #include <iostream>
 
@@ -90,30 +91,16 @@ int main(int argc, char *argv[])
     gradMagRecFilter->SetSigma(sigma);
     gradMagRecFilter->Update();
 
-    // Rescale all outputs to 0-255 for writing
-    using RescaleFilterType = itk::RescaleIntensityImageFilter<InputImageType, OutputImageType>;
-    auto rescaler1 = RescaleFilterType::New();
-    rescaler1->SetInput(gradMagFilter->GetOutput());
-    rescaler1->SetOutputMinimum(0);
-    rescaler1->SetOutputMaximum(255);
-    rescaler1->Update();
-
-    auto rescaler2 = RescaleFilterType::New();
-    rescaler2->SetInput(gradMagRecFilter->GetOutput());
-    rescaler2->SetOutputMinimum(0);
-    rescaler2->SetOutputMaximum(255);
-    rescaler2->Update();
-
-    // Writers
+    // Writers (min/max rescale to 0-255 fused with the cast to uchar)
     using WriterType = itk::ImageFileWriter<OutputImageType>;
 
     auto writer1 = WriterType::New();
     writer1->SetFileName(outputDir + basename + "_gradmag_gauss_mean5x5_sigma" + std::to_string(sigma) + ".png");
-    writer1->SetInput(rescaler1->GetOutput());
+    writer1->SetInput(salidaUchar::Convertir(gradMagFilter->GetOutput()));
 
     auto writer2 = WriterType::New();
     writer2->SetFileName(outputDir + basename + "_gradmagRec_mean5x5_sigma" + std::to_string(sigma) + ".png");
-    writer2->SetInput(rescaler2->GetOutput());
+    writer2->SetInput(salidaUchar::Convertir(gradMagRecFilter->GetOutput()));
 
     try
     {
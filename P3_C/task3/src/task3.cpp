@@ -1,9 +1,10 @@
 #include "itkImage.h"
 #include "itkImageFileReader.h"
 #include "itkCannyEdgeDetectionImageFilter.h"
-#include "itkRescaleIntensityImageFilter.h"
 #include "itkImageFileWriter.h"
 
+#include "salidaUchar.h"
+
 #include <string>
 #include <iostream>
 #include <sstream>
@@ -52,22 +53,15 @@ int main(int argc, char *argv[])
     canny->SetUpperThreshold(upperThreshold);
     canny->Update();
 
-    // Rescale to 0-255 for output
-    using RescaleType = itk::RescaleIntensityImageFilter<ImageType, OutputImageType>;
-    auto rescaler = RescaleType::New();
-    rescaler->SetInput(canny->GetOutput());
-    rescaler->SetOutputMinimum(0);
-    rescaler->SetOutputMaximum(255);
-    rescaler->Update();
-
-    // Writer
+    // Writer. Canny marks edges with 1 and the rest with 0, so the range is
+    // known and the rescale to 0-255 needs no min/max pass
     using WriterType = itk::ImageFileWriter<OutputImageType>;
     std::ostringstream oss;
     oss << basename << "_canny_var" << variance
         << "_thr" << lowerThreshold << "-" << upperThreshold << ".png";
     auto writer = WriterType::New();
     writer->SetFileName(outputDir + oss.str());
-    writer->SetInput(rescaler->GetOutput());
+    writer->SetInput(salidaUchar::Convertir(canny->GetOutput(), 0.0, 1.0));
     writer->Update();
 
     std::cout << "Saved Canny result to: " << outputDir + oss.str() << std::endl;
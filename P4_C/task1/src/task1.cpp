@@ -1,29 +1,290 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <thread>
 
 #include "itkImage.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
+#include "itkPNGImageIO.h"
 #include "itkMedianImageFilter.h"
-#include "itkConnectedThresholdImageFilter.h"
 #include "itkNeighborhoodConnectedImageFilter.h"
 #include "itkConfidenceConnectedImageFilter.h"
-#include "itkRescaleIntensityImageFilter.h"
+
+#include "cacheSuavizado.h"
+#include "medianaHistograma.h"
+#include "poolTareas.h"
+#include "salidaUchar.h"
+
+// Definir tipos de imagen de 2D con píxel float y con píxel unsigned char para salida
+constexpr unsigned int Dimension = 2;
+using PixelType = float;
+using ImageType = itk::Image<PixelType, Dimension>;
+using OutputPixelType = unsigned char;
+using OutputImageType = itk::Image<OutputPixelType, Dimension>;
+
+// Rejilla de parámetros del barrido. Los límites de ConnectedThreshold van por
+// parejas (ctLimiteInferior[i], ctLimiteSuperior[i]); el resto se combinan todos con todos.
+struct RejillaParametros
+{
+    std::vector<PixelType> ctLimiteInferior;
+    std::vector<PixelType> ctLimiteSuperior;
+    std::vector<unsigned int> ncRadio;
+    std::vector<unsigned int> ccRadio;
+    std::vector<double> ccMultiplicador;
+    std::vector<unsigned int> ccIteraciones;
+};
+
+// Crea una imagen nueva que comparte el buffer de píxeles de 'origen' sin copiarlo.
+// Cada tarea del barrido trabaja sobre su propia vista, así los pipelines de los
+// distintos hilos no tocan el mismo DataObject (RequestedRegion, Source, ...).
+ImageType::Pointer vistaCompartida(const ImageType* origen)
+{
+    auto vista = ImageType::New();
+    vista->CopyInformation(origen);
+    vista->SetRegions(origen->GetLargestPossibleRegion());
+    vista->SetPixelContainer(const_cast<ImageType::PixelContainer*>(origen->GetPixelContainer()));
+    return vista;
+}
+
+// Crecimiento de región equivalente a ConnectedThresholdImageFilter (4-vecindad,
+// valores en [inferior, superior]) pero escribiendo directamente la máscara 0/255.
+// Si se pasa 'dominio' sólo se visitan los píxeles a 255 en él: es la región de un
+// intervalo más ancho que contiene a éste, así que el resultado es el mismo y sólo
+// se recorre esa región en lugar de la imagen completa.
+OutputImageType::Pointer crecerRegion(const ImageType* imagen,
+                                      const ImageType::IndexType& semilla,
+                                      PixelType inferior, PixelType superior,
+                                      const OutputImageType* dominio)
+{
+    const auto region = imagen->GetBufferedRegion();
+    const auto inicio = region.GetIndex();
+    const long ancho = static_cast<long>(region.GetSize()[0]);
+    const long alto  = static_cast<long>(region.GetSize()[1]);
+
+    auto mascara = OutputImageType::New();
+    mascara->CopyInformation(imagen);
+    mascara->SetRegions(region);
+    mascara->Allocate();
+    mascara->FillBuffer(0);
+
+    const long sx = semilla[0] - inicio[0];
+    const long sy = semilla[1] - inicio[1];
+    if (sx < 0 || sy < 0 || sx >= ancho || sy >= alto)
+        return mascara;
+
+    const PixelType* valores = imagen->GetBufferPointer();
+    const OutputPixelType* permitido = dominio ? dominio->GetBufferPointer() : nullptr;
+    OutputPixelType* salida = mascara->GetBufferPointer();
+
+    auto dentro = [&](long p) {
+        return (!permitido || permitido[p]) && valores[p] >= inferior && valores[p] <= superior;
+    };
+
+    std::vector<long> pila;
+    const long p0 = sy * ancho + sx;
+    if (!dentro(p0))
+        return mascara;
+    salida[p0] = 255;
+    pila.push_back(p0);
+
+    while (!pila.empty())
+    {
+        const long p = pila.back();
+        pila.pop_back();
+        const long x = p % ancho;
+        const long y = p / ancho;
+        const long vecinos[4] = { x > 0 ? p - 1 : -1, x + 1 < ancho ? p + 1 : -1,
+                                  y > 0 ? p - ancho : -1, y + 1 < alto ? p + ancho : -1 };
+        for (long q : vecinos)
+        {
+            if (q >= 0 && !salida[q] && dentro(q))
+            {
+                salida[q] = 255;
+                pila.push_back(q);
+            }
+        }
+    }
+    return mascara;
+}
+
+// Escribe una imagen uchar en PNG. Se fija PNGImageIO explícitamente para no pasar
+// por la factoría de ImageIO desde varios hilos a la vez.
+void escribirPNG(const OutputImageType* imagen, const std::string& nombre)
+{
+    auto escritor = itk::ImageFileWriter<OutputImageType>::New();
+    escritor->SetImageIO(itk::PNGImageIO::New());
+    escritor->SetInput(imagen);
+    escritor->SetFileName(nombre);
+    escritor->Update();
+}
+
+// Reescala la salida de un filtro de segmentación a [0,255] y la guarda.
+void reescalarYEscribir(const ImageType* imagen, const std::string& nombre)
+{
+    escribirPNG(salidaUchar::Convertir(imagen), nombre);
+}
+
+// Prepara todas las tareas de segmentación para una imagen 'procesada' (de sólo
+// lectura y compartida por todas ellas).
+std::vector<std::function<void()>> tareasBarrido(const ImageType::Pointer& procesada,
+                                                 const ImageType::IndexType& semilla,
+                                                 const RejillaParametros& rejilla,
+                                                 const std::string& prefijoNombre,
+                                                 double sigma)
+{
+    std::vector<std::function<void()>> tareas;
+
+    // 3) ConnectedThreshold: se ordenan los intervalos de más ancho a más estrecho y
+    // cada uno cuelga del intervalo más estrecho ya visto que lo contiene. Cada
+    // cadena (intervalo raíz + descendientes) es una tarea: la raíz se crece sobre la
+    // imagen entera y el resto sólo dentro de la región de su padre.
+    const size_t numCT = std::min(rejilla.ctLimiteInferior.size(), rejilla.ctLimiteSuperior.size());
+    std::vector<size_t> orden(numCT);
+    for (size_t i = 0; i < numCT; ++i)
+        orden[i] = i;
+    auto anchura = [&](size_t i) { return rejilla.ctLimiteSuperior[i] - rejilla.ctLimiteInferior[i]; };
+    std::stable_sort(orden.begin(), orden.end(), [&](size_t a, size_t b) { return anchura(a) > anchura(b); });
+
+    std::vector<long> padre(numCT, -1);
+    std::vector<size_t> raiz(numCT);
+    for (size_t k = 0; k < numCT; ++k)
+    {
+        const size_t i = orden[k];
+        raiz[i] = i;
+        for (size_t j = 0; j < k; ++j)
+        {
+            const size_t c = orden[j];
+            if (rejilla.ctLimiteInferior[c] <= rejilla.ctLimiteInferior[i] &&
+                rejilla.ctLimiteSuperior[i] <= rejilla.ctLimiteSuperior[c])
+            {
+                padre[i] = static_cast<long>(c); // el último encontrado es el más estrecho
+                raiz[i] = raiz[c];
+            }
+        }
+    }
+
+    for (size_t r = 0; r < numCT; ++r)
+    {
+        if (padre[r] != -1)
+            continue;
+        std::vector<size_t> cadena;
+        for (size_t i : orden)
+            if (raiz[i] == r)
+                cadena.push_back(i);
+
+        tareas.emplace_back([=, &rejilla]() {
+            std::vector<OutputImageType::Pointer> mascaras(rejilla.ctLimiteInferior.size());
+            for (size_t i : cadena)
+            {
+                const OutputImageType* dominio = (padre[i] == -1) ? nullptr : mascaras[padre[i]].GetPointer();
+                mascaras[i] = crecerRegion(procesada, semilla, rejilla.ctLimiteInferior[i],
+                                           rejilla.ctLimiteSuperior[i], dominio);
+
+                std::ostringstream nombreSalida;
+                nombreSalida << prefijoNombre << "_CT_"
+                             << "sigma" << sigma
+                             << "_L" << rejilla.ctLimiteInferior[i]
+                             << "_U" << rejilla.ctLimiteSuperior[i]
+                             << ".png";
+                escribirPNG(mascaras[i], nombreSalida.str());
+            }
+        });
+    }
+
+    // 4) NeighborhoodConnectedImageFilter
+    for (auto radio : rejilla.ncRadio)
+    {
+        tareas.emplace_back([=]() {
+            using NCFilterType = itk::NeighborhoodConnectedImageFilter<ImageType, ImageType>;
+            auto filtroNC = NCFilterType::New();
+            filtroNC->SetInput(vistaCompartida(procesada));
+            filtroNC->SetSeed(semilla);
+            typename NCFilterType::InputImageSizeType radiusSize;
+            radiusSize.Fill(radio);
+            filtroNC->SetRadius(radiusSize);
+            filtroNC->SetReplaceValue(255.0f);
+            filtroNC->Update();
+
+            std::ostringstream nombreSalida;
+            nombreSalida << prefijoNombre << "_NC_"
+                         << "sigma" << sigma
+                         << "_R" << radio
+                         << ".png";
+            reescalarYEscribir(filtroNC->GetOutput(), nombreSalida.str());
+        });
+    }
+
+    // 5) ConfidenceConnectedImageFilter
+    for (auto radio : rejilla.ccRadio)
+    {
+        for (auto mult : rejilla.ccMultiplicador)
+        {
+            for (auto iter : rejilla.ccIteraciones)
+            {
+                tareas.emplace_back([=]() {
+                    using CCFilterType = itk::ConfidenceConnectedImageFilter<ImageType, ImageType>;
+                    auto filtroCC = CCFilterType::New();
+                    filtroCC->SetInput(vistaCompartida(procesada));
+                    filtroCC->SetSeed(semilla);
+                    filtroCC->SetInitialNeighborhoodRadius(radio);
+                    filtroCC->SetMultiplier(mult);
+                    filtroCC->SetNumberOfIterations(iter);
+                    filtroCC->SetReplaceValue(255.0f);
+                    filtroCC->Update();
+
+                    std::ostringstream nombreSalida;
+                    nombreSalida << prefijoNombre << "_CC_"
+                                 << "sigma" << sigma
+                                 << "_R" << radio
+                                 << "_M" << mult
+                                 << "_It" << iter
+                                 << ".png";
+                    reescalarYEscribir(filtroCC->GetOutput(), nombreSalida.str());
+                });
+            }
+        }
+    }
+
+    return tareas;
+}
 
 int main(int argc, char* argv[])
 {
     // Comprobar argumentos de entrada
+    auto uso = [&]() {
+        std::cerr << "Uso: " << argv[0]
+                  << " <imagenEntrada> <prefijoSalida> [numHilos]" << std::endl;
+    };
     if (argc < 3)
     {
-        std::cerr << "Uso: " << argv[0]
-                  << " <imagenEntrada> <prefijoSalida>" << std::endl;
+        uso();
         return EXIT_FAILURE;
     }
     // Ruta completa de la imagen de entrada
     const std::string rutaEntrada = argv[1];
     const std::string prefijoSalida = argv[2];
 
+    // Hilos del barrido (por defecto, todos los núcleos; 1 = ejecución en serie)
+    unsigned int numHilos = std::max(1u, std::thread::hardware_concurrency());
+    if (argc >= 4)
+    {
+        try
+        {
+            numHilos = std::max(1, std::stoi(argv[3]));
+        }
+        catch (const std::exception&)
+        {
+            std::cerr << "Numero de hilos no valido: " << argv[3] << std::endl;
+            uso();
+            return EXIT_FAILURE;
+        }
+    }
+
     // Extraer nombre base de la imagen (sin ruta ni extensión)
     std::string fichero = rutaEntrada;
     // Obtener sólo el último componente tras '/' o '\'
@@ -34,13 +295,6 @@ int main(int argc, char* argv[])
     auto posDot = fichero.rfind('.');
     std::string nombreBase = (posDot != std::string::npos) ? fichero.substr(0, posDot) : fichero;
 
-    // Definir tipos de imagen de 2D con píxel float y con píxel unsigned char para salida
-    constexpr unsigned int Dimension = 2;
-    using PixelType = float;
-    using ImageType = itk::Image<PixelType, Dimension>;
-    using OutputPixelType = unsigned char;
-    using OutputImageType = itk::Image<OutputPixelType, Dimension>;
-
     // Lector de imagen
     auto lector = itk::ImageFileReader<ImageType>::New();
     lector->SetFileName(rutaEntrada);
@@ -54,18 +308,22 @@ int main(int argc, char* argv[])
     semilla[0] = 128;
     semilla[1] = 128;
 
-    // Parámetros para ConnectedThresholdImageFilter
-    std::vector<PixelType> ctLimiteInferior = { 15.0f,50.0f, 80.0f };
-    std::vector<PixelType> ctLimiteSuperior = { 100.0f,150.0f, 200.0f };
+    RejillaParametros rejilla;
+    // Parámetros para ConnectedThresholdImageFilter. Ninguno de estos intervalos
+    // contiene a otro, así que cada uno se crece sobre la imagen entera; el
+    // crecimiento dentro del padre sólo actúa con intervalos anidados.
+    rejilla.ctLimiteInferior = { 15.0f,50.0f, 80.0f };
+    rejilla.ctLimiteSuperior = { 100.0f,150.0f, 200.0f };
 
     // Parámetros para NeighborhoodConnectedImageFilter
-    std::vector<unsigned int> ncRadio = { 1, 3 };
+    rejilla.ncRadio = { 1, 3 };
 
     // Parámetros para ConfidenceConnectedImageFilter
-    std::vector<unsigned int> ccRadio = { 1, 2 };
-    std::vector<double> ccMultiplicador = { 1.0, 2.5 };
-    std::vector<unsigned int> ccIteraciones = { 1, 3 };
+    rejilla.ccRadio = { 1, 2 };
+    rejilla.ccMultiplicador = { 1.0, 2.5 };
+    rejilla.ccIteraciones = { 1, 3 };
 
+    bool correcto = true;
     for (double sigma : sigmasSuavizado)
     {
         // 1. Obtener puntero a la imagen (sin suavizar o suavizada)
@@ -74,140 +332,37 @@ int main(int argc, char* argv[])
         // 2. Si sigma>0, aplicar MedianImageFilter 5×5
         if (sigma > 0.0)
         {
-            using MedianFilterType = itk::MedianImageFilter<ImageType, ImageType>;
-            auto mediana = MedianFilterType::New();
-            mediana->SetInput(lector->GetOutput());
-            typename MedianFilterType::InputSizeType radius;
-            radius.Fill(2); // vecindario 5×5
-            mediana->SetRadius(radius);
-            mediana->Update();
-            procesada = mediana->GetOutput();
+            procesada = cacheSuavizado::obtener<ImageType>(rutaEntrada, "median_r2", [&]() {
+                // vecindario 5×5; por histogramas o con MedianImageFilter según TVG_MEDIANA
+                return medianaHistograma::Mediana<ImageType>(lector->GetOutput(), 2);
+            });
         }
 
         // --- BLOQUE NUEVO: guardar 'procesada' antes de segmentar ---
         {
-            using RescaleType = itk::RescaleIntensityImageFilter<ImageType, OutputImageType>;
-            auto rescaleProc = RescaleType::New();
-            rescaleProc->SetInput(procesada);
-            rescaleProc->SetOutputMinimum(0);
-            rescaleProc->SetOutputMaximum(255);
-            rescaleProc->Update();
-
             std::ostringstream nombreProc;
             nombreProc << nombreBase << "_"               // <-- Nombre de la imagen original
                        << prefijoSalida << "_processed_"   // <-- tu prefijo
                        << "sigma" << sigma << ".png";      // <-- sufijo
-            auto writerProc = itk::ImageFileWriter<OutputImageType>::New();
-            writerProc->SetInput(rescaleProc->GetOutput());
-            writerProc->SetFileName(nombreProc.str());
-            writerProc->Update();
+            salidaUchar::Escribir(procesada.GetPointer(), nombreProc.str());
         }
         // --- FIN BLOQUE NUEVO ---
 
-        // 3) ConnectedThresholdImageFilter
-        for (size_t i = 0; i < ctLimiteInferior.size(); ++i)
-        {
-            using CTFilterType = itk::ConnectedThresholdImageFilter<ImageType, ImageType>;
-            auto filtroCT = CTFilterType::New();
-            filtroCT->SetInput(procesada);
-            filtroCT->SetLower(ctLimiteInferior[i]);
-            filtroCT->SetUpper(ctLimiteSuperior[i]);
-            filtroCT->SetSeed(semilla);
-            filtroCT->Update();
-
-            using RescaleType = itk::RescaleIntensityImageFilter<ImageType, OutputImageType>;
-            auto rescale = RescaleType::New();
-            rescale->SetInput(filtroCT->GetOutput());
-            rescale->SetOutputMinimum(0);
-            rescale->SetOutputMaximum(255);
-            rescale->Update();
-
-            std::ostringstream nombreSalida;
-            nombreSalida << nombreBase << "_"
-                         << prefijoSalida << "_CT_"
-                         << "sigma" << sigma
-                         << "_L" << ctLimiteInferior[i]
-                         << "_U" << ctLimiteSuperior[i]
-                         << ".png";
-            auto escritor = itk::ImageFileWriter<OutputImageType>::New();
-            escritor->SetInput(rescale->GetOutput());
-            escritor->SetFileName(nombreSalida.str());
-            escritor->Update();
-        }
-
-        // 4) NeighborhoodConnectedImageFilter
-        for (auto radio : ncRadio)
-        {
-            using NCFilterType = itk::NeighborhoodConnectedImageFilter<ImageType, ImageType>;
-            auto filtroNC = NCFilterType::New();
-            filtroNC->SetInput(procesada);
-            filtroNC->SetSeed(semilla);
-            typename NCFilterType::InputImageSizeType radiusSize;
-            radiusSize.Fill(radio);
-            filtroNC->SetRadius(radiusSize);
-            filtroNC->SetReplaceValue(255.0f);
-            filtroNC->Update();
-
-            using RescaleType = itk::RescaleIntensityImageFilter<ImageType, OutputImageType>;
-            auto rescale = RescaleType::New();
-            rescale->SetInput(filtroNC->GetOutput());
-            rescale->SetOutputMinimum(0);
-            rescale->SetOutputMaximum(255);
-            rescale->Update();
-
-            std::ostringstream nombreSalida;
-            nombreSalida << nombreBase << "_"
-                         << prefijoSalida << "_NC_"
-                         << "sigma" << sigma
-                         << "_R" << radio
-                         << ".png";
-            auto escritorNC = itk::ImageFileWriter<OutputImageType>::New();
-            escritorNC->SetInput(rescale->GetOutput());
-            escritorNC->SetFileName(nombreSalida.str());
-            escritorNC->Update();
-        }
-
-        // 5) ConfidenceConnectedImageFilter
-        for (auto radio : ccRadio)
-        {
-            for (auto mult : ccMultiplicador)
-            {
-                for (auto iter : ccIteraciones)
-                {
-                    using CCFilterType = itk::ConfidenceConnectedImageFilter<ImageType, ImageType>;
-                    auto filtroCC = CCFilterType::New();
-                    filtroCC->SetInput(procesada);
-                    filtroCC->SetSeed(semilla);
-                    filtroCC->SetInitialNeighborhoodRadius(radio);
-                    filtroCC->SetMultiplier(mult);
-                    filtroCC->SetNumberOfIterations(iter);
-                    filtroCC->SetReplaceValue(255.0f);
-                    filtroCC->Update();
-
-                    using RescaleType = itk::RescaleIntensityImageFilter<ImageType, OutputImageType>;
-                    auto rescale = RescaleType::New();
-                    rescale->SetInput(filtroCC->GetOutput());
-                    rescale->SetOutputMinimum(0);
-                    rescale->SetOutputMaximum(255);
-                    rescale->Update();
+        // 3-5) Barrido de parámetros: todas las combinaciones en paralelo sobre la
+        // misma imagen 'procesada'
+        const auto t0 = std::chrono::steady_clock::now();
+        const auto tareas = tareasBarrido(procesada, semilla, rejilla,
+                                          nombreBase + "_" + prefijoSalida, sigma);
+        correcto = poolTareas::ejecutar(tareas, numHilos, "Error en el barrido") && correcto;
+        const std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - t0;
 
-                    std::ostringstream nombreSalida;
-                    nombreSalida << nombreBase << "_"
-                                 << prefijoSalida << "_CC_"
-                                 << "sigma" << sigma
-                                 << "_R" << radio
-                                 << "_M" << mult
-                                 << "_It" << iter
-                                 << ".png";
-                    auto escritorCC = itk::ImageFileWriter<OutputImageType>::New();
-                    escritorCC->SetInput(rescale->GetOutput());
-                    escritorCC->SetFileName(nombreSalida.str());
-                    escritorCC->Update();
-                }
-            }
-        }
+        std::cout << "Barrido sigma=" << sigma << ": " << tareas.size() << " tareas, "
+                  << numHilos << " hilos, " << ms.count() << " ms" << std::endl;
     }
 
+    if (!correcto)
+        return EXIT_FAILURE;
+
     std::cout << "Procesamiento completado." << std::endl;
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -2,7 +2,12 @@
 #include <string>
 #include <vector>
 #include <iomanip>
+#include <set>
 #include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <thread>
 
 #include "itkImage.h"
 #include "itkImageFileReader.h"
@@ -11,21 +16,61 @@
 #include "itkMedianImageFilter.h"
 #include "itkGradientMagnitudeImageFilter.h"
 #include "itkWatershedImageFilter.h"
-#include "itkCastImageFilter.h"
-#include "itkRescaleIntensityImageFilter.h"
+#include "itkImageDuplicator.h"
+#include "itkPNGImageIO.h"
+
+#include "cacheSuavizado.h"
+#include "medianaHistograma.h"
+#include "poolTareas.h"
+#include "salidaUchar.h"
+
+// Decimales con los que se escriben 'valores' (distintos entre sí) en los
+// nombres de salida: 'minimo', el formato de siempre, y más sólo si dos
+// valores darían el mismo texto (p.ej. niveles 0.25 y 0.2 con un decimal).
+int decimalesDistintos(const std::vector<double>& valores, int minimo)
+{
+  const int maximo = 12;
+  for (int d = minimo; d < maximo; ++d)
+  {
+    std::set<std::string> textos;
+    for (double v : valores)
+    {
+      std::ostringstream os;
+      os << std::fixed << std::setprecision(d) << v;
+      textos.insert(os.str());
+    }
+    if (textos.size() == valores.size())
+      return d;
+  }
+  return maximo;
+}
 
 int main(int argc, char* argv[])
 {
+  auto uso = [&]() {
+    std::cerr << "Uso: " << argv[0]
+              << " <imagenEntrada> <prefijoSalida> [jerarquia|completo] [nivel1,nivel2,...]" << std::endl;
+  };
   if (argc < 3)
   {
-    std::cerr << "Uso: " << argv[0]
-              << " <imagenEntrada> <prefijoSalida>" << std::endl;
+    uso();
     return EXIT_FAILURE;
   }
 
   const std::string inputFile = argv[1];
   const std::string prefix    = argv[2];
 
+  // Modo "jerarquia" (por defecto): un único watershed por threshold; el árbol de
+  // fusión se calcula para el nivel más alto y los demás niveles son cortes de ese
+  // árbol (sólo se repite el relabeler). Modo "completo": un filtro nuevo por cada
+  // par (threshold, level), como antes.
+  const std::string modoWS = (argc > 3) ? argv[3] : "jerarquia";
+  if (modoWS != "jerarquia" && modoWS != "completo")
+  {
+    std::cerr << "Modo desconocido: " << modoWS << std::endl;
+    return EXIT_FAILURE;
+  }
+
   // Extraer baseName sin ruta ni extensión
   std::string fname = inputFile;
   auto posSlash = fname.find_last_of("/\\");
@@ -39,7 +84,6 @@ int main(int argc, char* argv[])
   using FloatImage = itk::Image<float,Dimension>;
   using WatershedFilterType = itk::WatershedImageFilter<FloatImage>;
   using LabelImage         = WatershedFilterType::OutputImageType;
-  using UCharImage         = itk::Image<unsigned char,Dimension>;
 
   // Leer imagen
   auto reader = itk::ImageFileReader<FloatImage>::New();
@@ -52,6 +96,46 @@ int main(int argc, char* argv[])
   // Parámetros de watershed
   std::vector<double> thresholds = { 0.001, 0.005, 0.01 };
   std::vector<double> levels     = { 0.1, 0.2, 0.3, 0.4 };
+  if (argc > 4)
+  {
+    levels.clear();
+    std::istringstream lista(argv[4]);
+    std::string valor;
+    while (std::getline(lista, valor, ','))
+    {
+      size_t leidos = 0;
+      try
+      {
+        levels.push_back(std::stod(valor, &leidos));
+      }
+      catch (const std::exception&)
+      {
+        leidos = 0;
+      }
+      if (leidos == 0 || leidos != valor.size())
+      {
+        std::cerr << "Nivel no válido: '" << valor << "'" << std::endl;
+        uso();
+        return EXIT_FAILURE;
+      }
+    }
+    if (levels.empty())
+    {
+      uso();
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Niveles de mayor a menor: el primero construye el árbol hasta el nivel más
+  // alto y los siguientes ya no necesitan volver a generarlo.
+  std::vector<double> nivelesOrdenados = levels;
+  std::sort(nivelesOrdenados.rbegin(), nivelesOrdenados.rend());
+  nivelesOrdenados.erase(std::unique(nivelesOrdenados.begin(), nivelesOrdenados.end()), nivelesOrdenados.end());
+  const int decimalesT = decimalesDistintos(thresholds, 3);
+  const int decimalesL = decimalesDistintos(nivelesOrdenados, 1);
+
+  const unsigned int numHilos = std::max(1u, std::thread::hardware_concurrency());
+  bool correcto = true;
 
   for (const auto& modo : modos)
   {
@@ -61,41 +145,31 @@ int main(int argc, char* argv[])
     // 2) Suavizado según el modo
     if (modo == "curvature")
     {
-      using CurvatureFlowType = itk::CurvatureFlowImageFilter<FloatImage,FloatImage>;
-      auto flow = CurvatureFlowType::New();
-      flow->SetInput(proc);
-      // **Parámetros exactos del ejemplo**:
-      flow->SetNumberOfIterations(14);
-      flow->SetTimeStep(0.0025);
-      flow->Update();
-      proc = flow->GetOutput();
+      // **Parámetros exactos del ejemplo**: 14 iteraciones, paso 0.0025
+      proc = cacheSuavizado::obtener<FloatImage>(inputFile, "curvatureFlow_it14_ts0.0025", [&]() {
+        using CurvatureFlowType = itk::CurvatureFlowImageFilter<FloatImage,FloatImage>;
+        auto flow = CurvatureFlowType::New();
+        flow->SetInput(reader->GetOutput());
+        flow->SetNumberOfIterations(14);
+        flow->SetTimeStep(0.0025);
+        flow->Update();
+        return FloatImage::Pointer(flow->GetOutput());
+      });
     }
     else if (modo == "median")
     {
-      auto med = itk::MedianImageFilter<FloatImage,FloatImage>::New();
-      typename FloatImage::SizeType radius; radius.Fill(2);
-      med->SetRadius(radius);
-      med->SetInput(proc);
-      med->Update();
-      proc = med->GetOutput();
+      proc = cacheSuavizado::obtener<FloatImage>(inputFile, "median_r2", [&]() {
+        // 5x5; por histogramas o con MedianImageFilter según TVG_MEDIANA
+        return medianaHistograma::Mediana<FloatImage>(reader->GetOutput(), 2);
+      });
     }
 
     // 3) Guardar imagen pre‐watershed
     {
-      using RescaleType = itk::RescaleIntensityImageFilter<FloatImage,UCharImage>;
-      auto res = RescaleType::New();
-      res->SetInput(proc);
-      res->SetOutputMinimum(0);
-      res->SetOutputMaximum(255);
-      res->Update();
-
       std::ostringstream name;
       name << baseName << "_" << prefix
            << "_" << modo << "_processed.png";
-      auto writer = itk::ImageFileWriter<UCharImage>::New();
-      writer->SetFileName(name.str());
-      writer->SetInput(res->GetOutput());
-      writer->Update();
+      salidaUchar::Escribir(proc.GetPointer(), name.str());
     }
 
     // 4) Calcular el gradiente de magnitud
@@ -103,49 +177,61 @@ int main(int argc, char* argv[])
     grad->SetInput(proc);
     grad->Update();
 
-    // 5) Ejecutar Watershed con todas las combinaciones
+    // 5) Ejecutar Watershed con todas las combinaciones. Cada salida se duplica y
+    // su conversión a uchar y escritura en PNG se ejecutan después en paralelo.
+    std::vector<std::function<void()>> salidas;
+    const auto t0 = std::chrono::steady_clock::now();
     for (double t : thresholds)
     {
-      for (double l : levels)
+      WatershedFilterType::Pointer ws;
+      for (double l : nivelesOrdenados)
       {
-        auto ws = WatershedFilterType::New();
-        ws->SetInput(grad->GetOutput());
-        ws->SetThreshold(t);
+        if (!ws || modoWS == "completo")
+        {
+          ws = WatershedFilterType::New();
+          ws->SetInput(grad->GetOutput());
+          ws->SetThreshold(t);
+        }
         ws->SetLevel(l);
         ws->Update();
 
-        // Castear la salida de etiquetas a float
-        using CastType = itk::CastImageFilter<LabelImage,FloatImage>;
-        auto caster = CastType::New();
-        caster->SetInput(ws->GetOutput());
-        caster->Update();
-
-        // Reescalar a unsigned char para visualizar
-        using RescaleType = itk::RescaleIntensityImageFilter<FloatImage,UCharImage>;
-        auto res = RescaleType::New();
-        res->SetInput(caster->GetOutput());
-        res->SetOutputMinimum(0);
-        res->SetOutputMaximum(255);
-        res->Update();
+        // Copia propia de las etiquetas: la siguiente actualización del filtro
+        // reutiliza el buffer de salida
+        auto duplicador = itk::ImageDuplicator<LabelImage>::New();
+        duplicador->SetInputImage(ws->GetOutput());
+        duplicador->Update();
+        LabelImage::Pointer etiquetas = duplicador->GetOutput();
 
         // Nombre de salida
         std::ostringstream out;
         out << baseName << "_" << prefix
             << "_WS_" << modo
-            << "_T" << std::fixed << std::setprecision(3) << t
-            << "_L" << std::fixed << std::setprecision(1) << l
+            << "_T" << std::fixed << std::setprecision(decimalesT) << t
+            << "_L" << std::fixed << std::setprecision(decimalesL) << l
             << ".png";
-
-        auto writer = itk::ImageFileWriter<UCharImage>::New();
-        writer->SetFileName(out.str());
-        writer->SetInput(res->GetOutput());
-        writer->Update();
-
-        std::cout << "Guardado: " << out.str() << std::endl;
+        const std::string nombre = out.str();
+
+        salidas.emplace_back([etiquetas, nombre]() {
+          // Etiquetas reescaladas a unsigned char para visualizar, en una sola
+          // pasada (sin la imagen float intermedia de Cast -> Rescale).
+          // PNGImageIO explícito para no usar la factoría desde varios hilos
+          salidaUchar::Escribir(etiquetas.GetPointer(), nombre, itk::PNGImageIO::New());
+        });
       }
     }
+    const std::chrono::duration<double, std::milli> msWS = std::chrono::steady_clock::now() - t0;
+
+    correcto = poolTareas::ejecutar(salidas, numHilos) && correcto;
+    const std::chrono::duration<double, std::milli> msTotal = std::chrono::steady_clock::now() - t0;
+
+    std::cout << "Watershed " << modo << " (" << modoWS << "): " << salidas.size()
+              << " salidas, segmentación " << msWS.count() << " ms, total "
+              << msTotal.count() << " ms" << std::endl;
   }
 
+  if (!correcto)
+    return EXIT_FAILURE;
+
   std::cout << "Watershed segmentación finalizada." << std::endl;
   return EXIT_SUCCESS;
 }
@@ -1,32 +1,104 @@
 // DicomToPng.cxx
+//
+// Uso:
+//   ejercicio <input.dcm> <output.png> [ventana]
+//   ejercicio --servidor [socket] [numHilos] [ventana]
+//
+// 'ventana' decide cómo se pasa a 8 bits:
+//   dicom   (por defecto) Window Center/Width del fichero; si no las tiene,
+//           reescalado mínimo/máximo
+//   minmax  reescalado del rango [mínimo, máximo] de la imagen
+//   cerebro | blando | pulmon | hueso | higado | mediastino, o "centro,anchura"
+//
+// En modo servidor el proceso no termina tras una conversión: lee trabajos
+// "<input.dcm> [output.png]" (uno por línea; si falta la salida se usa la
+// entrada con extensión .png) de la entrada estándar o, si se indica, de un
+// socket Unix local, y los pasa por un pipeline acotado de tres etapas
+// (decodificar -> reescalar -> codificar PNG). Cada hilo de decodificación y
+// de codificación conserva su lector/escritor e ImageIO entre trabajos. Por
+// cada trabajo se imprime su latencia y cada pocos segundos el rendimiento.
 #include "itkImage.h"
 #include "itkImageFileReader.h"
 #include "itkGDCMImageIO.h"
-#include "itkRescaleIntensityImageFilter.h"
-#include "itkCastImageFilter.h"
 #include "itkImageFileWriter.h"
+#include "itkPNGImageIO.h"
 
+#include "procesadoLotes.h"
+#include "salidaUchar.h"
+#include "ventanaDicom.h"
+
+#include <itksys/SystemTools.hxx>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
-int main(int argc, char* argv[])
+#if defined(__unix__) || defined(__APPLE__)
+#define EJERCICIO_SOCKET_UNIX
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+constexpr unsigned int Dimension = 2;
+using InputPixelType  = signed short;           // tipo típico en DICOM
+using OutputPixelType = unsigned char;          // PNG 8-bit
+using InputImageType  = itk::Image<InputPixelType, Dimension>;
+using OutputImageType = itk::Image<OutputPixelType, Dimension>;
+using Reloj           = std::chrono::steady_clock;
+
+// Modo de paso a 8 bits elegido en la línea de órdenes
+struct ModoVentana
 {
-    if (argc != 3)
-    {
-        std::cerr << "Uso: " << argv[0]
-                  << " <input.dcm> <output.png>" << std::endl;
-        return EXIT_FAILURE;
-    }
+    enum Tipo { Dicom, MinMax, Fija } tipo = Dicom;
+    ventanaDicom::Ventana fija;
+};
 
-    const char*  dicomFile = argv[1];
-    const char*  pngFile   = argv[2];
+static bool analizarModo(const std::string& texto, ModoVentana& modo)
+{
+    if (texto == "dicom")
+        modo.tipo = ModoVentana::Dicom;
+    else if (texto == "minmax")
+        modo.tipo = ModoVentana::MinMax;
+    else if (ventanaDicom::DesdeTexto(texto, modo.fija))
+        modo.tipo = ModoVentana::Fija;
+    else
+        return false;
+    return true;
+}
 
-    constexpr unsigned int Dimension = 2;
-    using InputPixelType  = signed short;           // tipo típico en DICOM
-    using OutputPixelType = unsigned char;          // PNG 8-bit
-    using InputImageType  = itk::Image<InputPixelType, Dimension>;
-    using MidImageType    = itk::Image<float, Dimension>;
-    using OutputImageType = itk::Image<OutputPixelType, Dimension>;
+// Paso a uchar según el modo. 'tabla' conserva la última tabla de ventana para
+// no recalcularla mientras no cambie la ventana (p.ej. toda una serie).
+static OutputImageType::Pointer aUchar(const InputImageType* imagen, const ModoVentana& modo,
+                                       std::unique_ptr<ventanaDicom::Tabla<InputPixelType>>& tabla)
+{
+    ventanaDicom::Ventana ventana = modo.fija;
+    if (modo.tipo == ModoVentana::MinMax ||
+        (modo.tipo == ModoVentana::Dicom &&
+         !ventanaDicom::DesdeEtiquetas(imagen->GetMetaDataDictionary(), ventana)))
+    {
+        // Mismo resultado que Rescale a float + Cast, en una sola pasada
+        return salidaUchar::Convertir<float>(imagen);
+    }
+    if (!tabla || tabla->GetVentana().centro != ventana.centro ||
+        tabla->GetVentana().anchura != ventana.anchura)
+        tabla.reset(new ventanaDicom::Tabla<InputPixelType>(ventana));
+    return ventanaDicom::Convertir(imagen, *tabla);
+}
 
+// Conversión de un único fichero (modo original)
+static int convertir(const char* dicomFile, const char* pngFile, const ModoVentana& modo)
+{
     // 1) Lector DICOM explícito
     auto dicomIO = itk::GDCMImageIO::New();
     auto reader  = itk::ImageFileReader<InputImageType>::New();
@@ -41,20 +113,14 @@ int main(int argc, char* argv[])
         return EXIT_FAILURE;
     }
 
-    // 2) Reescalar intensidad a rango [0,255]
-    auto rescaler = itk::RescaleIntensityImageFilter<InputImageType, MidImageType>::New();
-    rescaler->SetInput(reader->GetOutput());
-    rescaler->SetOutputMinimum(   0.0 );
-    rescaler->SetOutputMaximum( 255.0 );
-
-    // 3) Castear a unsigned char
-    auto caster = itk::CastImageFilter<MidImageType, OutputImageType>::New();
-    caster->SetInput(rescaler->GetOutput());
+    // 2) Ventana (o reescalado) a [0,255] en unsigned char
+    std::unique_ptr<ventanaDicom::Tabla<InputPixelType>> tabla;
+    auto convertida = aUchar(reader->GetOutput(), modo, tabla);
 
-    // 4) Escribir PNG
+    // 3) Escribir PNG
     auto writer = itk::ImageFileWriter<OutputImageType>::New();
     writer->SetFileName(pngFile);
-    writer->SetInput(caster->GetOutput());
+    writer->SetInput(convertida);
 
     try {
         writer->Update();
@@ -67,3 +133,403 @@ int main(int argc, char* argv[])
     std::cout << "Convertido: " << dicomFile << " → " << pngFile << std::endl;
     return EXIT_SUCCESS;
 }
+
+// ---------------------------------------------------------------------------
+// Modo servidor
+// ---------------------------------------------------------------------------
+
+// Conexión de un cliente del socket. Se cierra cuando ya no la usa ni su hilo
+// lector ni ningún trabajo pendiente, así el descriptor no se reutiliza para
+// otra conexión mientras quedan respuestas por enviar.
+struct Cliente
+{
+    int        fd = -1;
+    std::mutex mutex;
+
+    explicit Cliente(int descriptor) : fd(descriptor) {}
+    ~Cliente()
+    {
+#ifdef EJERCICIO_SOCKET_UNIX
+        if (fd >= 0)
+            close(fd);
+#endif
+    }
+
+    void Responder(const std::string& linea)
+    {
+#ifdef EJERCICIO_SOCKET_UNIX
+        std::lock_guard<std::mutex> lock(mutex);
+        const std::string texto = linea + "\n";
+        size_t enviado = 0;
+        while (enviado < texto.size())
+        {
+            int flags = 0;
+#ifdef MSG_NOSIGNAL
+            flags = MSG_NOSIGNAL; // el cliente puede haberse ido
+#endif
+            const ssize_t n = send(fd, texto.data() + enviado, texto.size() - enviado, flags);
+            if (n <= 0)
+                return;
+            enviado += static_cast<size_t>(n);
+        }
+#else
+        (void)linea;
+#endif
+    }
+};
+
+struct Trabajo
+{
+    std::string                  entrada;
+    std::string                  salida;
+    Reloj::time_point            llegada;
+    std::shared_ptr<Cliente>     cliente;
+    InputImageType::Pointer      decodificada;
+    OutputImageType::Pointer     convertida;
+};
+
+// Contadores compartidos por las etapas y el hilo de estadísticas
+struct Estadisticas
+{
+    std::atomic<unsigned long> completados{ 0 };
+    std::atomic<unsigned long> errores{ 0 };
+    std::mutex                 mutexSalida;
+};
+
+static double msDesde(Reloj::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(Reloj::now() - t0).count();
+}
+
+static void terminar(Estadisticas& est, const Trabajo& t, const std::string& error)
+{
+    std::ostringstream linea;
+    linea << std::fixed << std::setprecision(1);
+    if (error.empty())
+    {
+        ++est.completados;
+        linea << "OK " << t.entrada << " -> " << t.salida << " " << msDesde(t.llegada) << " ms";
+    }
+    else
+    {
+        ++est.errores;
+        linea << "ERROR " << t.entrada << " " << msDesde(t.llegada) << " ms: " << error;
+    }
+    {
+        std::lock_guard<std::mutex> lock(est.mutexSalida);
+        std::cout << linea.str() << std::endl;
+    }
+    if (t.cliente)
+        t.cliente->Responder(linea.str());
+}
+
+// "<entrada> [salida]": separados por tabulador si lo hay (rutas con espacios),
+// si no por el primer espacio.
+static bool analizarTrabajo(std::string linea, Trabajo& t)
+{
+    while (!linea.empty() && (linea.back() == '\r' || linea.back() == ' ' || linea.back() == '\t'))
+        linea.pop_back();
+    const size_t inicio = linea.find_first_not_of(" \t");
+    if (inicio == std::string::npos)
+        return false;
+    linea = linea.substr(inicio);
+
+    size_t sep = linea.find('\t');
+    if (sep == std::string::npos)
+        sep = linea.find(' ');
+    t.entrada = linea.substr(0, sep);
+    if (sep != std::string::npos)
+    {
+        const size_t s = linea.find_first_not_of(" \t", sep);
+        if (s != std::string::npos)
+            t.salida = linea.substr(s);
+    }
+    if (t.salida.empty())
+    {
+        const std::string dir = itksys::SystemTools::GetFilenamePath(t.entrada);
+        t.salida = (dir.empty() ? "" : dir + "/") +
+                   itksys::SystemTools::GetFilenameWithoutLastExtension(t.entrada) + ".png";
+    }
+    t.llegada = Reloj::now();
+    return true;
+}
+
+static void leerTrabajos(std::istream& is, procesadoLotes::ColaAcotada<Trabajo>& cola,
+                         const std::shared_ptr<Cliente>& cliente)
+{
+    std::string linea;
+    while (std::getline(is, linea))
+    {
+        Trabajo t;
+        if (!analizarTrabajo(linea, t))
+            continue;
+        t.cliente = cliente;
+        cola.Push(std::move(t));
+    }
+}
+
+#ifdef EJERCICIO_SOCKET_UNIX
+// Lee líneas de un descriptor hasta que el cliente cierra la conexión
+static void leerTrabajosSocket(std::shared_ptr<Cliente> cliente, procesadoLotes::ColaAcotada<Trabajo>& cola)
+{
+    std::string pendiente;
+    char        buffer[4096];
+    for (;;)
+    {
+        const ssize_t n = recv(cliente->fd, buffer, sizeof(buffer), 0);
+        if (n <= 0)
+            break;
+        pendiente.append(buffer, static_cast<size_t>(n));
+        size_t fin;
+        while ((fin = pendiente.find('\n')) != std::string::npos)
+        {
+            Trabajo t;
+            if (analizarTrabajo(pendiente.substr(0, fin), t))
+            {
+                t.cliente = cliente;
+                cola.Push(std::move(t));
+            }
+            pendiente.erase(0, fin + 1);
+        }
+    }
+    Trabajo t;
+    if (analizarTrabajo(pendiente, t))
+    {
+        t.cliente = cliente;
+        cola.Push(std::move(t));
+    }
+}
+
+static int abrirSocket(const std::string& ruta)
+{
+    sockaddr_un dir{};
+    if (ruta.size() >= sizeof(dir.sun_path))
+    {
+        std::cerr << "Ruta de socket demasiado larga: " << ruta << std::endl;
+        return -1;
+    }
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    dir.sun_family = AF_UNIX;
+    std::copy(ruta.begin(), ruta.end(), dir.sun_path);
+    unlink(ruta.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr*>(&dir), sizeof(dir)) != 0 || listen(fd, 16) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+#endif
+
+// Ejecuta 'n' hilos con 'cuerpo'; el último en terminar llama a 'alTerminar'
+// (cierra la cola de la etapa siguiente).
+template <typename TCuerpo, typename TFin>
+static void lanzarEtapa(std::vector<std::thread>& hilos, unsigned int n, TCuerpo cuerpo, TFin alTerminar)
+{
+    auto activos = std::make_shared<std::atomic<unsigned int>>(n);
+    for (unsigned int i = 0; i < n; ++i)
+        hilos.emplace_back([=]() {
+            cuerpo();
+            if (--(*activos) == 0)
+                alTerminar();
+        });
+}
+
+static int servidor(const std::string& rutaSocket, unsigned int numHilos, const ModoVentana& modo)
+{
+    // Decodificar es la etapa cara; reescalar es una pasada sobre memoria
+    const unsigned int hilosDecodificar = numHilos;
+    const unsigned int hilosReescalar = std::max(1u, numHilos / 4);
+    const unsigned int hilosCodificar = std::max(1u, numHilos / 2);
+    const size_t       capacidad = 2 * numHilos;
+
+    procesadoLotes::ColaAcotada<Trabajo> pendientes(capacidad);
+    procesadoLotes::ColaAcotada<Trabajo> decodificados(capacidad);
+    procesadoLotes::ColaAcotada<Trabajo> convertidos(capacidad);
+    Estadisticas                         est;
+    std::vector<std::thread>             hilos;
+
+    // Etapa 1: cada hilo reutiliza su lector y su GDCMImageIO
+    lanzarEtapa(hilos, hilosDecodificar, [&]() {
+        auto reader = itk::ImageFileReader<InputImageType>::New();
+        reader->SetImageIO(itk::GDCMImageIO::New());
+        Trabajo t;
+        while (pendientes.Pop(t))
+        {
+            try
+            {
+                reader->SetFileName(t.entrada);
+                reader->Update();
+                t.decodificada = reader->GetOutput();
+                t.decodificada->DisconnectPipeline();
+            }
+            catch (itk::ExceptionObject& err)
+            {
+                terminar(est, t, std::string("leyendo DICOM: ") + err.GetDescription());
+                continue;
+            }
+            decodificados.Push(std::move(t));
+        }
+    }, [&]() { decodificados.Cerrar(); });
+
+    // Etapa 2: ventana/reescalado a uchar
+    lanzarEtapa(hilos, hilosReescalar, [&]() {
+        std::unique_ptr<ventanaDicom::Tabla<InputPixelType>> tabla;
+        Trabajo t;
+        while (decodificados.Pop(t))
+        {
+            try
+            {
+                t.convertida = aUchar(t.decodificada.GetPointer(), modo, tabla);
+            }
+            catch (const std::exception& err)
+            {
+                terminar(est, t, std::string("reescalando: ") + err.what());
+                continue;
+            }
+            t.decodificada = nullptr;
+            convertidos.Push(std::move(t));
+        }
+    }, [&]() { convertidos.Cerrar(); });
+
+    // Etapa 3: cada hilo reutiliza su escritor y su PNGImageIO
+    lanzarEtapa(hilos, hilosCodificar, [&]() {
+        auto writer = itk::ImageFileWriter<OutputImageType>::New();
+        writer->SetImageIO(itk::PNGImageIO::New());
+        Trabajo t;
+        while (convertidos.Pop(t))
+        {
+            try
+            {
+                writer->SetInput(t.convertida);
+                writer->SetFileName(t.salida);
+                writer->Update();
+            }
+            catch (itk::ExceptionObject& err)
+            {
+                terminar(est, t, std::string("escribiendo PNG: ") + err.GetDescription());
+                continue;
+            }
+            terminar(est, t, "");
+        }
+    }, []() {});
+
+    // Rendimiento cada 5 s (sólo si ha habido actividad)
+    std::mutex              mutexFin;
+    std::condition_variable finCV;
+    bool                    fin = false;
+    std::thread estadisticas([&]() {
+        const auto    inicio = Reloj::now();
+        auto          anterior = inicio;
+        unsigned long hechosAntes = 0;
+        std::unique_lock<std::mutex> lock(mutexFin);
+        while (!finCV.wait_for(lock, std::chrono::seconds(5), [&] { return fin; }))
+        {
+            const auto          ahora = Reloj::now();
+            const unsigned long hechos = est.completados;
+            if (hechos == hechosAntes)
+                continue;
+            const double intervalo = std::chrono::duration<double>(ahora - anterior).count();
+            const double total = std::chrono::duration<double>(ahora - inicio).count();
+            std::lock_guard<std::mutex> salida(est.mutexSalida);
+            std::cout << std::fixed << std::setprecision(1) << "Rendimiento: "
+                      << (hechos - hechosAntes) / intervalo << " img/s (ultimos " << intervalo << " s), "
+                      << hechos << " convertidas, " << est.errores << " errores en " << total << " s"
+                      << std::endl;
+            anterior = ahora;
+            hechosAntes = hechos;
+        }
+    });
+
+    std::cout << "Servidor DICOM->PNG: " << hilosDecodificar << " decodificando, " << hilosReescalar
+              << " reescalando, " << hilosCodificar << " codificando; trabajos desde "
+              << (rutaSocket.empty() ? std::string("stdin") : rutaSocket) << std::endl;
+
+    int resultado = EXIT_SUCCESS;
+    if (rutaSocket.empty())
+    {
+        leerTrabajos(std::cin, pendientes, nullptr);
+    }
+    else
+    {
+#ifdef EJERCICIO_SOCKET_UNIX
+        const int fdEscucha = abrirSocket(rutaSocket);
+        if (fdEscucha < 0)
+        {
+            std::cerr << "No se pudo escuchar en " << rutaSocket << std::endl;
+            resultado = EXIT_FAILURE;
+        }
+        else
+        {
+            // Un hilo por conexión; el servidor sigue hasta que se le mata
+            for (;;)
+            {
+                const int fd = accept(fdEscucha, nullptr, nullptr);
+                if (fd < 0)
+                    continue;
+                std::thread(leerTrabajosSocket, std::make_shared<Cliente>(fd), std::ref(pendientes)).detach();
+            }
+        }
+#else
+        std::cerr << "Sockets Unix no disponibles en esta plataforma" << std::endl;
+        resultado = EXIT_FAILURE;
+#endif
+    }
+
+    // Fin de la entrada: vaciar el pipeline
+    pendientes.Cerrar();
+    for (auto& hilo : hilos)
+        hilo.join();
+    {
+        std::lock_guard<std::mutex> lock(mutexFin);
+        fin = true;
+    }
+    finCV.notify_one();
+    estadisticas.join();
+
+    std::cout << "Total: " << est.completados << " convertidas, " << est.errores << " errores" << std::endl;
+    return est.errores == 0 ? resultado : EXIT_FAILURE;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc >= 2 && std::string(argv[1]) == "--servidor")
+    {
+        const std::string  rutaSocket = argc > 2 ? argv[2] : "";
+        unsigned int       numHilos = std::max(1u, std::thread::hardware_concurrency());
+        if (argc > 3)
+        {
+            try
+            {
+                numHilos = std::max(1, std::stoi(argv[3]));
+            }
+            catch (const std::exception&)
+            {
+                std::cerr << "Numero de hilos no valido: " << argv[3] << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        ModoVentana modo;
+        if (argc > 4 && !analizarModo(argv[4], modo))
+        {
+            std::cerr << "Ventana no reconocida: " << argv[4] << std::endl;
+            return EXIT_FAILURE;
+        }
+        return servidor(rutaSocket == "-" ? "" : rutaSocket, numHilos, modo);
+    }
+
+    ModoVentana modo;
+    if (argc < 3 || argc > 4 || (argc == 4 && !analizarModo(argv[3], modo)))
+    {
+        std::cerr << "Uso: " << argv[0]
+                  << " <input.dcm> <output.png> [dicom|minmax|preset|centro,anchura]" << std::endl
+                  << "     " << argv[0]
+                  << " --servidor [socket|-] [numHilos] [ventana]   (trabajos '<input.dcm> [output.png]' por línea)"
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return convertir(argv[1], argv[2], modo);
+}
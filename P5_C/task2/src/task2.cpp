@@ -3,17 +3,33 @@
 #include "itkImageFileWriter.h"
 #include "itkVTKImageIO.h"
 #include "itkRawImageIO.h"
+#include "itksys/SystemTools.hxx"
 
+#include "lecturaMapeada.h"
+#include "volumenBloques.h"
+
+#include <cstdint>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <algorithm>
 
+// "x,y,z" -> tres enteros no negativos
+bool leerTriple(const std::string& texto, long valores[3])
+{
+    std::istringstream is(texto);
+    char coma1 = 0, coma2 = 0;
+    return (is >> valores[0] >> coma1 >> valores[1] >> coma2 >> valores[2]) && coma1 == ',' && coma2 == ',' &&
+           valores[0] >= 0 && valores[1] >= 0 && valores[2] >= 0;
+}
+
 int main(int argc, char* argv[])
 {
-    if (argc != 3)
+    if (argc != 3 && argc != 5)
     {
         std::cerr << "Uso: " << argv[0]
-                  << " <imagen_entrada(.mha|.raw)> <imagen_salida.vtk>\n";
+                  << " <imagen_entrada(.mha|.mhd|.raw|.blq)> <imagen_salida.vtk> [x,y,z tamX,tamY,tamZ]\n"
+                  << "La región opcional sólo se admite con .blq: se leen únicamente los bloques que la cortan.\n";
         return EXIT_FAILURE;
     }
 
@@ -30,40 +46,110 @@ int main(int argc, char* argv[])
     using ImageType = itk::Image<PixelType, Dimension>;
 
     // --- Reader ---
-    auto reader = itk::ImageFileReader<ImageType>::New();
-    reader->SetFileName(inputFile);
-
-    if (ext == ".raw")
+    // Los datos sin comprimir se proyectan en memoria (mmap) y se entregan a la
+    // imagen sin copiarlos; el resto de casos usa ImageFileReader.
+    ImageType::Pointer image;
+    bool mapeada = false;
+    size_t bloquesLeidos = 0;
+    if (argc == 5 && ext != ".blq")
     {
-        // Parámetros embebidos (sin .mhd externo):
-        const unsigned int dimX = 181;
-        const unsigned int dimY = 217;
-        const unsigned int dimZ = 1;    // RAW file has only one slice
-
-        using RawIOType = itk::RawImageIO<PixelType, Dimension>;
-        auto rawIO = RawIOType::New();
-        rawIO->SetFileTypeToBinary();
-        rawIO->SetDimensions(0, dimX);
-        rawIO->SetDimensions(1, dimY);
-        rawIO->SetDimensions(2, dimZ);
-        rawIO->SetPixelType(itk::ImageIOBase::SCALAR);
-        rawIO->SetNumberOfComponents(1);
-        rawIO->SetByteOrderToLittleEndian(); // ElementByteOrderMSB = False
-        reader->SetImageIO(rawIO);
+        std::cerr << "La región sólo se admite con entradas .blq" << std::endl;
+        return EXIT_FAILURE;
     }
-
     try
     {
-        reader->Update();
+        if (ext == ".blq")
+        {
+            // Volumen por bloques: completo o sólo la región pedida
+            volumenBloques::Cabecera cab;
+            std::vector<volumenBloques::Entrada> tabla;
+            volumenBloques::LeerInformacion(inputFile, cab, tabla);
+            ImageType::RegionType region;
+            if (argc == 5)
+            {
+                long inicio[3], tam[3];
+                if (!leerTriple(argv[3], inicio) || !leerTriple(argv[4], tam))
+                {
+                    std::cerr << "Región no válida: " << argv[3] << " " << argv[4] << std::endl;
+                    return EXIT_FAILURE;
+                }
+                for (unsigned int i = 0; i < Dimension; ++i)
+                {
+                    region.SetIndex(i, inicio[i]);
+                    region.SetSize(i, static_cast<itk::SizeValueType>(tam[i]));
+                }
+            }
+            else
+            {
+                for (unsigned int i = 0; i < Dimension; ++i)
+                    region.SetSize(i, cab.dims[i]);
+            }
+            image = volumenBloques::LeerRegion<ImageType>(inputFile, region, 0, &bloquesLeidos);
+            std::cout << "Bloques leídos: " << bloquesLeidos << " de " << cab.numBloques << std::endl;
+        }
+        else if (ext == ".raw")
+        {
+            // Parámetros embebidos (sin .mhd externo):
+            const unsigned int dimX = 181;
+            const unsigned int dimY = 217;
+            const unsigned int dimZ = 1;    // RAW file has only one slice
+
+            ImageType::SizeType tam;
+            tam[0] = dimX;
+            tam[1] = dimY;
+            tam[2] = dimZ;
+            ImageType::SpacingType spacing;
+            spacing.Fill(1.0);
+            ImageType::PointType origen;
+            origen.Fill(0.0);
+            ImageType::DirectionType direccion;
+            direccion.SetIdentity();
+            // RawImageIO sin SetHeaderSize toma como cabecera todo lo que sobra
+            // delante de los datos, es decir, lee el último corte del fichero
+            // (BrainProtonDensity3Slices.raw tiene 3). Se proyecta desde ahí.
+            const std::uint64_t bytesDatos = std::uint64_t(dimX) * dimY * dimZ * sizeof(PixelType);
+            const std::uint64_t bytesFichero = itksys::SystemTools::FileLength(inputFile);
+            if (bytesFichero >= bytesDatos)
+            {
+                image = lecturaMapeada::Proyectar<ImageType>(inputFile, bytesFichero - bytesDatos, tam, spacing,
+                                                             origen, direccion);
+            }
+            mapeada = image.IsNotNull();
+
+            if (!mapeada)
+            {
+                using RawIOType = itk::RawImageIO<PixelType, Dimension>;
+                auto rawIO = RawIOType::New();
+                rawIO->SetFileTypeToBinary();
+                rawIO->SetDimensions(0, dimX);
+                rawIO->SetDimensions(1, dimY);
+                rawIO->SetDimensions(2, dimZ);
+                rawIO->SetPixelType(itk::ImageIOBase::SCALAR);
+                rawIO->SetNumberOfComponents(1);
+                rawIO->SetByteOrderToLittleEndian(); // ElementByteOrderMSB = False
+
+                auto reader = itk::ImageFileReader<ImageType>::New();
+                reader->SetFileName(inputFile);
+                reader->SetImageIO(rawIO);
+                reader->Update();
+                image = reader->GetOutput();
+            }
+        }
+        else
+        {
+            image = lecturaMapeada::Leer<ImageType>(inputFile, &mapeada);
+        }
     }
     catch (itk::ExceptionObject & err)
     {
         std::cerr << "Excepción al leer la imagen: " << err << std::endl;
         return EXIT_FAILURE;
     }
+    std::cout << "Lectura "
+              << (ext == ".blq" ? "por bloques" : mapeada ? "proyectada en memoria (mmap)" : "con ImageFileReader")
+              << ": " << inputFile << std::endl;
 
     // --- Ajustar el spacing (1.0,1.0,1.0) ---
-    auto image = reader->GetOutput();
     itk::ImageBase<Dimension>::SpacingType spacing;
     spacing.Fill(1.0);
     image->SetSpacing(spacing);
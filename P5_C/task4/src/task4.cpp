@@ -1,10 +1,10 @@
 #include "itkImage.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
-#include "itkRescaleIntensityImageFilter.h"
-#include "itkCastImageFilter.h"
 #include "QuickView.h"
 
+#include "salidaUchar.h"
+
 #include <iostream>
 
 int main(int argc, char* argv[])
@@ -29,22 +29,17 @@ int main(int argc, char* argv[])
     auto reader = itk::ImageFileReader<InputImageType>::New();
     reader->SetFileName(inputFile);
 
-    // Filtro de rescalado: float [min,max] → float [0,255]
-    auto rescaler = itk::RescaleIntensityImageFilter<InputImageType, InputImageType>::New();
-    rescaler->SetInput(reader->GetOutput());
-    rescaler->SetOutputMinimum(0.0);
-    rescaler->SetOutputMaximum(255.0);
-
-    // Filtro de casteo: float [0,255] → uchar
-    auto caster = itk::CastImageFilter<InputImageType, OutputImageType>::New();
-    caster->SetInput(rescaler->GetOutput());
-
-    // Escritura de la imagen convertida
-    auto writer = itk::ImageFileWriter<OutputImageType>::New();
-    writer->SetFileName(outputFile);
-    writer->SetInput(caster->GetOutput());
-
+    // Rescalado float [min,max] → [0,255] y casteo a uchar en una sola pasada
+    // (mismo redondeo que Rescale a float seguido de Cast)
+    OutputImageType::Pointer convertida;
     try {
+        reader->Update();
+        convertida = salidaUchar::Convertir<float>(reader->GetOutput());
+
+        // Escritura de la imagen convertida
+        auto writer = itk::ImageFileWriter<OutputImageType>::New();
+        writer->SetFileName(outputFile);
+        writer->SetInput(convertida);
         writer->Update();
     } catch (itk::ExceptionObject& err) {
         std::cerr << "Excepción al escribir: " << err << std::endl;
@@ -54,7 +49,7 @@ int main(int argc, char* argv[])
     // Visualización de original y convertida
     QuickView viewer;
     viewer.AddImage(reader->GetOutput(), false, "Imagen original (float)");
-    viewer.AddImage(caster->GetOutput(), true, "Imagen convertida (uchar)");
+    viewer.AddImage(convertida.GetPointer(), true, "Imagen convertida (uchar)");
     viewer.Visualize();
 
     return EXIT_SUCCESS;
@@ -2,75 +2,185 @@
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
 #include "itkExtractImageFilter.h"
+#include "itkCastImageFilter.h"
 
+#include "lecturaMapeada.h"
+
+#include <chrono>
 #include <iostream>
+#include <string>
 
-int main(int argc, char* argv[])
-{
-    if (argc < 4)
-    {
-        std::cerr << "Uso: " << argv[0]
-                  << " <volumen3D> <slice2D_salida> <indiceSliceZ>" << std::endl;
-        return EXIT_FAILURE;
-    }
+constexpr unsigned int InputDimension  = 3;
+constexpr unsigned int OutputDimension = 2;
+using PixelType = float;
 
-    const char* inputVolume = argv[1];
-    const char* outputSlice  = argv[2];
-    const unsigned int sliceIndex = std::stoi(argv[3]);
+using VolumeType = itk::Image<PixelType, InputDimension>;
+using SliceType  = itk::Image<PixelType, OutputDimension>;
 
-    constexpr unsigned int InputDimension  = 3;
-    constexpr unsigned int OutputDimension = 2;
-    using PixelType = float;
+// Extrae el slice Z 'sliceIndex' de 'volumen' y lo convierte a float. La
+// región pedida se propaga al lector, que en modo streaming sólo carga ese
+// slice. Devuelve nulo (con el error ya mostrado) si falla.
+template <typename TVolume>
+SliceType::Pointer extraerSlice(const TVolume* volumen, unsigned int sliceIndex)
+{
+    using CorteType = itk::Image<typename TVolume::PixelType, OutputDimension>;
 
-    using VolumeType = itk::Image<PixelType, InputDimension>;
-    using SliceType  = itk::Image<PixelType, OutputDimension>;
+    // Región de extracción: misma anchura/alto, profundidad = 0
+    typename TVolume::RegionType volRegion = volumen->GetLargestPossibleRegion();
 
-    // 1) Leer el volumen 3D
-    auto reader = itk::ImageFileReader<VolumeType>::New();
-    reader->SetFileName(inputVolume);
-    try {
-        reader->Update();
-    }
-    catch (itk::ExceptionObject& err) {
-        std::cerr << "Error al leer volumen: " << err << std::endl;
-        return EXIT_FAILURE;
+    typename TVolume::SizeType size = volRegion.GetSize();
+    const long primerZ = volRegion.GetIndex()[2];
+    if (static_cast<long>(sliceIndex) < primerZ || static_cast<long>(sliceIndex) >= primerZ + static_cast<long>(size[2]))
+    {
+        std::cerr << "Indice de slice fuera de rango (" << primerZ << "-"
+                  << primerZ + static_cast<long>(size[2]) - 1 << ")" << std::endl;
+        return nullptr;
     }
 
-    // 2) Definir la región de extracción: misma anchura/alto, profundidad = 0
-    VolumeType::RegionType volRegion =
-        reader->GetOutput()->GetLargestPossibleRegion();
-
-    VolumeType::SizeType size = volRegion.GetSize();
     size[2] = 0;  // colapsar la dimensión Z
 
-    VolumeType::IndexType start = volRegion.GetIndex();
+    typename TVolume::IndexType start = volRegion.GetIndex();
     start[2] = sliceIndex; // slice deseado
 
-    VolumeType::RegionType sliceRegion;
+    typename TVolume::RegionType sliceRegion;
     sliceRegion.SetSize(size);
     sliceRegion.SetIndex(start);
 
-    // 3) Filtro de extracción
-    using ExtractFilterType = itk::ExtractImageFilter<VolumeType, SliceType>;
-    auto extractFilter = ExtractFilterType::New();
+    auto extractFilter = itk::ExtractImageFilter<TVolume, CorteType>::New();
     extractFilter->SetExtractionRegion(sliceRegion);
-    extractFilter->SetInput(reader->GetOutput());
-    extractFilter->SetDirectionCollapseToSubmatrix(); 
+    extractFilter->SetInput(volumen);
+    extractFilter->SetDirectionCollapseToSubmatrix();
     // necesaria para ajustar la matriz de dirección de 3D a 2D
 
+    auto castFilter = itk::CastImageFilter<CorteType, SliceType>::New();
+    castFilter->SetInput(extractFilter->GetOutput());
+
     try {
-        extractFilter->Update();
+        castFilter->Update();
     }
     catch (itk::ExceptionObject& err) {
         std::cerr << "Error en extraccion: " << err << std::endl;
+        return nullptr;
+    }
+    SliceType::Pointer slice = castFilter->GetOutput();
+    slice->DisconnectPipeline();
+    return slice;
+}
+
+// Proyecta en memoria 'ruta' con su tipo de píxel nativo. 'proyectado' queda
+// a false si no se puede (y entonces se devuelve nulo sin error).
+template <typename TPixel>
+SliceType::Pointer sliceMapeado(const char* ruta, unsigned int sliceIndex, bool& proyectado)
+{
+    using MapeadoType = itk::Image<TPixel, InputDimension>;
+    typename MapeadoType::Pointer volumen = lecturaMapeada::Mapear<MapeadoType>(ruta);
+    proyectado = volumen.IsNotNull();
+    return proyectado ? extraerSlice(volumen.GetPointer(), sliceIndex) : nullptr;
+}
+
+// Elige el tipo de píxel según el ElementType de la cabecera: Mapear exige
+// que coincida con el del fichero
+SliceType::Pointer sliceMapeado(const char* ruta, unsigned int sliceIndex, bool& proyectado)
+{
+    proyectado = false;
+    lecturaMapeada::Cabecera cabecera;
+    if (!lecturaMapeada::leerCabecera(ruta, cabecera))
+        return nullptr;
+    const std::string& tipo = cabecera.tipoElemento;
+    if (tipo == "MET_UCHAR")
+        return sliceMapeado<unsigned char>(ruta, sliceIndex, proyectado);
+    if (tipo == "MET_CHAR")
+        return sliceMapeado<char>(ruta, sliceIndex, proyectado);
+    if (tipo == "MET_USHORT")
+        return sliceMapeado<unsigned short>(ruta, sliceIndex, proyectado);
+    if (tipo == "MET_SHORT")
+        return sliceMapeado<short>(ruta, sliceIndex, proyectado);
+    if (tipo == "MET_UINT")
+        return sliceMapeado<unsigned int>(ruta, sliceIndex, proyectado);
+    if (tipo == "MET_INT")
+        return sliceMapeado<int>(ruta, sliceIndex, proyectado);
+    if (tipo == "MET_FLOAT")
+        return sliceMapeado<float>(ruta, sliceIndex, proyectado);
+    if (tipo == "MET_DOUBLE")
+        return sliceMapeado<double>(ruta, sliceIndex, proyectado);
+    return nullptr;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 4)
+    {
+        std::cerr << "Uso: " << argv[0]
+                  << " <volumen3D> <slice2D_salida> <indiceSliceZ> [streaming|mapeado|completo]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const char* inputVolume = argv[1];
+    const char* outputSlice  = argv[2];
+    const unsigned int sliceIndex = std::stoi(argv[3]);
+    // streaming (por defecto): el lector sólo carga la región que pide el filtro
+    // de extracción. mapeado: MetaImage sin comprimir proyectada en memoria con
+    // su tipo de píxel (sólo se cargan las páginas del slice); si no se puede,
+    // como streaming. completo: se lee el volumen entero antes de extraer.
+    std::string modo = (argc > 4 ? argv[4] : "streaming");
+    if (modo != "streaming" && modo != "mapeado" && modo != "completo")
+    {
+        std::cerr << "Modo desconocido: " << modo << " (streaming|mapeado|completo)" << std::endl;
         return EXIT_FAILURE;
     }
 
-    // 4) Escribir el slice 2D resultante
+    const auto t0 = std::chrono::steady_clock::now();
+
+    SliceType::Pointer slice;
+    if (modo == "mapeado")
+    {
+        bool proyectado = false;
+        slice = sliceMapeado(inputVolume, sliceIndex, proyectado);
+        if (proyectado && slice.IsNull())
+            return EXIT_FAILURE;
+        if (!proyectado)
+        {
+            std::cout << "Aviso: el volumen no se puede proyectar en memoria; "
+                      << "se usa streaming." << std::endl;
+            modo = "streaming";
+        }
+    }
+
+    if (slice.IsNull())
+    {
+        // 1) Leer el volumen 3D. En modo streaming sólo se lee la cabecera; los
+        //    datos se piden después, limitados al slice. MetaImage sin comprimir
+        //    salta directamente al desplazamiento del slice; con .zraw se
+        //    descomprime hasta el final del slice, sin guardar el resto del volumen.
+        auto reader = itk::ImageFileReader<VolumeType>::New();
+        reader->SetFileName(inputVolume);
+        try {
+            if (modo == "completo")
+                reader->Update();
+            else
+                reader->UpdateOutputInformation();
+        }
+        catch (itk::ExceptionObject& err) {
+            std::cerr << "Error al leer volumen: " << err << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (modo == "streaming" && !reader->GetImageIO()->CanStreamRead())
+        {
+            std::cout << "Aviso: el formato no admite lectura parcial; "
+                      << "se leerá el volumen completo." << std::endl;
+        }
+
+        // 2) Extraer el slice
+        slice = extraerSlice(reader->GetOutput(), sliceIndex);
+        if (slice.IsNull())
+            return EXIT_FAILURE;
+    }
+
+    // 3) Escribir el slice 2D resultante
     using WriterType = itk::ImageFileWriter<SliceType>;
     auto writer = WriterType::New();
     writer->SetFileName(outputSlice);
-    writer->SetInput(extractFilter->GetOutput());
+    writer->SetInput(slice);
 
     try {
         writer->Update();
@@ -80,7 +190,9 @@ int main(int argc, char* argv[])
         return EXIT_FAILURE;
     }
 
+    const std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - t0;
     std::cout << "Slice Z=" << sliceIndex
-              << " extraído y guardado en: " << outputSlice << std::endl;
+              << " extraído y guardado en: " << outputSlice
+              << " (" << modo << ", " << ms.count() << " ms)" << std::endl;
     return EXIT_SUCCESS;
 }
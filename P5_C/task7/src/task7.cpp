@@ -2,20 +2,263 @@
 #include "itkImage.h"
 #include "itkImageSeriesReader.h"
 #include "itkNumericSeriesFileNames.h"
+#include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
 #include "itkExtractImageFilter.h"
+#include "itksys/SystemTools.hxx"
 #include "QuickView.h"
 
+#include "deflateParalelo.h"
+#include "volumenBloques.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <sstream>
+#include <thread>
+#include <vector>
+
+constexpr unsigned int Dimension3D = 3;
+constexpr unsigned int Dimension2D = 2;
+using PixelType   = unsigned char;
+using VolumeType  = itk::Image<PixelType, Dimension3D>;
+using SliceType   = itk::Image<PixelType, Dimension2D>;
+
+// Cabecera .mhd equivalente a la que escribe MetaImageIO para 'volumen', con
+// los datos en 'ficheroDatos' (ruta relativa a la cabecera). Si
+// 'bytesComprimidos' no es 0, los datos son un flujo zlib de ese tamaño.
+void escribirCabeceraMHD(const std::string& nombre, const VolumeType* volumen, const std::string& ficheroDatos,
+                         std::uint64_t bytesComprimidos = 0)
+{
+    const auto tam = volumen->GetLargestPossibleRegion().GetSize();
+    const auto spacing = volumen->GetSpacing();
+    const auto origen = volumen->GetOrigin();
+    const auto direccion = volumen->GetDirection();
+
+    std::ofstream cabecera(nombre);
+    cabecera << "ObjectType = Image\nNDims = 3\nBinaryData = True\n"
+             << "BinaryDataByteOrderMSB = False\n";
+    if (bytesComprimidos > 0)
+        cabecera << "CompressedData = True\nCompressedDataSize = " << bytesComprimidos << "\n";
+    else
+        cabecera << "CompressedData = False\n";
+    cabecera << "TransformMatrix =";
+    for (unsigned int c = 0; c < Dimension3D; ++c)
+        for (unsigned int f = 0; f < Dimension3D; ++f)
+            cabecera << " " << direccion[f][c];
+    cabecera << "\nOffset = " << origen[0] << " " << origen[1] << " " << origen[2]
+             << "\nCenterOfRotation = 0 0 0\nAnatomicalOrientation = RAI"
+             << "\nElementSpacing = " << spacing[0] << " " << spacing[1] << " " << spacing[2]
+             << "\nDimSize = " << tam[0] << " " << tam[1] << " " << tam[2]
+             << "\nElementType = MET_UCHAR\nElementDataFile = " << ficheroDatos << "\n";
+    if (!cabecera)
+        itkGenericExceptionMacro(<< "No se pudo escribir " << nombre);
+}
+
+// Ensambla la serie en paralelo. El primer slice fija tamaño y geometría del
+// volumen; después 'numHilos' hilos decodifican el resto, cada uno en su plano Z
+// del buffer del volumen. Si la salida es .mhd, el hilo que llama va escribiendo
+// los planos en orden según se completan, de modo que la escritura se solapa con
+// la decodificación; con 'nivelCompresion' >= 0 los datos van a un .zraw cuyos
+// bloques de 1 MiB se comprimen en paralelo según están listos sus planos. .blq
+// se escribe al final por bloques comprimidos en paralelo y otros formatos con
+// ImageFileWriter.
+VolumeType::Pointer ensamblarParalelo(const std::vector<std::string>& nombres,
+                                      const std::string& outVolume, unsigned int numHilos,
+                                      int nivelCompresion = -1)
+{
+    // 1) Primer slice: tamaño, geometría y tipo de ImageIO
+    auto primero = itk::ImageFileReader<SliceType>::New();
+    primero->SetFileName(nombres.front());
+    primero->Update();
+    const SliceType* slice0 = primero->GetOutput();
+    const auto tam2D = slice0->GetLargestPossibleRegion().GetSize();
+    const size_t pixelesSlice = static_cast<size_t>(tam2D[0]) * tam2D[1];
+
+    // Mismo resultado que ImageSeriesReader: geometría del primer slice y
+    // spacing 1 en Z
+    auto volumen = VolumeType::New();
+    VolumeType::SizeType tam;
+    tam[0] = tam2D[0];
+    tam[1] = tam2D[1];
+    tam[2] = nombres.size();
+    VolumeType::RegionType region;
+    region.SetSize(tam);
+    volumen->SetRegions(region);
+    VolumeType::SpacingType spacing;
+    VolumeType::PointType origen;
+    VolumeType::DirectionType direccion;
+    direccion.SetIdentity();
+    spacing[2] = 1.0;
+    origen[2] = 0.0;
+    for (unsigned int i = 0; i < Dimension2D; ++i)
+    {
+        spacing[i] = slice0->GetSpacing()[i];
+        origen[i] = slice0->GetOrigin()[i];
+        for (unsigned int j = 0; j < Dimension2D; ++j)
+            direccion[i][j] = slice0->GetDirection()[i][j];
+    }
+    volumen->SetSpacing(spacing);
+    volumen->SetOrigin(origen);
+    volumen->SetDirection(direccion);
+    volumen->Allocate();
+    PixelType* buffer = volumen->GetBufferPointer();
+    std::memcpy(buffer, slice0->GetBufferPointer(), pixelesSlice);
+
+    // Cada hilo clona el ImageIO del primer slice en lugar de pasar por la
+    // factoría de ImageIO desde varios hilos
+    const itk::ImageIOBase* ioModelo = primero->GetImageIO();
+
+    // 2) Estado compartido: planos terminados y errores
+    std::vector<char> listo(nombres.size(), 0);
+    listo[0] = 1;
+    std::mutex mutexEstado;
+    std::condition_variable cambio;
+    std::atomic<size_t> siguiente{ 1 };
+    bool correcto = true;
+
+    auto trabajador = [&]() {
+        for (size_t z = siguiente++; z < nombres.size(); z = siguiente++)
+        {
+            PixelType* plano = buffer + z * pixelesSlice;
+            bool ok = true;
+            try
+            {
+                itk::ImageIOBase::Pointer io =
+                    dynamic_cast<itk::ImageIOBase*>(ioModelo->CreateAnother().GetPointer());
+                io->SetFileName(nombres[z]);
+                io->ReadImageInformation();
+                const bool mismoTam = io->GetNumberOfDimensions() >= 2 && io->GetDimensions(0) == tam2D[0] &&
+                                      io->GetDimensions(1) == tam2D[1];
+                if (!mismoTam)
+                    itkGenericExceptionMacro(<< "Tamaño distinto al del primer slice");
+                itk::ImageIORegion regionIO(Dimension2D);
+                regionIO.SetSize(0, tam2D[0]);
+                regionIO.SetSize(1, tam2D[1]);
+                io->SetIORegion(regionIO);
+
+                if (io->GetNumberOfComponents() == 1 && io->GetComponentSize() == 1 &&
+                    itk::ImageIOBase::GetComponentTypeAsString(io->GetComponentType()) == "unsigned_char")
+                {
+                    // Caso habitual (gris de 8 bits): se decodifica directamente en el plano
+                    io->Read(plano);
+                }
+                else
+                {
+                    // Otro tipo de píxel (RGB, 16 bits...): conversión del lector y copia
+                    auto lector = itk::ImageFileReader<SliceType>::New();
+                    lector->SetImageIO(io);
+                    lector->SetFileName(nombres[z]);
+                    lector->Update();
+                    std::memcpy(plano, lector->GetOutput()->GetBufferPointer(), pixelesSlice);
+                }
+            }
+            catch (itk::ExceptionObject& err)
+            {
+                std::lock_guard<std::mutex> lock(mutexEstado);
+                std::cerr << "Error leyendo " << nombres[z] << ": " << err << std::endl;
+                ok = false;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutexEstado);
+                listo[z] = 1;
+                correcto = correcto && ok;
+            }
+            cambio.notify_all();
+        }
+    };
+
+    const unsigned int hilosEscritura = numHilos;
+    numHilos = std::max(1u, std::min<unsigned int>(numHilos, static_cast<unsigned int>(nombres.size())));
+    std::vector<std::thread> hilos;
+    for (unsigned int h = 0; h < numHilos; ++h)
+        hilos.emplace_back(trabajador);
+
+    // 3) Escritura: en .mhd, plano a plano en orden conforme van estando listos
+    const bool salidaMHD = itksys::SystemTools::LowerCase(
+                             itksys::SystemTools::GetFilenameLastExtension(outVolume)) == ".mhd";
+    bool escrito = true;
+    std::uint64_t bytesComprimidos = 0;
+    const std::string ficheroDatos = itksys::SystemTools::GetFilenameWithoutLastExtension(outVolume) +
+                                     (nivelCompresion >= 0 ? ".zraw" : ".raw");
+    if (salidaMHD && nivelCompresion >= 0)
+    {
+        const std::string directorio = itksys::SystemTools::GetFilenamePath(outVolume);
+        const std::string rutaDatos = directorio.empty() ? ficheroDatos : directorio + "/" + ficheroDatos;
+
+        // Cada bloque espera sólo a los planos que cubre
+        std::ofstream datos(rutaDatos, std::ios::binary);
+        bytesComprimidos = deflateParalelo::Escribir(
+            datos, buffer, pixelesSlice * nombres.size(), nivelCompresion, hilosEscritura, size_t(1) << 20,
+            [&](size_t desde, size_t hasta) {
+                std::unique_lock<std::mutex> lock(mutexEstado);
+                cambio.wait(lock, [&] {
+                    for (size_t z = desde / pixelesSlice; z < (hasta + pixelesSlice - 1) / pixelesSlice; ++z)
+                        if (!listo[z])
+                            return false;
+                    return true;
+                });
+            });
+        datos.close();
+        escrito = bytesComprimidos > 0 && static_cast<bool>(datos);
+    }
+    else if (salidaMHD)
+    {
+        const std::string directorio = itksys::SystemTools::GetFilenamePath(outVolume);
+        const std::string rutaDatos = directorio.empty() ? ficheroDatos : directorio + "/" + ficheroDatos;
+
+        std::ofstream datos(rutaDatos, std::ios::binary);
+        for (size_t z = 0; z < nombres.size() && datos; ++z)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutexEstado);
+                cambio.wait(lock, [&] { return listo[z] != 0; });
+            }
+            datos.write(reinterpret_cast<const char*>(buffer + z * pixelesSlice),
+                        static_cast<std::streamsize>(pixelesSlice));
+        }
+        escrito = static_cast<bool>(datos);
+        datos.close();
+    }
+
+    for (auto& hilo : hilos)
+        hilo.join();
+
+    if (!correcto)
+        itkGenericExceptionMacro(<< "No se pudieron leer todos los slices");
+    if (!escrito)
+        itkGenericExceptionMacro(<< "Error escribiendo los datos de " << outVolume);
+
+    if (salidaMHD)
+    {
+        escribirCabeceraMHD(outVolume, volumen, ficheroDatos, bytesComprimidos);
+    }
+    else if (volumenBloques::EsFicheroBloques(outVolume))
+    {
+        volumenBloques::Escribir(volumen.GetPointer(), outVolume, 64, 1, numHilos);
+    }
+    else
+    {
+        auto volumeWriter = itk::ImageFileWriter<VolumeType>::New();
+        volumeWriter->SetFileName(outVolume);
+        volumeWriter->SetInput(volumen);
+        volumeWriter->Update();
+    }
+    return volumen;
+}
 
 int main(int argc, char* argv[])
 {
     if (argc < 5)
     {
         std::cerr << "Uso: " << argv[0]
-                  << " <patrón_entrada> <startIndex> <endIndex> <volumen_salida.mhd>\n"
+                  << " <patrón_entrada> <startIndex> <endIndex> <volumen_salida(.mhd|.blq)> [paralelo|itk] [numHilos] [no|zlib[:nivel]]\n"
                   << "Ejemplo: " << argv[0] << " \"t%02d.bmp\" 50 60 resultado.mhd\n";
         return EXIT_FAILURE;
     }
@@ -24,12 +267,31 @@ int main(int argc, char* argv[])
     const unsigned int startIdx  = std::stoi(argv[2]);
     const unsigned int endIdx    = std::stoi(argv[3]);
     const std::string outVolume  = argv[4];         // e.g. "resultado.mhd"
-
-    constexpr unsigned int Dimension3D = 3;
-    constexpr unsigned int Dimension2D = 2;
-    using PixelType   = unsigned char;
-    using VolumeType  = itk::Image<PixelType, Dimension3D>;
-    using SliceType   = itk::Image<PixelType, Dimension2D>;
+    // paralelo (por defecto): decodificación en varios hilos y escritura solapada.
+    // itk: ImageSeriesReader + ImageFileWriter, un slice detrás de otro.
+    const std::string modo       = (argc > 5 ? argv[5] : "paralelo");
+    unsigned int numHilos = std::max(1u, std::thread::hardware_concurrency());
+    if (argc > 6)
+        numHilos = std::max(1, std::stoi(argv[6]));
+    // Compresión de la salida .mhd (.zraw): zlib con nivel 1-9 (6 por defecto).
+    // En modo paralelo los bloques se comprimen en varios hilos; en modo itk el
+    // nivel se pasa a ImageFileWriter.
+    int nivelCompresion = -1;
+    if (argc > 7 && std::string(argv[7]) != "no")
+    {
+        // Sólo "zlib" o "zlib:N" con N de 1 a 9
+        const std::string compresion = argv[7];
+        if (compresion == "zlib")
+            nivelCompresion = 6;
+        else if (compresion.size() == 6 && compresion.compare(0, 5, "zlib:") == 0 && compresion[5] >= '1' &&
+                 compresion[5] <= '9')
+            nivelCompresion = compresion[5] - '0';
+        else
+        {
+            std::cerr << "Compresión no válida: " << compresion << " (no|zlib|zlib:1..9)" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
 
     // 1) Generar nombres de serie
     using NameGenType = itk::NumericSeriesFileNames;
@@ -39,41 +301,77 @@ int main(int argc, char* argv[])
     nameGenerator->SetEndIndex(endIdx);
     nameGenerator->SetIncrementIndex(1);
 
-    // 2) Leer la serie de 2D y crear el volumen 3D
-    using ReaderType = itk::ImageSeriesReader<VolumeType>;
-    auto seriesReader = ReaderType::New();
-    seriesReader->SetFileNames(nameGenerator->GetFileNames());
-
-    try
+    const std::vector<std::string> nombres = nameGenerator->GetFileNames();
+    if (nombres.empty())
     {
-        seriesReader->Update();
-    }
-    catch (itk::ExceptionObject& err)
-    {
-        std::cerr << "Error leyendo la serie: " << err << std::endl;
+        std::cerr << "La serie no contiene ficheros" << std::endl;
         return EXIT_FAILURE;
     }
 
-    // 3) Escribir el volumen en .mhd
-    using WriterType = itk::ImageFileWriter<VolumeType>;
-    auto volumeWriter = WriterType::New();
-    volumeWriter->SetFileName(outVolume);
-    volumeWriter->SetInput(seriesReader->GetOutput());
-
-    try
+    const auto t0 = std::chrono::steady_clock::now();
+    VolumeType::Pointer volume;
+    if (modo == "itk")
     {
-        volumeWriter->Update();
+        // 2) Leer la serie de 2D y crear el volumen 3D
+        using ReaderType = itk::ImageSeriesReader<VolumeType>;
+        auto seriesReader = ReaderType::New();
+        seriesReader->SetFileNames(nombres);
+
+        try
+        {
+            seriesReader->Update();
+        }
+        catch (itk::ExceptionObject& err)
+        {
+            std::cerr << "Error leyendo la serie: " << err << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // 3) Escribir el volumen en .mhd (o por bloques en .blq)
+        using WriterType = itk::ImageFileWriter<VolumeType>;
+        auto volumeWriter = WriterType::New();
+        volumeWriter->SetFileName(outVolume);
+        volumeWriter->SetInput(seriesReader->GetOutput());
+        volumeWriter->SetUseCompression(nivelCompresion >= 0);
+        if (nivelCompresion >= 0)
+            volumeWriter->SetCompressionLevel(nivelCompresion);
+
+        try
+        {
+            if (volumenBloques::EsFicheroBloques(outVolume))
+                volumenBloques::Escribir(seriesReader->GetOutput(), outVolume, 64, 1, numHilos);
+            else
+                volumeWriter->Update();
+        }
+        catch (itk::ExceptionObject& err)
+        {
+            std::cerr << "Error escribiendo el volumen: " << err << std::endl;
+            return EXIT_FAILURE;
+        }
+        volume = seriesReader->GetOutput();
     }
-    catch (itk::ExceptionObject& err)
+    else
     {
-        std::cerr << "Error escribiendo el volumen: " << err << std::endl;
-        return EXIT_FAILURE;
+        // 2-3) Lectura en paralelo y escritura solapada
+        try
+        {
+            volume = ensamblarParalelo(nombres, outVolume, numHilos, nivelCompresion);
+        }
+        catch (itk::ExceptionObject& err)
+        {
+            std::cerr << "Error ensamblando el volumen: " << err << std::endl;
+            return EXIT_FAILURE;
+        }
     }
+    const std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - t0;
+    std::cout << nombres.size() << " slices ensamblados (" << modo;
+    if (modo != "itk")
+        std::cout << ", " << numHilos << " hilos";
+    std::cout << ") en " << ms.count() << " ms" << std::endl;
 
     std::cout << "Volumen 3D creado: " << outVolume << std::endl;
 
     // 4) Extraer y visualizar los slices con QuickView
-    auto volume = seriesReader->GetOutput();
     auto fullRegion = volume->GetLargestPossibleRegion();
     auto size = fullRegion.GetSize();
     auto start = fullRegion.GetIndex();
@@ -2,23 +2,118 @@
 #include "itkImage.h"
 #include "itkImageFileReader.h"
 #include "itkGDCMImageIO.h"
+#include "itkExtractImageFilter.h"
+#include "itkImageFileWriter.h"
+#include "itksys/SystemTools.hxx"
 #include "QuickView.h"
 
+#include "procesadoLotes.h"
+#include "serieDicom.h"
+
+#include <algorithm>
 #include <iostream>
+#include <string>
+#include <thread>
+
+constexpr unsigned int Dimension = 2;
+using PixelType = signed short;  // típico en DICOM
+using ImageType = itk::Image<PixelType, Dimension>;
+using VolumeType = itk::Image<PixelType, 3>;
+
+// Serie DICOM (directorio o fichero con una ruta por línea): exploración de
+// etiquetas, decodificación en paralelo en un volumen y visualización del corte
+// central. Si se indica 'volumenSalida' se guarda también el volumen.
+int verSerie(const std::string& entrada, unsigned int numHilos, const std::string& volumenSalida)
+{
+    const std::vector<std::string> ficheros = procesadoLotes::listarEntradas(entrada);
+    if (ficheros.empty())
+    {
+        std::cerr << "No hay ficheros en: " << entrada << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    double msExploracion = 0.0;
+    double msDecodificacion = 0.0;
+    const std::vector<serieDicom::Serie> series = serieDicom::Explorar(ficheros, numHilos, &msExploracion);
+    if (series.empty())
+    {
+        std::cerr << "No se encontraron ficheros DICOM en: " << entrada << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Exploración: " << ficheros.size() << " ficheros, " << series.size()
+              << " series en " << msExploracion << " ms" << std::endl;
+    for (const auto& serie : series)
+        std::cout << "  " << serie.uid << ": " << serie.cortes.size() << " cortes" << std::endl;
+
+    // Se carga la serie con más cortes
+    VolumeType::Pointer volumen;
+    try
+    {
+        volumen = serieDicom::Cargar<VolumeType>(series.front(), numHilos, &msDecodificacion);
+    }
+    catch (itk::ExceptionObject& err)
+    {
+        std::cerr << "Error al leer la serie DICOM: " << err << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Decodificación: " << series.front().cortes.size() << " cortes con " << numHilos
+              << " hilos en " << msDecodificacion << " ms" << std::endl;
+
+    if (!volumenSalida.empty())
+    {
+        auto writer = itk::ImageFileWriter<VolumeType>::New();
+        writer->SetFileName(volumenSalida);
+        writer->SetInput(volumen);
+        try
+        {
+            writer->Update();
+        }
+        catch (itk::ExceptionObject& err)
+        {
+            std::cerr << "Error al escribir el volumen: " << err << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "Volumen guardado en: " << volumenSalida << std::endl;
+    }
+
+    // Corte central para QuickView
+    VolumeType::RegionType region = volumen->GetLargestPossibleRegion();
+    VolumeType::SizeType tam = region.GetSize();
+    VolumeType::IndexType inicio = region.GetIndex();
+    inicio[2] += tam[2] / 2;
+    tam[2] = 0;
+    auto extractor = itk::ExtractImageFilter<VolumeType, ImageType>::New();
+    extractor->SetExtractionRegion(VolumeType::RegionType(inicio, tam));
+    extractor->SetInput(volumen);
+    extractor->SetDirectionCollapseToSubmatrix();
+    extractor->Update();
+
+    QuickView viewer;
+    viewer.AddImage(extractor->GetOutput(), true, "DICOM Serie (corte central)");
+    viewer.Visualize();
+    return EXIT_SUCCESS;
+}
 
 int main(int argc, char* argv[])
 {
     if(argc < 2)
     {
-        std::cerr << "Uso: " << argv[0] << " <dicom_file>" << std::endl;
+        std::cerr << "Uso: " << argv[0] << " <dicom_file>\n"
+                  << "     " << argv[0] << " <directorio_serie|lista> [numHilos] [volumen_salida.mhd]" << std::endl;
         return EXIT_FAILURE;
     }
 
     const char* dicomFile = argv[1];
 
-    constexpr unsigned int Dimension = 2;
-    using PixelType = signed short;  // típico en DICOM
-    using ImageType = itk::Image<PixelType, Dimension>;
+    // Directorio o lista de ficheros: carga de la serie completa
+    const std::string ext = itksys::SystemTools::LowerCase(itksys::SystemTools::GetFilenameLastExtension(dicomFile));
+    if (itksys::SystemTools::FileIsDirectory(dicomFile) || ext == ".txt")
+    {
+        unsigned int numHilos = std::max(1u, std::thread::hardware_concurrency());
+        if (argc > 2)
+            numHilos = std::max(1, std::stoi(argv[2]));
+        return verSerie(dicomFile, numHilos, argc > 3 ? argv[3] : "");
+    }
 
     // Configurar GDCM explícito
     auto dicomIO = itk::GDCMImageIO::New();
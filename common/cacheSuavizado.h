@@ -0,0 +1,167 @@
+#ifndef cacheSuavizado_h
+#define cacheSuavizado_h
+
+// Caché en disco para la etapa de suavizado (CurvatureFlow, mediana, ...).
+//
+// La clave es el hash del fichero de entrada más el filtro y sus parámetros;
+// el valor es el resultado guardado como MetaImage sin comprimir
+// (<directorio>/<clave>.mhd + .raw). Si la entrada ya está en caché se lee de
+// disco en lugar de volver a filtrar.
+//
+// Directorio: variable de entorno TVG_CACHE_DIR (por defecto ".cache_suavizado").
+// Con TVG_SIN_CACHE definida se calcula siempre y no se escribe nada.
+
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+#include "itkMetaImageIO.h"
+#include "itksys/SystemTools.hxx"
+
+#include "nombreTemporal.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+namespace cacheSuavizado
+{
+
+// FNV-1a de 64 bits
+inline std::uint64_t fnv1a(const char* datos, size_t n, std::uint64_t h = 1469598103934665603ULL)
+{
+  for (size_t i = 0; i < n; ++i)
+  {
+    h ^= static_cast<unsigned char>(datos[i]);
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+// Hash del contenido del fichero (no de su ruta ni de su fecha)
+inline std::uint64_t hashFichero(const std::string& ruta)
+{
+  std::ifstream f(ruta, std::ios::binary);
+  if (!f)
+    return 0;
+  std::vector<char> bloque(1 << 20);
+  std::uint64_t h = 1469598103934665603ULL;
+  while (f)
+  {
+    f.read(bloque.data(), static_cast<std::streamsize>(bloque.size()));
+    h = fnv1a(bloque.data(), static_cast<size_t>(f.gcount()), h);
+  }
+  return h;
+}
+
+inline std::string directorio()
+{
+  const char* dir = std::getenv("TVG_CACHE_DIR");
+  return (dir && *dir) ? std::string(dir) : std::string(".cache_suavizado");
+}
+
+// Devuelve el resultado de 'calcular' para la imagen 'rutaEntrada'. 'filtro'
+// describe el filtro y todos sus parámetros, p.ej. "curvatureFlow_it14_ts0.0025".
+template <typename TImage>
+typename TImage::Pointer obtener(const std::string& rutaEntrada,
+                                 const std::string& filtro,
+                                 const std::function<typename TImage::Pointer()>& calcular)
+{
+  if (std::getenv("TVG_SIN_CACHE"))
+    return calcular();
+
+  const std::uint64_t hEntrada = hashFichero(rutaEntrada);
+  if (hEntrada == 0)
+    return calcular();
+
+  // El tipo de píxel forma parte de la clave: la mediana de una imagen uchar no
+  // es la misma que la de la misma imagen leída como float
+  std::ostringstream descripcion;
+  descripcion << std::hex << hEntrada << "|" << filtro << "|"
+              << typeid(typename TImage::PixelType).name() << "|" << TImage::ImageDimension;
+  const std::string d = descripcion.str();
+
+  std::ostringstream clave;
+  clave << std::hex << std::setw(16) << std::setfill('0') << fnv1a(d.data(), d.size());
+  const std::string dir = directorio();
+  const std::string ruta = dir + "/" + clave.str() + ".mhd";
+
+  if (itksys::SystemTools::FileExists(ruta, true))
+  {
+    try
+    {
+      auto lector = itk::ImageFileReader<TImage>::New();
+      lector->SetImageIO(itk::MetaImageIO::New());
+      lector->SetFileName(ruta);
+      lector->Update();
+      std::cout << "Suavizado " << filtro << " leído de caché: " << ruta << std::endl;
+      return lector->GetOutput();
+    }
+    catch (itk::ExceptionObject& err)
+    {
+      std::cerr << "Entrada de caché inválida, se recalcula (" << ruta << "): " << err << std::endl;
+    }
+  }
+
+  typename TImage::Pointer resultado = calcular();
+
+  // Datos y cabecera se escriben con nombres temporales propios de este
+  // proceso (y de esta llamada). Se renombran los datos primero y la cabecera
+  // después, así otro proceso nunca ve una entrada (ni su .raw) a medio
+  // escribir, aunque esté llenando la misma clave a la vez
+  const std::string sufijo = nombreTemporal::Sufijo();
+  const std::string temporal = dir + "/" + clave.str() + sufijo + ".tmp.mhd";
+  const std::string datosTemporal = clave.str() + sufijo + ".tmp.raw";
+  const std::string datos = clave.str() + ".raw";
+  try
+  {
+    itksys::SystemTools::MakeDirectory(dir);
+    auto metaIO = itk::MetaImageIO::New();
+    metaIO->SetDataFileName(datosTemporal.c_str());
+    auto escritor = itk::ImageFileWriter<TImage>::New();
+    escritor->SetImageIO(metaIO);
+    escritor->SetUseCompression(false);
+    escritor->SetFileName(temporal);
+    escritor->SetInput(resultado);
+    escritor->Update();
+
+    // La cabecera temporal apunta al .raw temporal: se reescribe con el
+    // nombre definitivo antes de renombrar
+    std::ifstream      leida(temporal);
+    std::ostringstream cabecera;
+    std::string        linea;
+    while (std::getline(leida, linea))
+    {
+      if (linea.compare(0, 15, "ElementDataFile") == 0)
+        linea = "ElementDataFile = " + datos;
+      cabecera << linea << "\n";
+    }
+    leida.close();
+    std::ofstream(temporal, std::ios::trunc) << cabecera.str();
+
+    if (std::rename((dir + "/" + datosTemporal).c_str(), (dir + "/" + datos).c_str()) != 0 ||
+        std::rename(temporal.c_str(), ruta.c_str()) != 0)
+    {
+      std::cerr << "No se pudo guardar en caché (" << ruta << "): fallo al renombrar" << std::endl;
+      std::remove(temporal.c_str());
+      std::remove((dir + "/" + datosTemporal).c_str());
+    }
+  }
+  catch (itk::ExceptionObject& err)
+  {
+    std::cerr << "No se pudo guardar en caché (" << ruta << "): " << err << std::endl;
+    std::remove(temporal.c_str());
+    std::remove((dir + "/" + datosTemporal).c_str());
+  }
+  return resultado;
+}
+
+} // namespace cacheSuavizado
+
+#endif
@@ -0,0 +1,282 @@
+#ifndef cargaProgresiva_h
+#define cargaProgresiva_h
+
+// Carga progresiva de volúmenes MetaImage para los MedicalDemo.
+//
+// LeerReducido() lee una versión submuestreada (1 de cada 'factor' vóxeles en
+// cada eje) en una sola pasada: sólo se leen del disco las filas de los
+// cortes elegidos y de cada fila se toma 1 de cada 'factor' valores. Con
+// factor 4 se lee ~1/16 del fichero y el volumen resultante es 64 veces más
+// pequeño, suficiente para la primera imagen.
+//
+// Carga::Iniciar() lee después el volumen completo con vtkMetaImageReader en
+// un hilo (y, opcionalmente, hace allí el trabajo caro con él: isosuperficies,
+// ...). Cuando termina, un temporizador del interactor llama en el hilo de la
+// interfaz a la función que sustituye la vista previa y vuelve a renderizar.
+// Ambas lecturas se anotan en la etapa de lectura de metricas.h.
+
+#include <vtkCallbackCommand.h>
+#include <vtkCommand.h>
+#include <vtkImageData.h>
+#include <vtkMetaImageReader.h>
+#include <vtkNew.h>
+#include <vtkRenderWindow.h>
+#include <vtkRenderWindowInteractor.h>
+#include <vtkSmartPointer.h>
+#include <vtksys/SystemTools.hxx>
+
+#include "metricas.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cargaProgresiva
+{
+
+// Campos de la cabecera MetaImage necesarios para leer los datos en crudo
+struct Cabecera
+{
+  int         dims[3] = { 1, 1, 1 };
+  double      spacing[3] = { 1.0, 1.0, 1.0 };
+  double      origen[3] = { 0.0, 0.0, 0.0 };
+  int         tipoVTK = -1;
+  int         bytesPixel = 0;
+  bool        msb = false;
+  std::string ficheroDatos;
+  long long   desplazamiento = 0; // -1: los datos están al final del fichero
+};
+
+// Lee la cabecera de un .mhd/.mha. Falla con datos comprimidos, varias
+// componentes o listas de ficheros, que no se pueden leer con saltos.
+inline bool LeerCabecera(const std::string& fichero, Cabecera& cab)
+{
+  std::ifstream is(fichero, std::ios::binary);
+  if (!is)
+    return false;
+  std::string linea;
+  long long   tamCabeceraLocal = 0;
+  bool        local = false;
+  int         numDims = 3;
+  while (std::getline(is, linea))
+  {
+    const size_t igual = linea.find('=');
+    if (igual == std::string::npos)
+      continue;
+    std::string clave = linea.substr(0, igual);
+    std::string valor = linea.substr(igual + 1);
+    clave.erase(clave.find_last_not_of(" \t\r") + 1);
+    valor.erase(0, valor.find_first_not_of(" \t"));
+    valor.erase(valor.find_last_not_of(" \t\r") + 1);
+    std::istringstream v(valor);
+
+    if (clave == "NDims")
+      v >> numDims;
+    else if (clave == "DimSize")
+      v >> cab.dims[0] >> cab.dims[1] >> cab.dims[2];
+    else if (clave == "ElementSpacing" || clave == "ElementSize")
+      v >> cab.spacing[0] >> cab.spacing[1] >> cab.spacing[2];
+    else if (clave == "Offset" || clave == "Origin" || clave == "Position")
+      v >> cab.origen[0] >> cab.origen[1] >> cab.origen[2];
+    else if ((clave == "CompressedData" && valor == "True") ||
+             (clave == "ElementNumberOfChannels" && valor != "1"))
+      return false;
+    else if (clave == "BinaryDataByteOrderMSB" || clave == "ElementByteOrderMSB")
+      cab.msb = (valor == "True");
+    else if (clave == "HeaderSize")
+      v >> cab.desplazamiento;
+    else if (clave == "ElementType")
+    {
+      if (valor == "MET_SHORT")
+        cab.tipoVTK = VTK_SHORT, cab.bytesPixel = 2;
+      else if (valor == "MET_USHORT")
+        cab.tipoVTK = VTK_UNSIGNED_SHORT, cab.bytesPixel = 2;
+      else if (valor == "MET_UCHAR")
+        cab.tipoVTK = VTK_UNSIGNED_CHAR, cab.bytesPixel = 1;
+      else if (valor == "MET_CHAR")
+        cab.tipoVTK = VTK_SIGNED_CHAR, cab.bytesPixel = 1;
+      else if (valor == "MET_FLOAT")
+        cab.tipoVTK = VTK_FLOAT, cab.bytesPixel = 4;
+      else
+        return false;
+    }
+    else if (clave == "ElementDataFile")
+    {
+      // Siempre es el último campo de la cabecera
+      if (valor == "LOCAL")
+      {
+        local = true;
+        tamCabeceraLocal = static_cast<long long>(is.tellg());
+      }
+      else if (valor.find(' ') != std::string::npos || valor == "LIST")
+        return false;
+      else
+      {
+        const std::string dir = vtksys::SystemTools::GetFilenamePath(fichero);
+        cab.ficheroDatos = (dir.empty() || vtksys::SystemTools::FileIsFullPath(valor)) ? valor : dir + "/" + valor;
+      }
+      break;
+    }
+  }
+  if (numDims != 3 || cab.tipoVTK < 0)
+    return false;
+  if (local)
+  {
+    cab.ficheroDatos = fichero;
+    cab.desplazamiento = tamCabeceraLocal;
+  }
+  return !cab.ficheroDatos.empty();
+}
+
+// Volumen con 1 de cada 'factor' vóxeles por eje; nullptr si el fichero no se
+// puede leer así (comprimido, tipo no soportado, ...).
+inline vtkSmartPointer<vtkImageData> LeerReducido(const std::string& fichero, int factor)
+{
+  const auto t0 = std::chrono::steady_clock::now();
+  Cabecera   cab;
+  if (factor < 1 || !LeerCabecera(fichero, cab))
+    return nullptr;
+  std::ifstream is(cab.ficheroDatos, std::ios::binary);
+  if (!is)
+    return nullptr;
+
+  const size_t bytesFila = static_cast<size_t>(cab.dims[0]) * cab.bytesPixel;
+  const size_t bytesCorte = bytesFila * cab.dims[1];
+  long long    inicio = cab.desplazamiento;
+  if (inicio < 0)
+  {
+    is.seekg(0, std::ios::end);
+    inicio = static_cast<long long>(is.tellg()) - static_cast<long long>(bytesCorte * cab.dims[2]);
+    if (inicio < 0)
+      return nullptr;
+  }
+
+  int reducido[3];
+  for (int i = 0; i < 3; ++i)
+    reducido[i] = (cab.dims[i] + factor - 1) / factor;
+  auto volumen = vtkSmartPointer<vtkImageData>::New();
+  volumen->SetDimensions(reducido);
+  volumen->SetSpacing(cab.spacing[0] * factor, cab.spacing[1] * factor, cab.spacing[2] * factor);
+  volumen->SetOrigin(cab.origen);
+  volumen->AllocateScalars(cab.tipoVTK, 1);
+  unsigned char* salida = static_cast<unsigned char*>(volumen->GetScalarPointer());
+
+  std::vector<unsigned char> fila(bytesFila);
+  const int                  b = cab.bytesPixel;
+  for (int z = 0; z < reducido[2]; ++z)
+  {
+    for (int y = 0; y < reducido[1]; ++y)
+    {
+      is.seekg(inicio + static_cast<long long>(z * factor) * bytesCorte + static_cast<long long>(y * factor) * bytesFila);
+      if (!is.read(reinterpret_cast<char*>(fila.data()), bytesFila))
+        return nullptr;
+      for (int x = 0; x < reducido[0]; ++x)
+        std::memcpy(salida + b * x, fila.data() + static_cast<size_t>(b) * x * factor, b);
+      salida += static_cast<size_t>(b) * reducido[0];
+    }
+  }
+
+  // Los datos MetaImage pueden venir en big endian
+  const std::uint16_t prueba = 1;
+  const bool          hostMSB = *reinterpret_cast<const unsigned char*>(&prueba) == 0;
+  if (b > 1 && cab.msb != hostMSB)
+  {
+    unsigned char* p = static_cast<unsigned char*>(volumen->GetScalarPointer());
+    const size_t   n = static_cast<size_t>(reducido[0]) * reducido[1] * reducido[2];
+    for (size_t i = 0; i < n; ++i, p += b)
+      std::reverse(p, p + b);
+  }
+
+  const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+  metricas::Anotar(metricas::Lectura, ms);
+  std::cout << "Vista previa 1/" << factor << ": " << reducido[0] << "x" << reducido[1] << "x" << reducido[2]
+            << " en " << ms << " ms" << std::endl;
+  return volumen;
+}
+
+// Lectura del volumen completo en segundo plano.
+class Carga
+{
+public:
+  using Funcion = std::function<void(vtkImageData*)>;
+
+  Carga() = default;
+  Carga(const Carga&) = delete;
+  Carga& operator=(const Carga&) = delete;
+
+  ~Carga()
+  {
+    if (m_Hilo.joinable())
+      m_Hilo.join();
+    if (m_Interactor)
+      m_Interactor->RemoveObserver(m_Observador);
+  }
+
+  // 'enSegundoPlano' se ejecuta en el hilo de lectura con el volumen completo;
+  // 'alTerminar', después, en el hilo de la interfaz. El interactor ya debe
+  // estar inicializado.
+  void Iniciar(const std::string& fichero, vtkRenderWindowInteractor* iren, Funcion enSegundoPlano, Funcion alTerminar)
+  {
+    m_Interactor = iren;
+    m_AlTerminar = alTerminar;
+    m_Inicio = std::chrono::steady_clock::now();
+
+    m_Observador->SetCallback(&Carga::AlTemporizador);
+    m_Observador->SetClientData(this);
+    iren->AddObserver(vtkCommand::TimerEvent, m_Observador);
+    m_Temporizador = iren->CreateRepeatingTimer(100);
+
+    m_Hilo = std::thread([this, fichero, enSegundoPlano]() {
+      vtkNew<vtkMetaImageReader> reader;
+      reader->SetFileName(fichero.c_str());
+      {
+        metricas::Cronometro cronometro(metricas::Lectura);
+        reader->Update();
+      }
+      m_Volumen = reader->GetOutput();
+      if (enSegundoPlano)
+        enSegundoPlano(m_Volumen);
+      m_Listo = true;
+    });
+  }
+
+private:
+  static void AlTemporizador(vtkObject*, unsigned long, void* clientData, void*)
+  {
+    auto* self = static_cast<Carga*>(clientData);
+    if (!self->m_Listo || self->m_Temporizador < 0)
+      return;
+    self->m_Hilo.join();
+    self->m_Interactor->DestroyTimer(self->m_Temporizador);
+    self->m_Temporizador = -1;
+
+    if (self->m_AlTerminar)
+      self->m_AlTerminar(self->m_Volumen);
+    self->m_Interactor->GetRenderWindow()->Render();
+    std::cout << "Volumen completo listo en "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - self->m_Inicio).count()
+              << " ms" << std::endl;
+  }
+
+  std::thread                           m_Hilo;
+  std::atomic<bool>                     m_Listo{ false };
+  vtkSmartPointer<vtkImageData>         m_Volumen;
+  Funcion                               m_AlTerminar;
+  vtkRenderWindowInteractor*            m_Interactor = nullptr;
+  vtkNew<vtkCallbackCommand>            m_Observador;
+  int                                   m_Temporizador = -1;
+  std::chrono::steady_clock::time_point m_Inicio;
+};
+
+} // namespace cargaProgresiva
+
+#endif
@@ -0,0 +1,306 @@
+#ifndef cortesColor_h
+#define cortesColor_h
+
+// Cortes ortogonales coloreados para los MedicalDemo sin pasar el volumen
+// entero por vtkImageMapToColors.
+//
+// Tabla precalcula el color RGBA de los 65536 valores posibles de un escalar
+// de 16 bits (o de 8) con la vtkLookupTable del plano, y MapearCorte() colorea
+// sólo el corte pedido con una consulta a la tabla por vóxel. Plano guarda el
+// corte que muestra un vtkImageActor: al moverlo sólo se mapea el corte nuevo.
+// Con otros tipos de escalar se usa vtkScalarsToColors::MapValue vóxel a vóxel.
+//
+// Plano guarda además los últimos 'tamCache' cortes mapeados (LRU) y un hilo
+// de fondo mapea por adelantado los 'cortesPrecarga' siguientes en el sentido
+// en que se mueve el plano, de modo que al desplazarlo el corte suele estar
+// ya listo. La precarga sólo se hace con la tabla (escalares de 8 y 16 bits):
+// MapValue no se puede llamar desde otro hilo.
+
+#include <vtkImageActor.h>
+#include <vtkImageData.h>
+#include <vtkImageMapper3D.h>
+#include <vtkScalarsToColors.h>
+#include <vtkSmartPointer.h>
+#include <vtkType.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace cortesColor
+{
+
+// Cortes mapeados que guarda cada plano
+const size_t tamCache = 32;
+// Cortes que se mapean por adelantado en el sentido del desplazamiento
+const int cortesPrecarga = 8;
+
+// Colores RGBA de todos los valores de 16 bits (con o sin signo)
+class Tabla
+{
+public:
+  Tabla(vtkScalarsToColors* lut, bool conSigno)
+    : m_Lut(lut)
+    , m_ConSigno(conSigno)
+    , m_Valores(65536 * 4)
+  {
+    for (unsigned int i = 0; i < 65536; ++i)
+    {
+      const double valor = conSigno ? static_cast<double>(static_cast<std::int16_t>(i)) : static_cast<double>(i);
+      std::memcpy(&m_Valores[4 * i], lut->MapValue(valor), 4);
+    }
+  }
+
+  bool                 ConSigno() const { return m_ConSigno; }
+  vtkScalarsToColors*  Lut() const { return m_Lut; }
+  const unsigned char* RGBA(std::uint16_t bits) const { return &m_Valores[4 * static_cast<size_t>(bits)]; }
+
+private:
+  vtkScalarsToColors*        m_Lut;
+  bool                       m_ConSigno;
+  std::vector<unsigned char> m_Valores;
+};
+
+namespace detalle
+{
+
+template <typename T>
+void mapear(vtkImageData* volumen, const int extension[6], const Tabla& tabla, unsigned char* salida)
+{
+  vtkIdType incX, incY, incZ;
+  volumen->GetIncrements(incX, incY, incZ);
+  for (int z = extension[4]; z <= extension[5]; ++z)
+    for (int y = extension[2]; y <= extension[3]; ++y)
+    {
+      const T* p = static_cast<const T*>(volumen->GetScalarPointer(extension[0], y, z));
+      for (int x = extension[0]; x <= extension[1]; ++x, p += incX, salida += 4)
+      {
+        if (std::is_integral<T>::value && sizeof(T) <= 2)
+        {
+          // Los enteros con signo se indexan por su patrón de 16 bits
+          const std::uint16_t bits = std::is_signed<T>::value
+            ? static_cast<std::uint16_t>(static_cast<std::int16_t>(*p))
+            : static_cast<std::uint16_t>(*p);
+          std::memcpy(salida, tabla.RGBA(bits), 4);
+        }
+        else
+          std::memcpy(salida, tabla.Lut()->MapValue(static_cast<double>(*p)), 4);
+      }
+    }
+}
+
+} // namespace detalle
+
+// true si los cortes de este tipo de escalar se mapean sólo con la tabla
+inline bool MapeoConTabla(int tipoEscalar)
+{
+  return tipoEscalar == VTK_SHORT || tipoEscalar == VTK_UNSIGNED_SHORT || tipoEscalar == VTK_CHAR ||
+         tipoEscalar == VTK_SIGNED_CHAR || tipoEscalar == VTK_UNSIGNED_CHAR;
+}
+
+// true si la tabla se indexa con signo para este tipo de escalar
+inline bool ConSigno(int tipoEscalar)
+{
+  return tipoEscalar == VTK_SHORT || tipoEscalar == VTK_SIGNED_CHAR ||
+         (tipoEscalar == VTK_CHAR && VTK_TYPE_CHAR_IS_SIGNED);
+}
+
+// Extensión del corte 'indice' de 'volumen' perpendicular a 'eje' (0: x, 1: y, 2: z)
+inline void ExtensionCorte(vtkImageData* volumen, int eje, int indice, int extension[6])
+{
+  volumen->GetExtent(extension);
+  extension[2 * eje] = extension[2 * eje + 1] = indice;
+}
+
+// Imagen RGBA (unsigned char) con sólo el corte 'indice' coloreado; conserva
+// origen y spacing del volumen para que el actor lo sitúe en su sitio.
+inline vtkSmartPointer<vtkImageData> MapearCorte(vtkImageData* volumen, int eje, int indice, const Tabla& tabla)
+{
+  int extension[6];
+  ExtensionCorte(volumen, eje, indice, extension);
+  auto corte = vtkSmartPointer<vtkImageData>::New();
+  corte->SetExtent(extension);
+  corte->SetOrigin(volumen->GetOrigin());
+  corte->SetSpacing(volumen->GetSpacing());
+  corte->AllocateScalars(VTK_UNSIGNED_CHAR, 4);
+  unsigned char* salida = static_cast<unsigned char*>(corte->GetScalarPointer());
+  switch (volumen->GetScalarType())
+  {
+    vtkTemplateMacro(detalle::mapear<VTK_TT>(volumen, extension, tabla, salida));
+  }
+  return corte;
+}
+
+// Un plano ortogonal mostrado con un vtkImageActor.
+class Plano
+{
+public:
+  Plano(vtkImageActor* actor, vtkScalarsToColors* lut, int eje)
+    : m_Actor(actor)
+    , m_Lut(lut)
+    , m_Eje(eje)
+  {
+  }
+
+  Plano(const Plano&) = delete;
+  Plano& operator=(const Plano&) = delete;
+
+  ~Plano()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_Salir = true;
+    }
+    m_Cambio.notify_all();
+    if (m_Hilo.joinable())
+      m_Hilo.join();
+  }
+
+  // Volumen del que se sacan los cortes. Vacía la caché; la tabla se rehace si
+  // cambia el signo del tipo de escalar.
+  void FijarVolumen(vtkImageData* volumen)
+  {
+    const bool conSigno = ConSigno(volumen->GetScalarType());
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Volumen = volumen;
+    if (!m_Tabla || m_Tabla->ConSigno() != conSigno)
+      m_Tabla = std::make_shared<Tabla>(m_Lut, conSigno);
+    m_Cache.clear();
+    m_Orden.clear();
+    m_Pendientes.clear();
+    ++m_Generacion;
+    m_Indice = -1;
+    if (MapeoConTabla(volumen->GetScalarType()) && !m_Hilo.joinable())
+      m_Hilo = std::thread(&Plano::Precargar, this);
+  }
+
+  // Muestra el corte 'indice' (recortado al volumen); sólo mapea si cambia y
+  // no está en la caché. Después pide la precarga de los siguientes.
+  void Mostrar(int indice)
+  {
+    int extension[6];
+    m_Volumen->GetExtent(extension);
+    const int primero = extension[2 * m_Eje], ultimo = extension[2 * m_Eje + 1];
+    indice = std::max(primero, std::min(ultimo, indice));
+    if (indice == m_Indice)
+      return;
+    const int sentido = m_Indice < 0 ? 0 : (indice > m_Indice ? 1 : -1);
+    m_Indice = indice;
+
+    vtkSmartPointer<vtkImageData> corte = Buscar(indice);
+    if (!corte)
+    {
+      ++m_Fallos;
+      corte = MapearCorte(m_Volumen, m_Eje, indice, *m_Tabla);
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      Guardar(indice, corte);
+    }
+    else
+      ++m_Aciertos;
+    m_Actor->GetMapper()->SetInputData(corte);
+    m_Actor->SetDisplayExtent(corte->GetExtent());
+
+    // La última petición sustituye a la anterior: sólo importa hacia dónde va el plano
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Pendientes.clear();
+    for (int k = 1; k <= cortesPrecarga; ++k)
+    {
+      // Sin sentido todavía (primer corte): alternando a ambos lados
+      const int paso = sentido != 0 ? sentido * k : (k % 2 ? 1 : -1) * ((k + 1) / 2);
+      const int i = indice + paso;
+      if (i >= primero && i <= ultimo && m_Cache.find(i) == m_Cache.end())
+        m_Pendientes.push_back(i);
+    }
+    if (!m_Pendientes.empty())
+      m_Cambio.notify_one();
+  }
+
+  int Indice() const { return m_Indice; }
+  int Eje() const { return m_Eje; }
+  // Cortes mostrados que estaban o no en la caché
+  size_t Aciertos() const { return m_Aciertos; }
+  size_t Fallos() const { return m_Fallos; }
+
+private:
+  using Corte = vtkSmartPointer<vtkImageData>;
+
+  Corte Buscar(int indice)
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto                        it = m_Cache.find(indice);
+    if (it == m_Cache.end())
+      return nullptr;
+    m_Orden.splice(m_Orden.begin(), m_Orden, it->second.second);
+    return it->second.first;
+  }
+
+  // Con m_Mutex tomado
+  void Guardar(int indice, const Corte& corte)
+  {
+    if (m_Cache.find(indice) != m_Cache.end())
+      return;
+    m_Orden.push_front(indice);
+    m_Cache[indice] = { corte, m_Orden.begin() };
+    while (m_Cache.size() > tamCache)
+    {
+      m_Cache.erase(m_Orden.back());
+      m_Orden.pop_back();
+    }
+  }
+
+  void Precargar()
+  {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    for (;;)
+    {
+      m_Cambio.wait(lock, [this] { return m_Salir || !m_Pendientes.empty(); });
+      if (m_Salir)
+        return;
+      const int indice = m_Pendientes.front();
+      m_Pendientes.pop_front();
+      if (m_Cache.find(indice) != m_Cache.end() || !MapeoConTabla(m_Volumen->GetScalarType()))
+        continue;
+      // Mapear sin el cerrojo, con el volumen y la tabla de este momento
+      vtkSmartPointer<vtkImageData> volumen = m_Volumen;
+      std::shared_ptr<Tabla>        tabla = m_Tabla;
+      const unsigned int            generacion = m_Generacion;
+      lock.unlock();
+      Corte corte = MapearCorte(volumen, m_Eje, indice, *tabla);
+      lock.lock();
+      if (generacion == m_Generacion)
+        Guardar(indice, corte);
+    }
+  }
+
+  vtkImageActor*                m_Actor;
+  vtkScalarsToColors*           m_Lut;
+  int                           m_Eje;
+  int                           m_Indice = -1;
+  size_t                        m_Aciertos = 0;
+  size_t                        m_Fallos = 0;
+  vtkSmartPointer<vtkImageData> m_Volumen;
+  std::shared_ptr<Tabla>        m_Tabla;
+
+  // Caché LRU (m_Orden: más reciente primero) y precarga, protegidas por m_Mutex
+  std::map<int, std::pair<Corte, std::list<int>::iterator>> m_Cache;
+  std::list<int>                                            m_Orden;
+  std::deque<int>                                           m_Pendientes;
+  unsigned int                                              m_Generacion = 0;
+  bool                                                      m_Salir = false;
+  std::mutex                                                m_Mutex;
+  std::condition_variable                                   m_Cambio;
+  std::thread                                               m_Hilo;
+};
+
+} // namespace cortesColor
+
+#endif
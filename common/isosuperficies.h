@@ -0,0 +1,749 @@
+#ifndef isosuperficies_h
+#define isosuperficies_h
+
+// Isosuperficies (piel, hueso, ...) para los MedicalDemo con caché en disco.
+//
+// La clave de la caché es una huella del volumen (dimensiones, geometría,
+// tipo y contenido) y el isovalor. Cada entrada guarda la vtkPolyData ya
+// pasada por vtkStripper en un formato binario propio (puntos y normales en
+// float y las celdas en el formato "legacy" de vtkCellArray), que se carga con
+// una sola lectura del fichero. Los isovalores que no están en la caché se
+// extraen a la vez, cada uno en su hilo, y se guardan para la próxima vez.
+//
+// Directorio de la caché: variable de entorno TVG_CACHE_ISOSUPERFICIES o, si
+// no está, ".isosuperficies" junto al volumen.
+//
+// Extracción en una sola pasada (ExtraerVarias): marching cubes que recorre
+// el volumen una vez para todos los isovalores. Los 8 valores de cada celda y
+// su mínimo/máximo se leen una vez y sirven para descartar a la vez todos los
+// contornos que no la cruzan; los vértices se comparten entre celdas vecinas
+// con una caché de aristas por capa. Las capas en z se reparten entre hilos y
+// los vértices del plano entre dos bloques se sueldan al unir los trozos.
+// Sale una vtkPolyData por isovalor, con el valor en el array de campo
+// "Isovalor". Con TVG_ISOSUPERFICIES=vtk se usa un vtkFlyingEdges3D por
+// isovalor, en paralelo.
+//
+// Necesita VTK >= 9: las celdas se guardan y se construyen como offsets y
+// conectividad de vtkCellArray (ExportLegacyFormat, ImportLegacyFormat,
+// SetData).
+//
+// Los tiempos de contorno, vtkStripper y caché se anotan en metricas.h.
+
+#include <vtkCellArray.h>
+#include <vtkDoubleArray.h>
+#include <vtkFieldData.h>
+#include <vtkFloatArray.h>
+#include <vtkFlyingEdges3D.h>
+#include <vtkIdTypeArray.h>
+#include <vtkImageData.h>
+#include <vtkMarchingCubesTriangleCases.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkStripper.h>
+#include <vtkVersion.h>
+#include <vtksys/SystemTools.hxx>
+
+#include "metricas.h"
+#include "nombreTemporal.h"
+
+#if VTK_MAJOR_VERSION < 9
+#error "isosuperficies.h necesita VTK >= 9"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace isosuperficies
+{
+
+namespace detalle
+{
+
+const char     firma[8] = { 'T', 'V', 'G', 'I', 'S', 'O', '1', '\0' };
+const unsigned numCeldas = 4; // verts, lines, polys, strips
+
+struct Cabecera
+{
+  char          firma[8];
+  std::uint64_t huella;
+  double        valor;
+  std::uint64_t tamIdType;
+  std::uint64_t numPuntos;
+  std::uint64_t tieneNormales;
+  std::uint64_t longitudCeldas[numCeldas];
+};
+
+inline std::uint64_t mezclar(std::uint64_t h, std::uint64_t v)
+{
+  h ^= v;
+  h *= 0x9E3779B97F4A7C15ull;
+  return h ^ (h >> 29);
+}
+
+inline vtkCellArray* celdas(vtkPolyData* malla, unsigned i)
+{
+  switch (i)
+  {
+    case 0:
+      return malla->GetVerts();
+    case 1:
+      return malla->GetLines();
+    case 2:
+      return malla->GetPolys();
+    default:
+      return malla->GetStrips();
+  }
+}
+
+inline void fijarCeldas(vtkPolyData* malla, unsigned i, vtkCellArray* c)
+{
+  switch (i)
+  {
+    case 0:
+      malla->SetVerts(c);
+      break;
+    case 1:
+      malla->SetLines(c);
+      break;
+    case 2:
+      malla->SetPolys(c);
+      break;
+    default:
+      malla->SetStrips(c);
+      break;
+  }
+}
+
+// Bytes de puntos y normales, redondeados a 8 para que las celdas (vtkIdType)
+// queden alineadas en el fichero y en el buffer de lectura.
+inline std::uint64_t bytesFloats(const Cabecera& cab)
+{
+  const std::uint64_t bytes = cab.numPuntos * 3 * sizeof(float) * (cab.tieneNormales ? 2 : 1);
+  return (bytes + 7) / 8 * 8;
+}
+
+// Vértices de la celda en el orden de vtkMarchingCubes y aristas entre ellos
+const int verticesCelda[8][3] = { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 },
+                                  { 0, 0, 1 }, { 1, 0, 1 }, { 1, 1, 1 }, { 0, 1, 1 } };
+const int aristasCelda[12][2] = { { 0, 1 }, { 1, 2 }, { 3, 2 }, { 0, 3 }, { 4, 5 }, { 5, 6 },
+                                  { 7, 6 }, { 4, 7 }, { 0, 4 }, { 1, 5 }, { 3, 7 }, { 2, 6 } };
+// Arista de la rejilla que corresponde a cada arista de la celda (i, j, k):
+// dirección (0 = x, 1 = y, 2 = z), capa (0 = k, 1 = k + 1) y desplazamiento
+// en i, j.
+const int aristasRejilla[12][4] = { { 0, 0, 0, 0 }, { 1, 0, 1, 0 }, { 0, 0, 0, 1 }, { 1, 0, 0, 0 },
+                                    { 0, 1, 0, 0 }, { 1, 1, 1, 0 }, { 0, 1, 0, 1 }, { 1, 1, 0, 0 },
+                                    { 2, 0, 0, 0 }, { 2, 0, 1, 0 }, { 2, 0, 0, 1 }, { 2, 0, 1, 1 } };
+
+// Triángulos de un contorno calculados por un hilo. 'inferior' y 'superior'
+// son los índices de vértice de las aristas x e y de los planos que el bloque
+// comparte con el hilo anterior y con el siguiente (vacíos en los extremos).
+struct Parcial
+{
+  std::vector<float>     puntos, normales;
+  std::vector<vtkIdType> triangulos;
+  std::vector<vtkIdType> inferior[2], superior[2];
+};
+
+// Da a los vértices del plano inferior de 'parcial' el índice global que
+// tiene el mismo vértice en el plano superior de 'anterior'.
+inline void Soldar(const Parcial& anterior, const std::vector<vtkIdType>& globalAnterior, const Parcial& parcial,
+                   std::vector<vtkIdType>& global)
+{
+  for (int d = 0; d < 2; ++d)
+  {
+    const std::vector<vtkIdType>& abajo = parcial.inferior[d];
+    const std::vector<vtkIdType>& arriba = anterior.superior[d];
+    for (size_t i = 0; i < abajo.size() && i < arriba.size(); ++i)
+      if (abajo[i] >= 0 && arriba[i] >= 0)
+        global[abajo[i]] = globalAnterior[arriba[i]];
+  }
+}
+
+// Índices de vértice ya creados en las aristas x/y de las capas k y k+1 y en
+// las aristas z entre ellas (-1 si aún no hay vértice).
+struct CacheAristas
+{
+  std::vector<vtkIdType> x[2], y[2], z;
+
+  void Iniciar(size_t n)
+  {
+    for (int c = 0; c < 2; ++c)
+    {
+      x[c].assign(n, -1);
+      y[c].assign(n, -1);
+    }
+    z.assign(n, -1);
+  }
+
+  void Avanzar()
+  {
+    x[0].swap(x[1]);
+    y[0].swap(y[1]);
+    std::fill(x[1].begin(), x[1].end(), -1);
+    std::fill(y[1].begin(), y[1].end(), -1);
+    std::fill(z.begin(), z.end(), -1);
+  }
+
+  vtkIdType& Arista(int e, size_t celda, size_t nx)
+  {
+    const int* r = aristasRejilla[e];
+    const size_t i = celda + r[2] + r[3] * nx;
+    return r[0] == 0 ? x[r[1]][i] : (r[0] == 1 ? y[r[1]][i] : z[i]);
+  }
+};
+
+// Gradiente en el vóxel (x, y, z): diferencias centrales (laterales en los
+// bordes) divididas por el spacing.
+template <typename T>
+inline void gradiente(const T* s, const int dims[3], const double spacing[3], int x, int y, int z, double g[3])
+{
+  const size_t paso[3] = { 1, static_cast<size_t>(dims[0]), static_cast<size_t>(dims[0]) * dims[1] };
+  const int    p[3] = { x, y, z };
+  const size_t idx = z * paso[2] + y * paso[1] + x;
+  for (int d = 0; d < 3; ++d)
+  {
+    const bool   inicio = p[d] == 0;
+    const bool   fin = p[d] == dims[d] - 1;
+    const double mas = fin ? double(s[idx]) : double(s[idx + paso[d]]);
+    const double menos = inicio ? double(s[idx]) : double(s[idx - paso[d]]);
+    const double h = (inicio || fin ? 1.0 : 2.0) * spacing[d];
+    g[d] = (inicio && fin) ? 0.0 : (mas - menos) / h;
+  }
+}
+
+// Marching cubes de las capas de celdas [k0, k1) para todos los 'valores'.
+template <typename T>
+void contornosCapas(const T* s, const int dims[3], const double origen[3], const double spacing[3],
+                    const std::vector<double>& valores, int k0, int k1, std::vector<Parcial>& parciales)
+{
+  vtkMarchingCubesTriangleCases* casos = vtkMarchingCubesTriangleCases::GetCases();
+  const size_t nx = static_cast<size_t>(dims[0]);
+  const size_t capa = nx * dims[1];
+  const size_t desplazamiento[8] = { 0, 1, 1 + nx, nx, capa, capa + 1, capa + 1 + nx, capa + nx };
+  const double minimoValores = *std::min_element(valores.begin(), valores.end());
+  const double maximoValores = *std::max_element(valores.begin(), valores.end());
+
+  std::vector<CacheAristas> caches(valores.size());
+  for (auto& c : caches)
+    c.Iniciar(capa);
+  parciales.assign(valores.size(), Parcial());
+
+  for (int k = k0; k < k1; ++k)
+  {
+    if (k > k0)
+      for (auto& c : caches)
+        c.Avanzar();
+    for (int j = 0; j + 1 < dims[1]; ++j)
+    {
+      for (int i = 0; i + 1 < dims[0]; ++i)
+      {
+        const size_t base = k * capa + j * nx + i;
+        double       v[8];
+        double       mn, mx;
+        v[0] = mn = mx = static_cast<double>(s[base]);
+        for (int n = 1; n < 8; ++n)
+        {
+          v[n] = static_cast<double>(s[base + desplazamiento[n]]);
+          mn = std::min(mn, v[n]);
+          mx = std::max(mx, v[n]);
+        }
+        // Ningún contorno cruza la celda si todos sus valores quedan a un lado
+        if (mx < minimoValores || mn >= maximoValores)
+          continue;
+
+        const size_t celda = j * nx + i;
+        for (size_t c = 0; c < valores.size(); ++c)
+        {
+          const double valor = valores[c];
+          if (mx < valor || mn >= valor)
+            continue;
+          int indice = 0;
+          for (int n = 0; n < 8; ++n)
+            if (v[n] >= valor)
+              indice |= 1 << n;
+
+          Parcial&  parcial = parciales[c];
+          const int* aristas = casos[indice].edges;
+          for (; aristas[0] > -1; aristas += 3)
+          {
+            for (int a = 0; a < 3; ++a)
+            {
+              const int  e = aristas[a];
+              vtkIdType& id = caches[c].Arista(e, celda, nx);
+              if (id < 0)
+              {
+                const int* va = verticesCelda[aristasCelda[e][0]];
+                const int* vb = verticesCelda[aristasCelda[e][1]];
+                const double sa = v[aristasCelda[e][0]];
+                const double sb = v[aristasCelda[e][1]];
+                const double t = (valor - sa) / (sb - sa);
+                double       ga[3], gb[3], n[3];
+                gradiente(s, dims, spacing, i + va[0], j + va[1], k + va[2], ga);
+                gradiente(s, dims, spacing, i + vb[0], j + vb[1], k + vb[2], gb);
+                for (int d = 0; d < 3; ++d)
+                {
+                  const double pa = (d == 0 ? i : (d == 1 ? j : k)) + va[d];
+                  const double pb = (d == 0 ? i : (d == 1 ? j : k)) + vb[d];
+                  parcial.puntos.push_back(static_cast<float>(origen[d] + spacing[d] * (pa + t * (pb - pa))));
+                  n[d] = -(ga[d] + t * (gb[d] - ga[d])); // hacia valores menores (fuera)
+                }
+                const double longitud = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                for (int d = 0; d < 3; ++d)
+                  parcial.normales.push_back(static_cast<float>(longitud > 0.0 ? n[d] / longitud : 0.0));
+                id = static_cast<vtkIdType>(parcial.puntos.size() / 3 - 1);
+              }
+              parcial.triangulos.push_back(id);
+            }
+          }
+        }
+      }
+    }
+    // El plano k0 lo comparte el hilo anterior
+    if (k == k0 && k0 > 0)
+    {
+      for (size_t c = 0; c < valores.size(); ++c)
+      {
+        parciales[c].inferior[0] = caches[c].x[0];
+        parciales[c].inferior[1] = caches[c].y[0];
+      }
+    }
+  }
+  // y el plano k1, el siguiente
+  if (k1 < dims[2] - 1)
+  {
+    for (size_t c = 0; c < valores.size(); ++c)
+    {
+      parciales[c].superior[0].swap(caches[c].x[1]);
+      parciales[c].superior[1].swap(caches[c].y[1]);
+    }
+  }
+}
+
+inline std::string ficheroCache(const std::string& dir, std::uint64_t huella, double valor)
+{
+  std::ostringstream os;
+  os << dir << "/" << std::hex << std::setw(16) << std::setfill('0') << huella << std::dec << "_" << valor << ".iso";
+  return os.str();
+}
+
+} // namespace detalle
+
+// Huella de 64 bits del volumen: metadatos y todos los bytes de los escalares.
+// Cuatro acumuladores independientes para no depender de la latencia de la
+// multiplicación.
+inline std::uint64_t Huella(vtkImageData* volumen)
+{
+  int    dims[3];
+  double spacing[3], origen[3];
+  volumen->GetDimensions(dims);
+  volumen->GetSpacing(spacing);
+  volumen->GetOrigin(origen);
+
+  std::uint64_t h = 0xCBF29CE484222325ull;
+  for (int i = 0; i < 3; ++i)
+  {
+    std::uint64_t s, o;
+    std::memcpy(&s, &spacing[i], sizeof(s));
+    std::memcpy(&o, &origen[i], sizeof(o));
+    h = detalle::mezclar(h, static_cast<std::uint64_t>(dims[i]));
+    h = detalle::mezclar(h, s);
+    h = detalle::mezclar(h, o);
+  }
+  h = detalle::mezclar(h, static_cast<std::uint64_t>(volumen->GetScalarType()));
+  h = detalle::mezclar(h, static_cast<std::uint64_t>(volumen->GetNumberOfScalarComponents()));
+
+  const unsigned char* datos = static_cast<const unsigned char*>(volumen->GetScalarPointer());
+  const size_t         bytes = static_cast<size_t>(volumen->GetNumberOfPoints()) *
+                       volumen->GetNumberOfScalarComponents() * volumen->GetScalarSize();
+  std::uint64_t a[4] = { h, h ^ 1, h ^ 2, h ^ 3 };
+  size_t        i = 0;
+  for (; i + 32 <= bytes; i += 32)
+  {
+    std::uint64_t v[4];
+    std::memcpy(v, datos + i, sizeof(v));
+    for (int k = 0; k < 4; ++k)
+      a[k] = (a[k] ^ v[k]) * 0x9E3779B97F4A7C15ull;
+  }
+  for (int k = 0; k < 4; ++k)
+    h = detalle::mezclar(h, a[k]);
+  for (; i < bytes; ++i)
+    h = detalle::mezclar(h, datos[i]);
+  return h;
+}
+
+// Directorio de caché para un volumen leído de 'ficheroVolumen'.
+inline std::string DirectorioCache(const std::string& ficheroVolumen)
+{
+  std::string dir;
+  if (vtksys::SystemTools::GetEnv("TVG_CACHE_ISOSUPERFICIES", dir) && !dir.empty())
+    return dir;
+  dir = vtksys::SystemTools::GetFilenamePath(ficheroVolumen);
+  return (dir.empty() ? std::string(".") : dir) + "/.isosuperficies";
+}
+
+// Guarda 'malla' en 'fichero' (vía un temporal y rename, por si hay varios
+// procesos escribiendo la misma entrada).
+inline bool Guardar(vtkPolyData* malla, const std::string& fichero, std::uint64_t huella, double valor)
+{
+  detalle::Cabecera cab{};
+  std::memcpy(cab.firma, detalle::firma, sizeof(cab.firma));
+  cab.huella = huella;
+  cab.valor = valor;
+  cab.tamIdType = sizeof(vtkIdType);
+  cab.numPuntos = static_cast<std::uint64_t>(malla->GetNumberOfPoints());
+
+  // Puntos y normales en float (DeepCopy convierte si vienen en double)
+  auto puntos = vtkSmartPointer<vtkFloatArray>::New();
+  if (malla->GetPoints())
+    puntos->DeepCopy(malla->GetPoints()->GetData());
+  auto          normales = vtkSmartPointer<vtkFloatArray>::New();
+  vtkDataArray* normalesMalla = malla->GetPointData()->GetNormals();
+  if (normalesMalla)
+  {
+    cab.tieneNormales = 1;
+    normales->DeepCopy(normalesMalla);
+  }
+
+  vtkNew<vtkIdTypeArray> legado[detalle::numCeldas];
+  for (unsigned i = 0; i < detalle::numCeldas; ++i)
+  {
+    detalle::celdas(malla, i)->ExportLegacyFormat(legado[i]);
+    cab.longitudCeldas[i] = static_cast<std::uint64_t>(legado[i]->GetNumberOfValues());
+  }
+
+  // Nombre temporal único por proceso y llamada: ni otro proceso ni otro hilo
+  // escriben en el mismo fichero antes del rename
+  const std::string temporal = fichero + nombreTemporal::Sufijo() + ".tmp";
+  {
+    std::ofstream os(temporal, std::ios::binary);
+    if (!os)
+      return false;
+    os.write(reinterpret_cast<const char*>(&cab), sizeof(cab));
+    os.write(reinterpret_cast<const char*>(puntos->GetPointer(0)), cab.numPuntos * 3 * sizeof(float));
+    if (cab.tieneNormales)
+      os.write(reinterpret_cast<const char*>(normales->GetPointer(0)), cab.numPuntos * 3 * sizeof(float));
+    const char relleno[8] = {};
+    os.write(relleno, detalle::bytesFloats(cab) - cab.numPuntos * 3 * sizeof(float) * (cab.tieneNormales ? 2 : 1));
+    for (unsigned i = 0; i < detalle::numCeldas; ++i)
+      os.write(reinterpret_cast<const char*>(legado[i]->GetPointer(0)), cab.longitudCeldas[i] * sizeof(vtkIdType));
+    if (!os)
+    {
+      os.close();
+      std::remove(temporal.c_str());
+      return false;
+    }
+  }
+  if (std::rename(temporal.c_str(), fichero.c_str()) != 0)
+  {
+    std::remove(temporal.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Carga una entrada de la caché; nullptr si no existe o no corresponde.
+inline vtkSmartPointer<vtkPolyData> Cargar(const std::string& fichero, std::uint64_t huella, double valor)
+{
+  std::ifstream is(fichero, std::ios::binary | std::ios::ate);
+  if (!is)
+    return nullptr;
+  const std::streamoff tam = is.tellg();
+  if (tam < static_cast<std::streamoff>(sizeof(detalle::Cabecera)))
+    return nullptr;
+  std::vector<char> buffer(static_cast<size_t>(tam));
+  is.seekg(0);
+  if (!is.read(buffer.data(), tam))
+    return nullptr;
+
+  detalle::Cabecera cab;
+  std::memcpy(&cab, buffer.data(), sizeof(cab));
+  if (std::memcmp(cab.firma, detalle::firma, sizeof(cab.firma)) != 0 || cab.huella != huella ||
+      cab.valor != valor || cab.tamIdType != sizeof(vtkIdType))
+    return nullptr;
+  std::uint64_t esperado = sizeof(cab) + detalle::bytesFloats(cab);
+  for (unsigned i = 0; i < detalle::numCeldas; ++i)
+    esperado += cab.longitudCeldas[i] * sizeof(vtkIdType);
+  if (esperado != static_cast<std::uint64_t>(tam))
+    return nullptr;
+
+  const char* p = buffer.data() + sizeof(cab);
+  const char* celdas = p + detalle::bytesFloats(cab);
+  auto        malla = vtkSmartPointer<vtkPolyData>::New();
+
+  vtkNew<vtkFloatArray> coordenadas;
+  coordenadas->SetNumberOfComponents(3);
+  coordenadas->SetNumberOfTuples(static_cast<vtkIdType>(cab.numPuntos));
+  std::memcpy(coordenadas->GetPointer(0), p, cab.numPuntos * 3 * sizeof(float));
+  p += cab.numPuntos * 3 * sizeof(float);
+  vtkNew<vtkPoints> puntos;
+  puntos->SetData(coordenadas);
+  malla->SetPoints(puntos);
+
+  if (cab.tieneNormales)
+  {
+    vtkNew<vtkFloatArray> normales;
+    normales->SetName("Normals");
+    normales->SetNumberOfComponents(3);
+    normales->SetNumberOfTuples(static_cast<vtkIdType>(cab.numPuntos));
+    std::memcpy(normales->GetPointer(0), p, cab.numPuntos * 3 * sizeof(float));
+    malla->GetPointData()->SetNormals(normales);
+  }
+
+  p = celdas;
+  for (unsigned i = 0; i < detalle::numCeldas; ++i)
+  {
+    vtkNew<vtkCellArray> c;
+    c->ImportLegacyFormat(reinterpret_cast<const vtkIdType*>(p), static_cast<vtkIdType>(cab.longitudCeldas[i]));
+    p += cab.longitudCeldas[i] * sizeof(vtkIdType);
+    detalle::fijarCeldas(malla, i, c);
+  }
+  return malla;
+}
+
+// Pasa 'malla' por vtkStripper.
+inline vtkSmartPointer<vtkPolyData> Tiras(vtkPolyData* malla)
+{
+  metricas::Cronometro cronometro(metricas::Tiras);
+  vtkNew<vtkStripper>  stripper;
+  stripper->SetInputData(malla);
+  stripper->Update();
+  vtkSmartPointer<vtkPolyData> tiras = stripper->GetOutput();
+  return tiras;
+}
+
+// Isosuperficies de todos los 'valores' en una sola pasada por el volumen,
+// pasadas por vtkStripper (cada contorno en su hilo). Devuelve vacío si el
+// volumen no tiene una sola componente de un tipo escalar conocido.
+inline std::vector<vtkSmartPointer<vtkPolyData>> ExtraerVarias(vtkImageData* volumen, const std::vector<double>& valores,
+                                                               unsigned int numHilos = 0)
+{
+  std::vector<vtkSmartPointer<vtkPolyData>> mallas;
+  int                                       dims[3];
+  double                                    origen[3], spacing[3];
+  volumen->GetDimensions(dims);
+  volumen->GetOrigin(origen);
+  volumen->GetSpacing(spacing);
+  if (valores.empty() || volumen->GetNumberOfScalarComponents() != 1 || dims[0] < 2 || dims[1] < 2 || dims[2] < 2)
+    return mallas;
+
+  if (numHilos == 0)
+    numHilos = std::max(1u, std::thread::hardware_concurrency());
+  numHilos = std::min<unsigned int>(numHilos, static_cast<unsigned int>(dims[2] - 1));
+
+  // Cada hilo un bloque de capas de celdas; los vértices del plano que separa
+  // dos bloques se crean en ambos y se sueldan al unir.
+  std::vector<std::vector<detalle::Parcial>> parciales(numHilos);
+  std::vector<std::thread>                   hilos;
+  std::atomic<bool>                          tipoDesconocido(false);
+  const auto                                 inicioContorno = std::chrono::steady_clock::now();
+  for (unsigned int h = 0; h < numHilos; ++h)
+  {
+    const int k0 = static_cast<int>((dims[2] - 1) * static_cast<long>(h) / numHilos);
+    const int k1 = static_cast<int>((dims[2] - 1) * static_cast<long>(h + 1) / numHilos);
+    hilos.emplace_back([&, h, k0, k1]() {
+      switch (volumen->GetScalarType())
+      {
+        vtkTemplateMacro(detalle::contornosCapas(static_cast<const VTK_TT*>(volumen->GetScalarPointer()), dims,
+                                                 origen, spacing, valores, k0, k1, parciales[h]));
+        default:
+          tipoDesconocido = true;
+          return;
+      }
+    });
+  }
+  for (auto& hilo : hilos)
+    hilo.join();
+  if (tipoDesconocido)
+    return mallas;
+  metricas::Anotar(metricas::Contorno, std::chrono::duration<double, std::milli>(
+                                         std::chrono::steady_clock::now() - inicioContorno).count());
+
+  // Unir los trozos de cada contorno y pasarlo por el stripper
+  mallas.resize(valores.size());
+  hilos.clear();
+  for (size_t c = 0; c < valores.size(); ++c)
+  {
+    hilos.emplace_back([&, c]() {
+      // Índice global de cada vértice: los del plano entre dos bloques se
+      // quedan con el que les dio el hilo anterior
+      std::vector<std::vector<vtkIdType>> global(parciales.size());
+      vtkIdType                           numPuntos = 0, numIndices = 0;
+      for (size_t h = 0; h < parciales.size(); ++h)
+      {
+        const detalle::Parcial& parcial = parciales[h][c];
+        global[h].assign(parcial.puntos.size() / 3, -1);
+        if (h > 0)
+          detalle::Soldar(parciales[h - 1][c], global[h - 1], parcial, global[h]);
+        for (vtkIdType& g : global[h])
+          if (g < 0)
+            g = numPuntos++;
+        numIndices += static_cast<vtkIdType>(parcial.triangulos.size());
+      }
+      vtkNew<vtkFloatArray> coordenadas, normales;
+      coordenadas->SetNumberOfComponents(3);
+      coordenadas->SetNumberOfTuples(numPuntos);
+      normales->SetName("Normals");
+      normales->SetNumberOfComponents(3);
+      normales->SetNumberOfTuples(numPuntos);
+      vtkNew<vtkIdTypeArray> offsets, conectividad;
+      offsets->SetNumberOfValues(numIndices / 3 + 1);
+      conectividad->SetNumberOfValues(numIndices);
+
+      float*    xyz = coordenadas->GetPointer(0);
+      float*    nxyz = normales->GetPointer(0);
+      vtkIdType primerIndice = 0;
+      for (size_t h = 0; h < parciales.size(); ++h)
+      {
+        detalle::Parcial&             parcial = parciales[h][c];
+        const std::vector<vtkIdType>& g = global[h];
+        for (size_t v = 0; v < g.size(); ++v)
+        {
+          std::copy_n(&parcial.puntos[3 * v], 3, xyz + 3 * g[v]);
+          std::copy_n(&parcial.normales[3 * v], 3, nxyz + 3 * g[v]);
+        }
+        vtkIdType* ids = conectividad->GetPointer(primerIndice);
+        for (size_t n = 0; n < parcial.triangulos.size(); ++n)
+          ids[n] = g[parcial.triangulos[n]];
+        primerIndice += static_cast<vtkIdType>(parcial.triangulos.size());
+        parcial = detalle::Parcial(); // liberar cuanto antes
+        global[h] = std::vector<vtkIdType>();
+      }
+      for (vtkIdType t = 0; t <= numIndices / 3; ++t)
+        offsets->SetValue(t, 3 * t);
+
+      vtkNew<vtkPoints> puntos;
+      puntos->SetData(coordenadas);
+      vtkNew<vtkCellArray> triangulos;
+      triangulos->SetData(offsets, conectividad);
+      vtkNew<vtkPolyData> malla;
+      malla->SetPoints(puntos);
+      malla->SetPolys(triangulos);
+      malla->GetPointData()->SetNormals(normales);
+
+      mallas[c] = Tiras(malla);
+      vtkNew<vtkDoubleArray> etiqueta;
+      etiqueta->SetName("Isovalor");
+      etiqueta->InsertNextValue(valores[c]);
+      mallas[c]->GetFieldData()->AddArray(etiqueta);
+    });
+  }
+  for (auto& hilo : hilos)
+    hilo.join();
+  return mallas;
+}
+
+// Isosuperficie 'valor' de 'volumen' con el filtro de VTK, pasada por
+// vtkStripper.
+inline vtkSmartPointer<vtkPolyData> Extraer(vtkImageData* volumen, double valor)
+{
+  // Cada extracción con su propia copia superficial del volumen: los filtros
+  // pueden ejecutarse en hilos distintos sin compartir el pipeline del lector.
+  vtkNew<vtkImageData> entrada;
+  entrada->ShallowCopy(volumen);
+
+  vtkNew<vtkFlyingEdges3D> extractor;
+  extractor->SetInputData(entrada);
+  extractor->SetValue(0, valor);
+
+  {
+    metricas::Cronometro cronometro(metricas::Contorno);
+    extractor->Update();
+  }
+
+  metricas::Cronometro cronometro(metricas::Tiras);
+  vtkNew<vtkStripper>  stripper;
+  stripper->SetInputConnection(extractor->GetOutputPort());
+  stripper->Update();
+
+  vtkSmartPointer<vtkPolyData> malla = stripper->GetOutput();
+  return malla;
+}
+
+// Una isosuperficie por valor (en el orden de 'valores'), de la caché de
+// 'dirCache' si está; las que faltan se extraen en paralelo y se guardan.
+inline std::vector<vtkSmartPointer<vtkPolyData>> Obtener(vtkImageData* volumen, const std::vector<double>& valores,
+                                                         const std::string& dirCache)
+{
+  using Reloj = std::chrono::steady_clock;
+  const auto t0 = Reloj::now();
+  auto       ms = [](Reloj::time_point desde) {
+    return std::chrono::duration<double, std::milli>(Reloj::now() - desde).count();
+  };
+
+  const std::uint64_t huella = Huella(volumen);
+  const double        msHuella = ms(t0);
+
+  std::vector<vtkSmartPointer<vtkPolyData>> mallas(valores.size());
+  std::vector<std::string>                  ficheros(valores.size());
+  std::vector<size_t>                       pendientes;
+  for (size_t i = 0; i < valores.size(); ++i)
+  {
+    ficheros[i] = detalle::ficheroCache(dirCache, huella, valores[i]);
+    mallas[i] = Cargar(ficheros[i], huella, valores[i]);
+    if (!mallas[i])
+      pendientes.push_back(i);
+  }
+  const double msCarga = ms(t0) - msHuella;
+  metricas::Anotar(metricas::Cache, msHuella + msCarga);
+
+  if (!pendientes.empty())
+  {
+    const auto  t1 = Reloj::now();
+    std::string modo;
+    vtksys::SystemTools::GetEnv("TVG_ISOSUPERFICIES", modo);
+    std::vector<vtkSmartPointer<vtkPolyData>> extraidas;
+    if (modo != "vtk")
+    {
+      std::vector<double> valoresPendientes;
+      for (size_t i : pendientes)
+        valoresPendientes.push_back(valores[i]);
+      extraidas = ExtraerVarias(volumen, valoresPendientes);
+    }
+    if (extraidas.size() == pendientes.size())
+    {
+      for (size_t n = 0; n < pendientes.size(); ++n)
+        mallas[pendientes[n]] = extraidas[n];
+    }
+    else
+    {
+      std::vector<std::thread> hilos;
+      for (size_t i : pendientes)
+        hilos.emplace_back([&, i]() { mallas[i] = Extraer(volumen, valores[i]); });
+      for (auto& hilo : hilos)
+        hilo.join();
+    }
+    const double msExtraccion = ms(t1);
+
+    vtksys::SystemTools::MakeDirectory(dirCache);
+    for (size_t i : pendientes)
+      if (!Guardar(mallas[i], ficheros[i], huella, valores[i]))
+        std::cerr << "No se pudo guardar " << ficheros[i] << std::endl;
+    std::cout << "Isosuperficies: " << pendientes.size() << " extraídas en " << msExtraccion
+              << " ms" << std::endl;
+  }
+
+  std::cout << "Isosuperficies: " << (valores.size() - pendientes.size()) << " de " << valores.size()
+            << " desde la caché (huella " << msHuella << " ms, lectura " << msCarga << " ms, total " << ms(t0)
+            << " ms)" << std::endl;
+  return mallas;
+}
+
+} // namespace isosuperficies
+
+#endif
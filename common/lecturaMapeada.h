@@ -0,0 +1,353 @@
+#ifndef lecturaMapeada_h
+#define lecturaMapeada_h
+
+// Lectura de MetaImage (.mhd/.mha) y .raw sin comprimir proyectando el fichero
+// en memoria (mmap) en lugar de leerlo.
+//
+// Los datos del fichero se entregan a la imagen ITK a través de su contenedor
+// de píxeles, sin copiarlos: sólo se cargan de disco las páginas que se tocan y
+// el lector no reserva memoria propia. La proyección es privada (copy-on-write),
+// así que escribir en la imagen nunca modifica el fichero. Spacing, origen y
+// dirección se toman de la cabecera igual que MetaImageIO.
+//
+// Si el fichero no se puede proyectar (datos comprimidos, tipo de píxel u orden
+// de bytes distintos, varios ficheros de datos, sistema sin mmap...) Leer()
+// recurre a itk::ImageFileReader.
+
+#include "itkImage.h"
+#include "itkImageFileReader.h"
+#include "itkImportImageContainer.h"
+#include "itksys/SystemTools.hxx"
+
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define LECTURA_MAPEADA_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lecturaMapeada
+{
+
+// Contenedor de píxeles que apunta a una proyección de fichero y la libera
+// (munmap) al destruirse, cuando la imagen ya no lo usa.
+template <typename TElemento>
+class ContenedorMapeado : public itk::ImportImageContainer<itk::SizeValueType, TElemento>
+{
+public:
+  using Self = ContenedorMapeado;
+  using Superclass = itk::ImportImageContainer<itk::SizeValueType, TElemento>;
+  using Pointer = itk::SmartPointer<Self>;
+  using ConstPointer = itk::SmartPointer<const Self>;
+  itkNewMacro(Self);
+
+  // 'base'/'longitud' describen la proyección; 'datos' apunta a los píxeles dentro de ella
+  void Asignar(void* base, size_t longitud, TElemento* datos, size_t numElementos)
+  {
+    m_Base = base;
+    m_Longitud = longitud;
+    this->SetImportPointer(datos, numElementos, false);
+  }
+
+protected:
+  ContenedorMapeado() = default;
+  ~ContenedorMapeado() override
+  {
+#ifdef LECTURA_MAPEADA_MMAP
+    if (m_Base)
+      munmap(m_Base, m_Longitud);
+#endif
+  }
+
+private:
+  void*  m_Base = nullptr;
+  size_t m_Longitud = 0;
+};
+
+// Campos de la cabecera MetaImage que hacen falta para proyectar los datos
+struct Cabecera
+{
+  unsigned int        numDimensiones = 0;
+  std::vector<size_t> tam;
+  std::vector<double> spacing;
+  std::vector<double> origen;
+  std::vector<double> matriz; // TransformMatrix, por filas como en el fichero
+  std::string         tipoElemento;
+  unsigned int        canales = 1;
+  bool                comprimida = false;
+  bool                msb = false;
+  long                saltoCabecera = 0; // HeaderSize (-1: datos al final del fichero)
+  std::string         ficheroDatos;      // ruta completa; igual a la cabecera si LOCAL
+  std::uint64_t       inicioLocal = 0;   // desplazamiento de los datos si LOCAL
+};
+
+namespace detalle
+{
+
+inline std::vector<double> numeros(const std::string& texto)
+{
+  std::vector<double> v;
+  std::istringstream is(texto);
+  double x;
+  while (is >> x)
+    v.push_back(x);
+  return v;
+}
+
+inline std::string recortar(const std::string& s)
+{
+  const size_t a = s.find_first_not_of(" \t\r");
+  const size_t b = s.find_last_not_of(" \t\r");
+  return a == std::string::npos ? std::string() : s.substr(a, b - a + 1);
+}
+
+template <typename T>
+const char* tipoMET()
+{
+  if (std::is_same<T, unsigned char>::value)
+    return "MET_UCHAR";
+  if (std::is_same<T, signed char>::value || std::is_same<T, char>::value)
+    return "MET_CHAR";
+  if (std::is_same<T, unsigned short>::value)
+    return "MET_USHORT";
+  if (std::is_same<T, short>::value)
+    return "MET_SHORT";
+  if (std::is_same<T, unsigned int>::value)
+    return "MET_UINT";
+  if (std::is_same<T, int>::value)
+    return "MET_INT";
+  if (std::is_same<T, float>::value)
+    return "MET_FLOAT";
+  if (std::is_same<T, double>::value)
+    return "MET_DOUBLE";
+  return "";
+}
+
+inline bool hostLittleEndian()
+{
+  const std::uint16_t uno = 1;
+  return *reinterpret_cast<const unsigned char*>(&uno) == 1;
+}
+
+// Proyecta 'longitud' bytes de 'ruta' desde 'desplazamiento' y los asigna a un
+// ContenedorMapeado. Devuelve nullptr si no se puede.
+template <typename TElemento>
+typename ContenedorMapeado<TElemento>::Pointer proyectar(const std::string& ruta, std::uint64_t desplazamiento,
+                                                         size_t numElementos)
+{
+#ifdef LECTURA_MAPEADA_MMAP
+  const size_t bytes = numElementos * sizeof(TElemento);
+  if (bytes == 0)
+    return nullptr;
+  const int fd = open(ruta.c_str(), O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+  struct stat info;
+  if (fstat(fd, &info) != 0 || static_cast<std::uint64_t>(info.st_size) < desplazamiento + bytes)
+  {
+    close(fd);
+    return nullptr;
+  }
+
+  // mmap exige un desplazamiento múltiplo del tamaño de página
+  const std::uint64_t pagina = static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+  const std::uint64_t inicio = desplazamiento - desplazamiento % pagina;
+  const size_t        longitud = static_cast<size_t>(desplazamiento - inicio) + bytes;
+  void* base = mmap(nullptr, longitud, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, static_cast<off_t>(inicio));
+  close(fd);
+  if (base == MAP_FAILED)
+    return nullptr;
+
+  auto* datos = reinterpret_cast<TElemento*>(static_cast<char*>(base) + (desplazamiento - inicio));
+  if (reinterpret_cast<std::uintptr_t>(datos) % alignof(TElemento) != 0)
+  {
+    munmap(base, longitud);
+    return nullptr;
+  }
+  auto contenedor = ContenedorMapeado<TElemento>::New();
+  contenedor->Asignar(base, longitud, datos, numElementos);
+  return contenedor;
+#else
+  (void)ruta;
+  (void)desplazamiento;
+  (void)numElementos;
+  return nullptr;
+#endif
+}
+
+} // namespace detalle
+
+// Lee la cabecera de un .mhd/.mha. Devuelve false si no es una MetaImage válida.
+inline bool leerCabecera(const std::string& ruta, Cabecera& c)
+{
+  std::ifstream f(ruta, std::ios::binary);
+  if (!f)
+    return false;
+
+  // Un valor numérico mal formado (stoul/stol) invalida la cabecera
+  try
+  {
+    std::string linea;
+    std::uint64_t leidos = 0;
+    while (std::getline(f, linea))
+    {
+      leidos += linea.size() + 1;
+      const size_t igual = linea.find('=');
+      if (igual == std::string::npos)
+        continue;
+      const std::string clave = detalle::recortar(linea.substr(0, igual));
+      const std::string valor = detalle::recortar(linea.substr(igual + 1));
+
+      if (clave == "NDims")
+        c.numDimensiones = static_cast<unsigned int>(std::stoul(valor));
+      else if (clave == "DimSize")
+      {
+        c.tam.clear();
+        for (double d : detalle::numeros(valor))
+          c.tam.push_back(static_cast<size_t>(d));
+      }
+      else if (clave == "ElementSpacing" || (clave == "ElementSize" && c.spacing.empty()))
+        c.spacing = detalle::numeros(valor);
+      else if (clave == "Offset" || clave == "Origin" || clave == "Position")
+        c.origen = detalle::numeros(valor);
+      else if (clave == "TransformMatrix" || clave == "Rotation" || clave == "Orientation")
+        c.matriz = detalle::numeros(valor);
+      else if (clave == "ElementType")
+        c.tipoElemento = valor;
+      else if (clave == "ElementNumberOfChannels")
+        c.canales = static_cast<unsigned int>(std::stoul(valor));
+      else if (clave == "CompressedData")
+        c.comprimida = (valor == "True" || valor == "true");
+      else if (clave == "BinaryDataByteOrderMSB" || clave == "ElementByteOrderMSB")
+        c.msb = (valor == "True" || valor == "true");
+      else if (clave == "HeaderSize")
+        c.saltoCabecera = std::stol(valor);
+      else if (clave == "ElementDataFile")
+      {
+        // Último campo de la cabecera
+        if (valor == "LOCAL" || valor == "Local" || valor == "local")
+        {
+          c.ficheroDatos = ruta;
+          c.inicioLocal = leidos;
+        }
+        else if (valor.find(' ') == std::string::npos && valor.find('%') == std::string::npos && valor != "LIST")
+        {
+          const std::string dir = itksys::SystemTools::GetFilenamePath(ruta);
+          c.ficheroDatos = (dir.empty() || itksys::SystemTools::FileIsFullPath(valor)) ? valor : dir + "/" + valor;
+        }
+        break;
+      }
+    }
+  }
+  catch (const std::exception&)
+  {
+    return false;
+  }
+  return c.numDimensiones > 0 && c.tam.size() == c.numDimensiones && !c.ficheroDatos.empty();
+}
+
+// Crea la imagen a partir de los datos de 'rutaDatos' (desde 'desplazamiento')
+// proyectados en memoria y la geometría dada. nullptr si no se puede proyectar.
+template <typename TImage>
+typename TImage::Pointer Proyectar(const std::string& rutaDatos, std::uint64_t desplazamiento,
+                                   const typename TImage::SizeType& tam,
+                                   const typename TImage::SpacingType& spacing,
+                                   const typename TImage::PointType& origen,
+                                   const typename TImage::DirectionType& direccion)
+{
+  using PixelType = typename TImage::PixelType;
+  size_t numPixeles = 1;
+  for (unsigned int d = 0; d < TImage::ImageDimension; ++d)
+    numPixeles *= tam[d];
+
+  auto contenedor = detalle::proyectar<PixelType>(rutaDatos, desplazamiento, numPixeles);
+  if (contenedor.IsNull())
+    return nullptr;
+
+  auto imagen = TImage::New();
+  typename TImage::RegionType region;
+  region.SetSize(tam);
+  imagen->SetRegions(region);
+  imagen->SetSpacing(spacing);
+  imagen->SetOrigin(origen);
+  imagen->SetDirection(direccion);
+  imagen->SetPixelContainer(contenedor);
+  return imagen;
+}
+
+// Proyecta una MetaImage sin comprimir. nullptr si no es posible.
+template <typename TImage>
+typename TImage::Pointer Mapear(const std::string& ruta)
+{
+  using PixelType = typename TImage::PixelType;
+  constexpr unsigned int D = TImage::ImageDimension;
+
+  const std::string ext = itksys::SystemTools::LowerCase(itksys::SystemTools::GetFilenameLastExtension(ruta));
+  Cabecera c;
+  if ((ext != ".mhd" && ext != ".mha") || !leerCabecera(ruta, c))
+    return nullptr;
+  if (c.numDimensiones != D || c.comprimida || c.canales != 1 || c.tipoElemento != detalle::tipoMET<PixelType>() ||
+      (sizeof(PixelType) > 1 && c.msb == detalle::hostLittleEndian()))
+    return nullptr;
+
+  typename TImage::SizeType      tam;
+  typename TImage::SpacingType   spacing;
+  typename TImage::PointType     origen;
+  typename TImage::DirectionType direccion;
+  direccion.SetIdentity();
+  size_t bytes = sizeof(PixelType);
+  for (unsigned int i = 0; i < D; ++i)
+  {
+    tam[i] = c.tam[i];
+    bytes *= c.tam[i];
+    spacing[i] = i < c.spacing.size() ? c.spacing[i] : 1.0;
+    origen[i] = i < c.origen.size() ? c.origen[i] : 0.0;
+    // Igual que MetaImageIO: la fila i de TransformMatrix es la dirección del eje i
+    if (c.matriz.size() == D * D)
+      for (unsigned int j = 0; j < D; ++j)
+        direccion[j][i] = c.matriz[i * D + j];
+  }
+
+  std::uint64_t desplazamiento = c.inicioLocal;
+  if (c.saltoCabecera > 0)
+    desplazamiento += static_cast<std::uint64_t>(c.saltoCabecera);
+  else if (c.saltoCabecera < 0)
+  {
+    // HeaderSize = -1: los datos ocupan los últimos bytes del fichero
+    const std::uint64_t total = itksys::SystemTools::FileLength(c.ficheroDatos);
+    if (total < bytes)
+      return nullptr;
+    desplazamiento = total - bytes;
+  }
+  return Proyectar<TImage>(c.ficheroDatos, desplazamiento, tam, spacing, origen, direccion);
+}
+
+// Proyección si es posible; si no, itk::ImageFileReader. 'mapeada' indica qué
+// camino se ha seguido.
+template <typename TImage>
+typename TImage::Pointer Leer(const std::string& ruta, bool* mapeada = nullptr)
+{
+  typename TImage::Pointer imagen = Mapear<TImage>(ruta);
+  if (mapeada)
+    *mapeada = imagen.IsNotNull();
+  if (imagen.IsNotNull())
+    return imagen;
+
+  auto lector = itk::ImageFileReader<TImage>::New();
+  lector->SetFileName(ruta);
+  lector->Update();
+  return lector->GetOutput();
+}
+
+} // namespace lecturaMapeada
+
+#endif
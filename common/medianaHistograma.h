@@ -0,0 +1,234 @@
+#ifndef medianaHistograma_h
+#define medianaHistograma_h
+
+// Mediana de coste constante por píxel (Perreault y Hébert, 2007) para
+// imágenes 2D de 8 y 16 bits.
+//
+// Se mantiene un histograma por columna con las 2r+1 filas de la ventana y el
+// histograma del núcleo se obtiene sumando/restando columnas al avanzar en x.
+// Los histogramas tienen dos niveles (grueso y fino): por píxel sólo se
+// actualiza el nivel grueso, y el segmento fino en el que cae la mediana se
+// pone al día de forma perezosa. La imagen se procesa en franjas verticales
+// cuyos histogramas de columna caben en caché y en bandas de filas repartidas
+// entre hilos.
+//
+// El resultado es el mismo que el de itk::MedianImageFilter (bordes replicados,
+// elemento N/2 de la vecindad ordenada). Las imágenes float/double también se
+// aceptan si todos sus valores son enteros en un rango de como mucho 65536
+// valores (p.ej. un PNG leído como float); si no, Mediana() usa ITK.
+//
+// Selección: variable de entorno TVG_MEDIANA = "histograma" (por defecto) o "itk".
+
+#include "itkImage.h"
+#include "itkMedianImageFilter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace medianaHistograma
+{
+
+namespace detalle
+{
+
+inline long recortar(long i, long n)
+{
+  return i < 0 ? 0 : (i >= n ? n - 1 : i);
+}
+
+// Calcula las filas [y0, y1) de la mediana sobre la imagen de índices 'bins'
+// (valores en [0, numBins)), escribiendo índices en 'salida'.
+inline void procesarBanda(const std::uint16_t* bins, std::uint16_t* salida, long ancho, long alto,
+                          long r, long y0, long y1, unsigned int numBins)
+{
+  // Segmentos finos de 16 valores para 8 bits, de 256 para rangos mayores
+  const unsigned int F = numBins <= 256 ? 16 : 256;
+  const unsigned int C = (numBins + F - 1) / F;
+  const unsigned int B = C * F;
+  const std::uint32_t mitad = static_cast<std::uint32_t>(((2 * r + 1) * (2 * r + 1)) / 2);
+
+  // Franja de columnas cuyos histogramas ocupen unos 512 KB
+  const long bytesColumna = static_cast<long>((B + C) * sizeof(std::uint16_t));
+  const long anchoFranja = std::max(16L, (512L * 1024L) / bytesColumna - 2 * r);
+
+  std::vector<std::uint16_t> colFino, colGrueso;
+  std::vector<std::uint32_t> kerFino(B), kerGrueso(C);
+  std::vector<long>          ultima(C);
+
+  for (long x0 = 0; x0 < ancho; x0 += anchoFranja)
+  {
+    const long x1 = std::min(ancho, x0 + anchoFranja);
+    const long numCol = (x1 - x0) + 2 * r;
+    colFino.assign(static_cast<size_t>(numCol) * B, 0);
+    colGrueso.assign(static_cast<size_t>(numCol) * C, 0);
+
+    auto sumarPixel = [&](long c, long y, int signo) {
+      const std::uint16_t v = bins[recortar(y, alto) * ancho + recortar(x0 - r + c, ancho)];
+      colFino[c * B + v] += signo;
+      colGrueso[c * C + v / F] += signo;
+    };
+
+    // Histogramas de columna para la primera fila de la banda
+    for (long c = 0; c < numCol; ++c)
+      for (long k = -r; k <= r; ++k)
+        sumarPixel(c, y0 + k, +1);
+
+    for (long y = y0; y < y1; ++y)
+    {
+      if (y > y0)
+      {
+        for (long c = 0; c < numCol; ++c)
+        {
+          sumarPixel(c, y - r - 1, -1);
+          sumarPixel(c, y + r, +1);
+        }
+      }
+
+      // Núcleo grueso de la primera posición; el fino se rehace bajo demanda
+      std::fill(kerGrueso.begin(), kerGrueso.end(), 0u);
+      for (long c = 0; c <= 2 * r; ++c)
+        for (unsigned int k = 0; k < C; ++k)
+          kerGrueso[k] += colGrueso[c * C + k];
+      std::fill(ultima.begin(), ultima.end(), -1L);
+
+      for (long xl = 0; xl < x1 - x0; ++xl)
+      {
+        if (xl > 0)
+        {
+          const std::uint16_t* entra = &colGrueso[(xl + 2 * r) * C];
+          const std::uint16_t* sale = &colGrueso[(xl - 1) * C];
+          for (unsigned int k = 0; k < C; ++k)
+            kerGrueso[k] += entra[k] - sale[k];
+        }
+
+        // Segmento grueso que contiene la mediana
+        std::uint32_t acumulado = 0;
+        unsigned int  k = 0;
+        while (acumulado + kerGrueso[k] <= mitad)
+          acumulado += kerGrueso[k++];
+
+        // Poner al día el segmento fino k
+        std::uint32_t* seg = &kerFino[k * F];
+        if (ultima[k] < 0 || xl - ultima[k] > 2 * r + 1)
+        {
+          std::fill(seg, seg + F, 0u);
+          for (long c = xl; c <= xl + 2 * r; ++c)
+          {
+            const std::uint16_t* col = &colFino[c * B + k * F];
+            for (unsigned int f = 0; f < F; ++f)
+              seg[f] += col[f];
+          }
+        }
+        else
+        {
+          for (long j = ultima[k] + 1; j <= xl; ++j)
+          {
+            const std::uint16_t* entra = &colFino[(j + 2 * r) * B + k * F];
+            const std::uint16_t* sale = &colFino[(j - 1) * B + k * F];
+            for (unsigned int f = 0; f < F; ++f)
+              seg[f] += entra[f] - sale[f];
+          }
+        }
+        ultima[k] = xl;
+
+        unsigned int f = 0;
+        while (acumulado + seg[f] <= mitad)
+          acumulado += seg[f++];
+        salida[y * ancho + x0 + xl] = static_cast<std::uint16_t>(k * F + f);
+      }
+    }
+  }
+}
+
+} // namespace detalle
+
+// Mediana de radio 'radio' con histogramas. Devuelve nullptr si la imagen no se
+// puede representar con índices de 16 bits (valores no enteros o rango > 65536).
+template <typename TImage>
+typename TImage::Pointer Filtrar(const TImage* entrada, unsigned int radio, unsigned int numHilos = 0)
+{
+  static_assert(TImage::ImageDimension == 2, "medianaHistograma: sólo imágenes 2D");
+  using PixelType = typename TImage::PixelType;
+
+  const auto   tam = entrada->GetBufferedRegion().GetSize();
+  const long   ancho = static_cast<long>(tam[0]);
+  const long   alto = static_cast<long>(tam[1]);
+  const size_t total = static_cast<size_t>(ancho) * static_cast<size_t>(alto);
+  const PixelType* pin = entrada->GetBufferPointer();
+  if (total == 0)
+    return nullptr;
+
+  // Rango de valores y comprobación de que son enteros
+  double minimo = static_cast<double>(pin[0]);
+  double maximo = minimo;
+  for (size_t i = 0; i < total; ++i)
+  {
+    const double v = static_cast<double>(pin[i]);
+    if (v != std::floor(v))
+      return nullptr;
+    minimo = std::min(minimo, v);
+    maximo = std::max(maximo, v);
+  }
+  if (maximo - minimo >= 65536.0)
+    return nullptr;
+  const unsigned int numBins = static_cast<unsigned int>(maximo - minimo) + 1;
+
+  std::vector<std::uint16_t> bins(total), resultado(total);
+  for (size_t i = 0; i < total; ++i)
+    bins[i] = static_cast<std::uint16_t>(static_cast<double>(pin[i]) - minimo);
+
+  if (numHilos == 0)
+    numHilos = std::max(1u, std::thread::hardware_concurrency());
+  numHilos = std::min<unsigned int>(numHilos, static_cast<unsigned int>(alto));
+
+  const long r = static_cast<long>(radio);
+  std::vector<std::thread> hilos;
+  for (unsigned int h = 0; h < numHilos; ++h)
+  {
+    const long y0 = alto * h / numHilos;
+    const long y1 = alto * (h + 1) / numHilos;
+    hilos.emplace_back(detalle::procesarBanda, bins.data(), resultado.data(), ancho, alto, r, y0, y1, numBins);
+  }
+  for (auto& hilo : hilos)
+    hilo.join();
+
+  auto salida = TImage::New();
+  salida->CopyInformation(entrada);
+  salida->SetRegions(entrada->GetBufferedRegion());
+  salida->Allocate();
+  PixelType* pout = salida->GetBufferPointer();
+  for (size_t i = 0; i < total; ++i)
+    pout[i] = static_cast<PixelType>(minimo + resultado[i]);
+  return salida;
+}
+
+// Mediana según TVG_MEDIANA: por histogramas si es posible, si no (o con
+// TVG_MEDIANA=itk) con itk::MedianImageFilter.
+template <typename TImage>
+typename TImage::Pointer Mediana(const TImage* entrada, unsigned int radio)
+{
+  const char* modo = std::getenv("TVG_MEDIANA");
+  if (!modo || std::string(modo) != "itk")
+  {
+    typename TImage::Pointer rapida = Filtrar<TImage>(entrada, radio);
+    if (rapida)
+      return rapida;
+  }
+
+  auto mediana = itk::MedianImageFilter<TImage, TImage>::New();
+  typename TImage::SizeType radius;
+  radius.Fill(radio);
+  mediana->SetRadius(radius);
+  mediana->SetInput(entrada);
+  mediana->Update();
+  return mediana->GetOutput();
+}
+
+} // namespace medianaHistograma
+
+#endif
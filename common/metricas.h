@@ -0,0 +1,315 @@
+#ifndef metricas_h
+#define metricas_h
+
+// Métricas por fotograma para los MedicalDemo.
+//
+// Las etapas de preparación (lectura del volumen, contorno, vtkStripper y
+// caché de isosuperficies) se anotan con Cronometro o Anotar desde cualquier
+// hilo; cada etapa acumula sus milisegundos (varias isosuperficies o la
+// vista previa más el volumen completo suman).
+//
+// Monitor se engancha al EndEvent del renderer y, en cada fotograma, toma
+// GetLastRenderTimeInSeconds(), los triángulos de los actores visibles y una
+// estimación de memoria:
+//   CPU: GetActualMemorySize() de la entrada de cada actor, imagen o volumen
+//        (más 3 bytes por vóxel de gradientes en los volúmenes, lo que guarda
+//        vtkFixedPointVolumeRayCastMapper).
+//   GPU: puntos (y normales) en float más índices de 32 bits por triángulo en
+//        las mallas, y la textura de cada vtkImageActor. Los volúmenes se
+//        trazan en la CPU y no cuentan.
+// Escribe una fila por fotograma en CSV (o todo en JSON al terminar, si el
+// fichero acaba en .json) y, si se pide, lo muestra sobre la imagen con un
+// vtkTextActor.
+
+#include <vtkAbstractVolumeMapper.h>
+#include <vtkActor.h>
+#include <vtkCallbackCommand.h>
+#include <vtkCellArray.h>
+#include <vtkCommand.h>
+#include <vtkImageActor.h>
+#include <vtkImageData.h>
+#include <vtkMapper.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkPolyData.h>
+#include <vtkProp.h>
+#include <vtkPropCollection.h>
+#include <vtkRenderer.h>
+#include <vtkTextActor.h>
+#include <vtkTextProperty.h>
+#include <vtkVolume.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace metricas
+{
+
+enum Etapa
+{
+  Lectura,
+  Contorno,
+  Tiras,
+  Cache,
+  NumEtapas
+};
+
+const char* const nombresEtapas[NumEtapas] = { "lectura", "contorno", "stripper", "cache" };
+
+namespace detalle
+{
+
+struct Tiempos
+{
+  std::mutex mutex;
+  double     ms[NumEtapas] = {};
+};
+
+inline Tiempos& tiempos()
+{
+  static Tiempos t;
+  return t;
+}
+
+inline double kib(double bytes)
+{
+  return bytes / 1024.0;
+}
+
+} // namespace detalle
+
+// Suma 'ms' a la etapa (desde cualquier hilo)
+inline void Anotar(Etapa etapa, double ms)
+{
+  detalle::Tiempos&           t = detalle::tiempos();
+  std::lock_guard<std::mutex> lock(t.mutex);
+  t.ms[etapa] += ms;
+}
+
+// Milisegundos acumulados de cada etapa
+inline void Consultar(double ms[NumEtapas])
+{
+  detalle::Tiempos&           t = detalle::tiempos();
+  std::lock_guard<std::mutex> lock(t.mutex);
+  for (int e = 0; e < NumEtapas; ++e)
+    ms[e] = t.ms[e];
+}
+
+// Anota en 'etapa' el tiempo que vive el objeto
+class Cronometro
+{
+public:
+  explicit Cronometro(Etapa etapa)
+    : m_Etapa(etapa)
+    , m_Inicio(std::chrono::steady_clock::now())
+  {
+  }
+
+  Cronometro(const Cronometro&) = delete;
+  Cronometro& operator=(const Cronometro&) = delete;
+
+  ~Cronometro()
+  {
+    Anotar(m_Etapa, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_Inicio).count());
+  }
+
+private:
+  Etapa                                 m_Etapa;
+  std::chrono::steady_clock::time_point m_Inicio;
+};
+
+// Medidas de un fotograma
+struct Fotograma
+{
+  size_t    numero = 0;
+  double    segundos = 0.0; // desde Iniciar
+  double    msRender = 0.0;
+  vtkIdType triangulos = 0;
+  double    kibCPU = 0.0;
+  double    kibGPU = 0.0;
+  double    msEtapas[NumEtapas] = {};
+};
+
+class Monitor
+{
+public:
+  Monitor() = default;
+  Monitor(const Monitor&) = delete;
+  Monitor& operator=(const Monitor&) = delete;
+
+  ~Monitor()
+  {
+    if (m_Renderer)
+    {
+      m_Renderer->RemoveObserver(m_AlRenderizar);
+      if (m_Superpuesto)
+        m_Renderer->RemoveViewProp(m_Texto);
+    }
+    if (m_Json)
+      EscribirJson();
+  }
+
+  // Empieza a medir los fotogramas de 'renderer'. 'fichero' vacío: sin
+  // registro; si acaba en .json se escribe en JSON al destruir el monitor y
+  // si no, en CSV según se dibuja. Devuelve false si no se puede abrir.
+  bool Iniciar(vtkRenderer* renderer, const std::string& fichero, bool superpuesto)
+  {
+    m_Renderer = renderer;
+    m_Superpuesto = superpuesto;
+    m_Inicio = std::chrono::steady_clock::now();
+    if (!fichero.empty())
+    {
+      m_Json = fichero.size() >= 5 && fichero.compare(fichero.size() - 5, 5, ".json") == 0;
+      m_Salida.open(fichero);
+      if (!m_Salida)
+      {
+        std::cerr << "No se pudo abrir " << fichero << std::endl;
+        m_Json = false;
+        return false;
+      }
+      if (!m_Json)
+      {
+        m_Salida << "fotograma,segundos,render_ms,triangulos,cpu_kib,gpu_kib";
+        for (int e = 0; e < NumEtapas; ++e)
+          m_Salida << "," << nombresEtapas[e] << "_ms";
+        m_Salida << "\n";
+      }
+    }
+
+    if (superpuesto)
+    {
+      m_Texto->SetDisplayPosition(10, 10);
+      m_Texto->GetTextProperty()->SetFontSize(14);
+      m_Texto->GetTextProperty()->SetColor(1.0, 1.0, 1.0);
+      renderer->AddViewProp(m_Texto);
+    }
+
+    m_AlRenderizar->SetCallback(&Monitor::AlRenderizar);
+    m_AlRenderizar->SetClientData(this);
+    renderer->AddObserver(vtkCommand::EndEvent, m_AlRenderizar);
+    return true;
+  }
+
+  const std::vector<Fotograma>& Fotogramas() const { return m_Fotogramas; }
+
+private:
+  // Triángulos de 'malla': polígonos de 3 vértices y n - 2 por tira
+  static vtkIdType Triangulos(vtkPolyData* malla)
+  {
+    vtkCellArray* tiras = malla->GetStrips();
+    return malla->GetNumberOfPolys() + tiras->GetNumberOfConnectivityIds() - 2 * tiras->GetNumberOfCells();
+  }
+
+  void Medir()
+  {
+    Fotograma f;
+    f.numero = m_Fotogramas.size();
+    f.segundos = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_Inicio).count();
+    f.msRender = 1000.0 * m_Renderer->GetLastRenderTimeInSeconds();
+    Consultar(f.msEtapas);
+
+    vtkPropCollection* props = m_Renderer->GetViewProps();
+    props->InitTraversal();
+    for (vtkProp* prop = props->GetNextProp(); prop; prop = props->GetNextProp())
+    {
+      if (!prop->GetVisibility())
+        continue;
+      if (auto* imagen = vtkImageActor::SafeDownCast(prop))
+      {
+        if (vtkImageData* corte = imagen->GetInput())
+        {
+          f.kibCPU += corte->GetActualMemorySize();
+          f.kibGPU += corte->GetActualMemorySize();
+        }
+      }
+      else if (auto* actor = vtkActor::SafeDownCast(prop))
+      {
+        vtkPolyData* malla = actor->GetMapper() ? vtkPolyData::SafeDownCast(actor->GetMapper()->GetInput()) : nullptr;
+        if (!malla)
+          continue;
+        const vtkIdType triangulos = Triangulos(malla);
+        f.triangulos += triangulos;
+        f.kibCPU += malla->GetActualMemorySize();
+        const double floatsPorPunto = malla->GetPointData()->GetNormals() ? 6.0 : 3.0;
+        f.kibGPU += detalle::kib(malla->GetNumberOfPoints() * floatsPorPunto * sizeof(float) +
+                                 triangulos * 3.0 * sizeof(unsigned int));
+      }
+      else if (auto* volumen = vtkVolume::SafeDownCast(prop))
+      {
+        vtkImageData* datos =
+          volumen->GetMapper() ? vtkImageData::SafeDownCast(volumen->GetMapper()->GetDataSetInput()) : nullptr;
+        if (datos)
+          f.kibCPU += datos->GetActualMemorySize() + detalle::kib(3.0 * datos->GetNumberOfPoints());
+      }
+    }
+    m_Fotogramas.push_back(f);
+
+    if (m_Salida && !m_Json)
+    {
+      m_Salida << f.numero << "," << f.segundos << "," << f.msRender << "," << f.triangulos << "," << f.kibCPU << ","
+               << f.kibGPU;
+      for (int e = 0; e < NumEtapas; ++e)
+        m_Salida << "," << f.msEtapas[e];
+      m_Salida << "\n";
+    }
+
+    if (m_Superpuesto)
+    {
+      std::ostringstream os;
+      os << std::fixed << std::setprecision(1) << "render " << f.msRender << " ms ("
+         << 1000.0 / std::max(f.msRender, 1e-3) << " fps)\n"
+         << "triangulos " << f.triangulos << "\n"
+         << "CPU " << f.kibCPU / 1024.0 << " MiB  GPU ~" << f.kibGPU / 1024.0 << " MiB\n";
+      for (int e = 0; e < NumEtapas; ++e)
+        os << (e ? "  " : "") << nombresEtapas[e] << " " << f.msEtapas[e] << " ms";
+      // Se verá en el fotograma siguiente
+      m_Texto->SetInput(os.str().c_str());
+    }
+  }
+
+  void EscribirJson()
+  {
+    m_Salida << "{\n  \"etapas_ms\": {";
+    double ms[NumEtapas];
+    Consultar(ms);
+    for (int e = 0; e < NumEtapas; ++e)
+      m_Salida << (e ? ", " : " ") << "\"" << nombresEtapas[e] << "\": " << ms[e];
+    m_Salida << " },\n  \"fotogramas\": [";
+    for (size_t i = 0; i < m_Fotogramas.size(); ++i)
+    {
+      const Fotograma& f = m_Fotogramas[i];
+      m_Salida << (i ? "," : "") << "\n    { \"fotograma\": " << f.numero << ", \"segundos\": " << f.segundos
+               << ", \"render_ms\": " << f.msRender << ", \"triangulos\": " << f.triangulos
+               << ", \"cpu_kib\": " << f.kibCPU << ", \"gpu_kib\": " << f.kibGPU;
+      for (int e = 0; e < NumEtapas; ++e)
+        m_Salida << ", \"" << nombresEtapas[e] << "_ms\": " << f.msEtapas[e];
+      m_Salida << " }";
+    }
+    m_Salida << "\n  ]\n}\n";
+  }
+
+  static void AlRenderizar(vtkObject*, unsigned long, void* clientData, void*)
+  {
+    static_cast<Monitor*>(clientData)->Medir();
+  }
+
+  vtkRenderer*                          m_Renderer = nullptr;
+  bool                                  m_Superpuesto = false;
+  bool                                  m_Json = false;
+  std::ofstream                         m_Salida;
+  std::chrono::steady_clock::time_point m_Inicio;
+  std::vector<Fotograma>                m_Fotogramas;
+  vtkNew<vtkTextActor>                  m_Texto;
+  vtkNew<vtkCallbackCommand>            m_AlRenderizar;
+};
+
+} // namespace metricas
+
+#endif
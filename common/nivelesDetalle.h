@@ -0,0 +1,238 @@
+#ifndef nivelesDetalle_h
+#define nivelesDetalle_h
+
+// Niveles de detalle para las isosuperficies de los MedicalDemo.
+//
+// Conmutador::Anadir(actor, malla) lanza en segundo plano la decimación de la
+// malla completa (vtkQuadricDecimation, cada nivel a partir del anterior) en
+// versiones con ~25 % y ~5 % de los triángulos. Cada nivel tiene su propio
+// vtkPolyDataMapper para que cambiar de nivel no vuelva a subir la geometría
+// a la GPU. Antes de cada render se elige el nivel: mientras el interactor
+// pide una tasa de refresco de interacción se usa un nivel reducido (más
+// grueso si el último frame no llegó a tiempo, más fino si sobró), y al
+// soltar el ratón se vuelve a la malla completa.
+//
+// Los niveles terminados se instalan desde un temporizador del interactor,
+// en el hilo de la interfaz, porque VTK no admite tocar actores desde otro
+// hilo.
+
+#include <vtkActor.h>
+#include <vtkCallbackCommand.h>
+#include <vtkCommand.h>
+#include <vtkNew.h>
+#include <vtkPolyData.h>
+#include <vtkPolyDataMapper.h>
+#include <vtkPolyDataNormals.h>
+#include <vtkQuadricDecimation.h>
+#include <vtkRenderWindow.h>
+#include <vtkRenderWindowInteractor.h>
+#include <vtkRenderer.h>
+#include <vtkSmartPointer.h>
+#include <vtkStripper.h>
+#include <vtkTriangleFilter.h>
+
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nivelesDetalle
+{
+
+// Fracción de triángulos que conserva cada nivel reducido
+const double fracciones[] = { 0.25, 0.05 };
+
+// Decima 'malla' (triángulos) conservando 'fraccion' de sus triángulos.
+inline vtkSmartPointer<vtkPolyData> Decimar(vtkPolyData* malla, double fraccion)
+{
+  vtkNew<vtkQuadricDecimation> decimador;
+  decimador->SetInputData(malla);
+  decimador->SetTargetReduction(1.0 - fraccion);
+  decimador->VolumePreservationOn();
+  decimador->Update();
+  vtkSmartPointer<vtkPolyData> salida = decimador->GetOutput();
+  return salida;
+}
+
+// Normales y tiras para dibujar un nivel decimado.
+inline vtkSmartPointer<vtkPolyData> Preparar(vtkPolyData* malla)
+{
+  vtkNew<vtkPolyDataNormals> normales;
+  normales->SetInputData(malla);
+  normales->SplittingOff();
+  vtkNew<vtkStripper> stripper;
+  stripper->SetInputConnection(normales->GetOutputPort());
+  stripper->Update();
+  vtkSmartPointer<vtkPolyData> salida = stripper->GetOutput();
+  return salida;
+}
+
+class Conmutador
+{
+public:
+  Conmutador() = default;
+  Conmutador(const Conmutador&) = delete;
+  Conmutador& operator=(const Conmutador&) = delete;
+
+  ~Conmutador()
+  {
+    if (m_Hilo.joinable())
+      m_Hilo.join();
+    if (m_Renderer)
+      m_Renderer->RemoveObserver(m_AlRenderizar);
+    if (m_Interactor)
+      m_Interactor->RemoveObserver(m_AlTemporizador);
+  }
+
+  // Registra un actor cuya entrada completa es 'completa'. Llamar a todos los
+  // Anadir antes de Iniciar.
+  void Anadir(vtkActor* actor, vtkPolyData* completa)
+  {
+    Entrada e;
+    e.actor = actor;
+    e.mappers.push_back(vtkPolyDataMapper::SafeDownCast(actor->GetMapper()));
+    // Copia profunda: una superficial compartiría los vtkPoints y las celdas
+    // con el pipeline, que puede volver a ejecutarse mientras el hilo de fondo
+    // los lee
+    e.completa = vtkSmartPointer<vtkPolyData>::New();
+    e.completa->DeepCopy(completa);
+    m_Entradas.push_back(e);
+  }
+
+  // Empieza la decimación en segundo plano y engancha el conmutador al
+  // renderer y al interactor (que ya debe estar inicializado).
+  void Iniciar(vtkRenderer* renderer, vtkRenderWindowInteractor* iren)
+  {
+    m_Renderer = renderer;
+    m_Interactor = iren;
+
+    m_AlRenderizar->SetCallback(&Conmutador::AlRenderizar);
+    m_AlRenderizar->SetClientData(this);
+    renderer->AddObserver(vtkCommand::StartEvent, m_AlRenderizar);
+
+    m_AlTemporizador->SetCallback(&Conmutador::AlTemporizador);
+    m_AlTemporizador->SetClientData(this);
+    iren->AddObserver(vtkCommand::TimerEvent, m_AlTemporizador);
+    m_Temporizador = iren->CreateRepeatingTimer(200);
+
+    std::vector<vtkSmartPointer<vtkPolyData>> completas;
+    for (const auto& e : m_Entradas)
+      completas.push_back(e.completa);
+    m_Hilo = std::thread([this, completas]() {
+      for (size_t i = 0; i < completas.size(); ++i)
+      {
+        vtkNew<vtkTriangleFilter> triangulos;
+        triangulos->SetInputData(completas[i]);
+        triangulos->Update();
+        vtkSmartPointer<vtkPolyData> anterior = triangulos->GetOutput();
+        const vtkIdType              numCompleta = anterior->GetNumberOfPolys();
+        double                       fraccionAnterior = 1.0;
+        for (double fraccion : fracciones)
+        {
+          // Cada nivel se decima a partir del anterior, que es más pequeño
+          vtkSmartPointer<vtkPolyData> decimada = Decimar(anterior, fraccion / fraccionAnterior);
+          vtkSmartPointer<vtkPolyData> lista = Preparar(decimada);
+          std::lock_guard<std::mutex>  lock(m_Mutex);
+          m_Terminados.push_back({ i, lista, decimada->GetNumberOfPolys(), numCompleta });
+          anterior = decimada;
+          fraccionAnterior = fraccion;
+        }
+      }
+    });
+  }
+
+private:
+  struct Entrada
+  {
+    vtkActor*                                       actor = nullptr;
+    vtkSmartPointer<vtkPolyData>                    completa;
+    std::vector<vtkSmartPointer<vtkPolyDataMapper>> mappers; // [0] = completa
+  };
+
+  struct Terminado
+  {
+    size_t                       entrada;
+    vtkSmartPointer<vtkPolyData> malla;
+    vtkIdType                    triangulos, triangulosCompleta;
+  };
+
+  static void AlTemporizador(vtkObject*, unsigned long, void* clientData, void*)
+  {
+    auto*                  self = static_cast<Conmutador*>(clientData);
+    std::vector<Terminado> terminados;
+    {
+      std::lock_guard<std::mutex> lock(self->m_Mutex);
+      terminados.swap(self->m_Terminados);
+    }
+    for (const auto& t : terminados)
+    {
+      Entrada& e = self->m_Entradas[t.entrada];
+      auto     mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+      mapper->SetInputData(t.malla);
+      mapper->SetScalarVisibility(e.mappers[0]->GetScalarVisibility());
+      e.mappers.push_back(mapper);
+      std::cout << "Nivel de detalle " << e.mappers.size() - 1 << ": " << t.triangulos << " de "
+                << t.triangulosCompleta << " triángulos" << std::endl;
+    }
+
+    bool todos = true;
+    for (const auto& e : self->m_Entradas)
+      todos = todos && e.mappers.size() == 1 + sizeof(fracciones) / sizeof(fracciones[0]);
+    if (todos && self->m_Temporizador >= 0)
+    {
+      self->m_Interactor->DestroyTimer(self->m_Temporizador);
+      self->m_Temporizador = -1;
+    }
+  }
+
+  static void AlRenderizar(vtkObject*, unsigned long, void* clientData, void*)
+  {
+    auto*        self = static_cast<Conmutador*>(clientData);
+    const double tasa = self->m_Renderer->GetRenderWindow()->GetDesiredUpdateRate();
+    const bool   interactivo = tasa >= 1.0; // StillUpdateRate es 0.0001
+
+    int nivel = 0;
+    if (interactivo)
+    {
+      // Ajustar con el tiempo del frame anterior si también fue interactivo
+      const double objetivo = 1.0 / tasa;
+      const double ultimo = self->m_Renderer->GetLastRenderTimeInSeconds();
+      if (self->m_UltimoInteractivo)
+      {
+        if (ultimo > objetivo)
+          ++self->m_NivelInteractivo;
+        else if (ultimo < 0.3 * objetivo)
+          --self->m_NivelInteractivo;
+      }
+      const int maximo = static_cast<int>(sizeof(fracciones) / sizeof(fracciones[0]));
+      self->m_NivelInteractivo = std::max(0, std::min(maximo, self->m_NivelInteractivo));
+      nivel = self->m_NivelInteractivo;
+    }
+    self->m_UltimoInteractivo = interactivo;
+
+    for (auto& e : self->m_Entradas)
+    {
+      // Si un nivel aún no está listo, el más grueso disponible
+      const int disponible = std::min(nivel, static_cast<int>(e.mappers.size()) - 1);
+      if (e.actor->GetMapper() != e.mappers[disponible])
+        e.actor->SetMapper(e.mappers[disponible]);
+    }
+  }
+
+  std::vector<Entrada>       m_Entradas;
+  std::vector<Terminado>     m_Terminados;
+  std::mutex                 m_Mutex;
+  std::thread                m_Hilo;
+  vtkRenderer*               m_Renderer = nullptr;
+  vtkRenderWindowInteractor* m_Interactor = nullptr;
+  vtkNew<vtkCallbackCommand> m_AlRenderizar;
+  vtkNew<vtkCallbackCommand> m_AlTemporizador;
+  int                        m_Temporizador = -1;
+  int                        m_NivelInteractivo = 1;
+  bool                       m_UltimoInteractivo = false;
+};
+
+} // namespace nivelesDetalle
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef nombreTemporal_h
+#define nombreTemporal_h
+
+// Sufijo para ficheros temporales que se escriben y luego se renombran sobre
+// una entrada de caché. Lleva el pid y un contador, así que no coincide entre
+// procesos ni entre hilos del mismo proceso que llenen la misma entrada.
+
+#include <atomic>
+#include <string>
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace nombreTemporal
+{
+
+// ".<pid>.<n>", distinto en cada llamada
+inline std::string Sufijo()
+{
+  static std::atomic<unsigned long> contador{ 0 };
+#if defined(_WIN32)
+  const long pid = static_cast<long>(_getpid());
+#else
+  const long pid = static_cast<long>(getpid());
+#endif
+  return "." + std::to_string(pid) + "." + std::to_string(contador++);
+}
+
+} // namespace nombreTemporal
+
+#endif
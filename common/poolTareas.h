@@ -0,0 +1,67 @@
+#ifndef poolTareas_h
+#define poolTareas_h
+
+// Reparto de tareas independientes entre hilos. Cada hilo toma la siguiente
+// tarea libre, así las más largas no dejan hilos parados mientras quedan
+// otras por hacer.
+
+#include "itkMacro.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace poolTareas
+{
+
+// Ejecuta 'tareas' en 'numHilos' hilos (el que llama es uno de ellos). Las
+// excepciones se informan con el prefijo 'contexto' y se sigue con la
+// siguiente tarea. Devuelve false si alguna tarea lanzó una excepción.
+inline bool ejecutar(const std::vector<std::function<void()>>& tareas, unsigned int numHilos,
+                     const std::string& contexto = "Error")
+{
+  std::atomic<size_t> siguiente{ 0 };
+  std::atomic<bool>   correcto{ true };
+  std::mutex          mutexSalida;
+
+  auto trabajador = [&]() {
+    for (size_t i = siguiente++; i < tareas.size(); i = siguiente++)
+    {
+      try
+      {
+        tareas[i]();
+      }
+      catch (itk::ExceptionObject& err)
+      {
+        std::lock_guard<std::mutex> lock(mutexSalida);
+        std::cerr << contexto << ": " << err << std::endl;
+        correcto = false;
+      }
+      catch (const std::exception& err)
+      {
+        std::lock_guard<std::mutex> lock(mutexSalida);
+        std::cerr << contexto << ": " << err.what() << std::endl;
+        correcto = false;
+      }
+    }
+  };
+
+  numHilos = std::max(1u, std::min<unsigned int>(numHilos, static_cast<unsigned int>(tareas.size())));
+  std::vector<std::thread> hilos;
+  for (unsigned int h = 1; h < numHilos; ++h)
+    hilos.emplace_back(trabajador);
+  trabajador();
+  for (auto& hilo : hilos)
+    hilo.join();
+  return correcto;
+}
+
+} // namespace poolTareas
+
+#endif
@@ -0,0 +1,211 @@
+#ifndef procesadoLotes_h
+#define procesadoLotes_h
+
+// Procesado por lotes: lectura -> filtrado -> escritura en tres hilos unidos por
+// colas acotadas, de modo que mientras se filtra una imagen ya se está
+// decodificando la siguiente y codificando la anterior. Cada etapa conserva sus
+// objetos ITK (lector, filtros, escritores) durante todo el lote.
+
+#include "itkMacro.h"
+#include "itksys/Directory.hxx"
+#include "itksys/SystemTools.hxx"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace procesadoLotes
+{
+
+// Cola FIFO con capacidad máxima. Push bloquea si está llena; Pop bloquea si
+// está vacía y devuelve false cuando se ha cerrado y ya no quedan elementos.
+template <typename T>
+class ColaAcotada
+{
+public:
+  explicit ColaAcotada(size_t capacidad) : m_Capacidad(std::max<size_t>(1, capacidad)) {}
+
+  void Push(T elemento)
+  {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_NoLlena.wait(lock, [this] { return m_Cola.size() < m_Capacidad; });
+    m_Cola.push(std::move(elemento));
+    m_NoVacia.notify_one();
+  }
+
+  bool Pop(T& elemento)
+  {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_NoVacia.wait(lock, [this] { return !m_Cola.empty() || m_Cerrada; });
+    if (m_Cola.empty())
+      return false;
+    elemento = std::move(m_Cola.front());
+    m_Cola.pop();
+    m_NoLlena.notify_one();
+    return true;
+  }
+
+  void Cerrar()
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Cerrada = true;
+    m_NoVacia.notify_all();
+  }
+
+private:
+  std::queue<T>           m_Cola;
+  size_t                  m_Capacidad;
+  bool                    m_Cerrada = false;
+  std::mutex              m_Mutex;
+  std::condition_variable m_NoLlena;
+  std::condition_variable m_NoVacia;
+};
+
+// Entradas del lote: todos los ficheros de un directorio (ordenados por nombre)
+// o, si 'ruta' es un fichero, una ruta por línea.
+inline std::vector<std::string> listarEntradas(const std::string& ruta)
+{
+  std::vector<std::string> entradas;
+  if (itksys::SystemTools::FileIsDirectory(ruta))
+  {
+    itksys::Directory dir;
+    if (dir.Load(ruta))
+    {
+      for (unsigned long i = 0; i < dir.GetNumberOfFiles(); ++i)
+      {
+        const std::string completo = ruta + "/" + dir.GetFile(i);
+        if (!itksys::SystemTools::FileIsDirectory(completo))
+          entradas.push_back(completo);
+      }
+    }
+    std::sort(entradas.begin(), entradas.end());
+  }
+  else
+  {
+    std::ifstream listado(ruta);
+    std::string linea;
+    while (std::getline(listado, linea))
+    {
+      if (!linea.empty() && linea.back() == '\r')
+        linea.pop_back();
+      if (!linea.empty())
+        entradas.push_back(linea);
+    }
+  }
+  return entradas;
+}
+
+// Nombre base de una ruta (sin directorio ni extensión) y su extensión.
+inline std::string nombreBase(const std::string& ruta)
+{
+  return itksys::SystemTools::GetFilenameWithoutLastExtension(ruta);
+}
+
+inline std::string extension(const std::string& ruta, const std::string& porDefecto)
+{
+  const std::string ext = itksys::SystemTools::GetFilenameLastExtension(ruta);
+  return ext.empty() ? porDefecto : ext;
+}
+
+// Ejecuta el lote. 'leer' corre en el hilo lector, 'filtrar' en el hilo de
+// filtrado (devuelve las salidas de cada filtro con su sufijo) y 'escribir' en
+// el hilo que llama. Las excepciones (de ITK o de la biblioteca estándar, p.ej.
+// std::bad_alloc) se informan, la imagen cuenta como fallida y se pasa a la
+// siguiente. Devuelve el número de imágenes con error.
+template <typename TEntrada, typename TSalida>
+unsigned int ejecutar(
+  const std::vector<std::string>& entradas,
+  const std::function<typename TEntrada::Pointer(const std::string&)>& leer,
+  const std::function<std::vector<std::pair<std::string, typename TSalida::Pointer>>(TEntrada*)>& filtrar,
+  const std::function<void(const std::string& entrada, const std::string& sufijo, TSalida*)>& escribir,
+  size_t capacidad = 4)
+{
+  using Leida    = std::pair<std::string, typename TEntrada::Pointer>;
+  using Filtrada = std::pair<std::string, std::vector<std::pair<std::string, typename TSalida::Pointer>>>;
+
+  ColaAcotada<Leida>    leidas(capacidad);
+  ColaAcotada<Filtrada> filtradas(capacidad);
+  std::mutex            mutexSalida;
+  unsigned int          errores = 0;
+
+  auto informar = [&](const std::string& etapa, const std::string& ruta, const std::exception& err) {
+    std::lock_guard<std::mutex> lock(mutexSalida);
+    std::cerr << "Error " << etapa << " (" << ruta << "): ";
+    if (auto* errITK = dynamic_cast<const itk::ExceptionObject*>(&err))
+      std::cerr << *errITK << std::endl;
+    else
+      std::cerr << err.what() << std::endl;
+    ++errores;
+  };
+
+  const auto t0 = std::chrono::steady_clock::now();
+
+  std::thread lector([&]() {
+    for (const auto& ruta : entradas)
+    {
+      try
+      {
+        leidas.Push(Leida(ruta, leer(ruta)));
+      }
+      catch (const std::exception& err)
+      {
+        informar("leyendo", ruta, err);
+      }
+    }
+    leidas.Cerrar();
+  });
+
+  std::thread filtro([&]() {
+    Leida elemento;
+    while (leidas.Pop(elemento))
+    {
+      try
+      {
+        filtradas.Push(Filtrada(elemento.first, filtrar(elemento.second)));
+      }
+      catch (const std::exception& err)
+      {
+        informar("filtrando", elemento.first, err);
+      }
+    }
+    filtradas.Cerrar();
+  });
+
+  size_t escritas = 0;
+  Filtrada elemento;
+  while (filtradas.Pop(elemento))
+  {
+    try
+    {
+      for (const auto& salida : elemento.second)
+        escribir(elemento.first, salida.first, salida.second);
+      ++escritas;
+    }
+    catch (const std::exception& err)
+    {
+      informar("escribiendo", elemento.first, err);
+    }
+  }
+
+  lector.join();
+  filtro.join();
+
+  const std::chrono::duration<double> segundos = std::chrono::steady_clock::now() - t0;
+  std::cout << "Lote: " << escritas << "/" << entradas.size() << " imágenes en " << segundos.count()
+            << " s (" << (segundos.count() > 0 ? escritas / segundos.count() : 0.0) << " img/s)" << std::endl;
+  return errores;
+}
+
+} // namespace procesadoLotes
+
+#endif
@@ -0,0 +1,249 @@
+#ifndef renderLotes_h
+#define renderLotes_h
+
+// Render por lotes sin ventana para los MedicalDemo (miniaturas de estudios).
+//
+//   MedicalDemoN --batch <vistas> <dirSalida> [--threads N] [--size WxH] vol1.mhd [vol2.mhd ...]
+//
+// <vistas> es un número N (órbita de N vistas repartidas en acimut) o un
+// fichero con una vista por línea: "acimut elevación [zoom]" en grados
+// respecto a la cámara inicial de la demo. Cada hilo de trabajo tiene su
+// propia ventana fuera de pantalla (un contexto OpenGL por hilo) y va tomando
+// volúmenes de la lista: monta la escena de la demo con su propio lector y
+// escribe <dirSalida>/<i>_<volumen>_<k>.png para cada vista (<i> es la
+// posición del volumen en la lista, para que dos volúmenes con el mismo
+// nombre en directorios distintos no se pisen).
+//
+// Varios contextos a la vez desde hilos distintos sólo son seguros con
+// OSMesa o EGL (VTK_OPENGL_HAS_OSMESA / VTK_OPENGL_HAS_EGL, o
+// VTK_DEFAULT_RENDER_WINDOW_OFFSCREEN); con otro backend (X/GLX, ...) se usa
+// un solo hilo. Para trabajar sin display, VTK debe estar compilado así; con
+// Mesa, LIBGL_ALWAYS_SOFTWARE=1 fuerza el render por software.
+
+#include <vtkCamera.h>
+#include <vtkNew.h>
+#include <vtkErrorCode.h>
+#include <vtkPNGWriter.h>
+#include <vtkRenderWindow.h>
+#include <vtkRenderer.h>
+#include <vtkRenderingOpenGLConfigure.h>
+#include <vtkWindowToImageFilter.h>
+#include <vtksys/SystemTools.hxx>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace renderLotes
+{
+
+// true si VTK puede crear contextos de render fuera de pantalla en varios
+// hilos a la vez
+#if defined(VTK_OPENGL_HAS_OSMESA) || defined(VTK_OPENGL_HAS_EGL) || defined(VTK_DEFAULT_RENDER_WINDOW_OFFSCREEN)
+const bool variosContextos = true;
+#else
+const bool variosContextos = false;
+#endif
+
+struct Vista
+{
+  double acimut = 0.0;
+  double elevacion = 0.0;
+  double zoom = 1.0;
+};
+
+struct Opciones
+{
+  std::vector<Vista>       vistas;
+  std::string              dirSalida;
+  std::vector<std::string> volumenes;
+  unsigned int             numHilos = 0; // 0: uno por núcleo (como mucho uno por volumen)
+  int                      ancho = 640;
+  int                      alto = 480;
+};
+
+// Monta la escena de la demo para 'fichero' en 'renderer' (cámara incluida) y
+// devuelve lo que haya que mantener vivo mientras se renderiza.
+using Escena = std::function<std::shared_ptr<void>(const std::string& fichero, vtkRenderer* renderer)>;
+
+// true si la línea de órdenes pide el modo por lotes
+inline bool Pedido(int argc, char* argv[])
+{
+  return argc > 1 && std::string(argv[1]) == "--batch";
+}
+
+inline void Uso(const char* programa)
+{
+  std::cout << "       " << programa
+            << " --batch <N|views.txt> <outputDir> [--threads N] [--size WxH] file.mhd [file.mhd ...]" << std::endl;
+}
+
+// Vistas: "N" (órbita) o fichero con "acimut elevación [zoom]" por línea
+inline bool LeerVistas(const std::string& texto, std::vector<Vista>& vistas)
+{
+  vistas.clear();
+  char*      fin = nullptr;
+  const long n = std::strtol(texto.c_str(), &fin, 10);
+  if (*fin == '\0' && n > 0)
+  {
+    for (long i = 0; i < n; ++i)
+    {
+      Vista v;
+      v.acimut = 360.0 * i / n;
+      vistas.push_back(v);
+    }
+    return true;
+  }
+  std::ifstream is(texto);
+  std::string   linea;
+  while (std::getline(is, linea))
+  {
+    std::istringstream ls(linea);
+    Vista              v;
+    if (linea.empty() || linea[0] == '#' || !(ls >> v.acimut >> v.elevacion))
+      continue;
+    if (!(ls >> v.zoom) || v.zoom <= 0.0)
+      v.zoom = 1.0;
+    vistas.push_back(v);
+  }
+  return !vistas.empty();
+}
+
+inline bool AnalizarArgumentos(int argc, char* argv[], Opciones& opciones)
+{
+  if (argc < 5 || !LeerVistas(argv[2], opciones.vistas))
+    return false;
+  opciones.dirSalida = argv[3];
+  for (int i = 4; i < argc; ++i)
+  {
+    const std::string arg = argv[i];
+    if (arg == "--threads" && i + 1 < argc)
+      opciones.numHilos = static_cast<unsigned int>(std::max(1, std::atoi(argv[++i])));
+    else if (arg == "--size" && i + 1 < argc)
+    {
+      const std::string valor = argv[++i];
+      const size_t      x = valor.find('x');
+      if (x == std::string::npos)
+        return false;
+      opciones.ancho = std::atoi(valor.substr(0, x).c_str());
+      opciones.alto = std::atoi(valor.substr(x + 1).c_str());
+      if (opciones.ancho <= 0 || opciones.alto <= 0)
+        return false;
+    }
+    else
+      opciones.volumenes.push_back(arg);
+  }
+  return !opciones.volumenes.empty();
+}
+
+// Renderiza todas las vistas de todos los volúmenes. Devuelve el número de
+// imágenes escritas.
+inline size_t Ejecutar(const Opciones& opciones, const Escena& escena)
+{
+  using Reloj = std::chrono::steady_clock;
+  auto ms = [](Reloj::time_point desde) {
+    return std::chrono::duration<double, std::milli>(Reloj::now() - desde).count();
+  };
+
+  vtksys::SystemTools::MakeDirectory(opciones.dirSalida);
+  unsigned int numHilos = opciones.numHilos;
+  if (numHilos == 0)
+    numHilos = std::max(1u, std::thread::hardware_concurrency());
+  numHilos = static_cast<unsigned int>(std::min<size_t>(numHilos, opciones.volumenes.size()));
+  if (numHilos > 1 && !variosContextos)
+  {
+    std::cerr << "Aviso: VTK no está compilado con OSMesa ni EGL; se renderiza con un solo hilo" << std::endl;
+    numHilos = 1;
+  }
+
+  std::atomic<size_t> siguiente{ 0 };
+  std::atomic<size_t> imagenes{ 0 };
+  std::mutex          mutexSalida;
+  const auto          t0 = Reloj::now();
+
+  auto trabajador = [&]() {
+    // Un contexto de render por hilo, reutilizado para todos sus volúmenes
+    vtkNew<vtkRenderWindow> ventana;
+    ventana->SetOffScreenRendering(1);
+    ventana->SetSize(opciones.ancho, opciones.alto);
+    vtkNew<vtkWindowToImageFilter> captura;
+    captura->SetInput(ventana);
+    captura->ReadFrontBufferOff();
+    vtkNew<vtkPNGWriter> png;
+    png->SetInputConnection(captura->GetOutputPort());
+
+    for (size_t i = siguiente++; i < opciones.volumenes.size(); i = siguiente++)
+    {
+      const std::string& fichero = opciones.volumenes[i];
+      const auto         t1 = Reloj::now();
+      vtkNew<vtkRenderer> renderer;
+      ventana->AddRenderer(renderer);
+      std::shared_ptr<void> vivo = escena(fichero, renderer);
+      const double          msEscena = ms(t1);
+
+      // Las vistas son relativas a la cámara que deja la escena
+      vtkNew<vtkCamera> base;
+      base->DeepCopy(renderer->GetActiveCamera());
+      const std::string nombre =
+        std::to_string(i) + "_" + vtksys::SystemTools::GetFilenameWithoutLastExtension(fichero);
+      const auto        t2 = Reloj::now();
+      for (size_t k = 0; k < opciones.vistas.size(); ++k)
+      {
+        const Vista& v = opciones.vistas[k];
+        vtkCamera*   camara = renderer->GetActiveCamera();
+        camara->DeepCopy(base);
+        camara->Azimuth(v.acimut);
+        camara->Elevation(v.elevacion);
+        camara->OrthogonalizeViewUp();
+        camara->Zoom(v.zoom);
+        renderer->ResetCameraClippingRange();
+        ventana->Render();
+
+        captura->Modified();
+        const std::string imagen = opciones.dirSalida + "/" + nombre + "_" + std::to_string(k) + ".png";
+        png->SetFileName(imagen.c_str());
+        png->Write();
+        if (png->GetErrorCode() != vtkErrorCode::NoError)
+        {
+          std::lock_guard<std::mutex> lock(mutexSalida);
+          std::cerr << "No se pudo escribir " << imagen << std::endl;
+          continue;
+        }
+        ++imagenes;
+      }
+      const double msVistas = ms(t2);
+      ventana->RemoveRenderer(renderer);
+
+      std::lock_guard<std::mutex> lock(mutexSalida);
+      std::cout << fichero << ": escena " << msEscena << " ms, " << opciones.vistas.size() << " imágenes en "
+                << msVistas << " ms (" << 1000.0 * opciones.vistas.size() / std::max(msVistas, 1e-3)
+                << " img/s)" << std::endl;
+    }
+  };
+
+  std::vector<std::thread> hilos;
+  for (unsigned int h = 0; h < numHilos; ++h)
+    hilos.emplace_back(trabajador);
+  for (auto& hilo : hilos)
+    hilo.join();
+
+  const double total = ms(t0);
+  std::cout << imagenes << " imágenes de " << opciones.volumenes.size() << " volúmenes con " << numHilos
+            << " hilos en " << total << " ms: " << 1000.0 * imagenes / std::max(total, 1e-3) << " img/s"
+            << std::endl;
+  return imagenes;
+}
+
+} // namespace renderLotes
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef salidaUchar_h
+#define salidaUchar_h
+
+// Etapa de salida "a uchar para visualizar": sustituye a
+// RescaleIntensityImageFilter -> [CastImageFilter] -> ImageFileWriter.
+//
+// Calcula mínimo y máximo en una pasada vectorizada (o usa los que se le den)
+// y escribe los bytes reescalados directamente en el buffer de la imagen que
+// recibe el escritor, sin imágenes intermedias. Usa la misma fórmula que
+// RescaleIntensityImageFilter (incluido el caso de imagen constante) y trunca
+// igual que ITK. Con TIntermedio = float reproduce también el redondeo de
+// Rescale a float seguido de Cast a uchar.
+
+#include "itkImage.h"
+#include "itkImageFileWriter.h"
+#include "itkImageIOBase.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#if (defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER)) && \
+  (defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__))
+#define SALIDA_UCHAR_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace salidaUchar
+{
+
+namespace detalle
+{
+
+template <typename T>
+inline void minMaxEscalar(const T* p, size_t n, double& minimo, double& maximo)
+{
+  T mn = p[0];
+  T mx = p[0];
+  for (size_t i = 1; i < n; ++i)
+  {
+    mn = p[i] < mn ? p[i] : mn;
+    mx = p[i] > mx ? p[i] : mx;
+  }
+  minimo = static_cast<double>(mn);
+  maximo = static_cast<double>(mx);
+}
+
+template <typename T>
+inline void minMax(const T* p, size_t n, double& minimo, double& maximo)
+{
+  minMaxEscalar(p, n, minimo, maximo);
+}
+
+#ifdef SALIDA_UCHAR_SSE2
+
+inline void minMax(const float* p, size_t n, double& minimo, double& maximo)
+{
+  if (n < 8)
+    return minMaxEscalar(p, n, minimo, maximo);
+  __m128 mn = _mm_loadu_ps(p);
+  __m128 mx = mn;
+  size_t i = 4;
+  for (; i + 4 <= n; i += 4)
+  {
+    const __m128 v = _mm_loadu_ps(p + i);
+    mn = _mm_min_ps(mn, v);
+    mx = _mm_max_ps(mx, v);
+  }
+  alignas(16) float a[4], b[4];
+  _mm_store_ps(a, mn);
+  _mm_store_ps(b, mx);
+  float fmn = std::min(std::min(a[0], a[1]), std::min(a[2], a[3]));
+  float fmx = std::max(std::max(b[0], b[1]), std::max(b[2], b[3]));
+  for (; i < n; ++i)
+  {
+    fmn = std::min(fmn, p[i]);
+    fmx = std::max(fmx, p[i]);
+  }
+  minimo = fmn;
+  maximo = fmx;
+}
+
+inline void minMax(const unsigned char* p, size_t n, double& minimo, double& maximo)
+{
+  if (n < 32)
+    return minMaxEscalar(p, n, minimo, maximo);
+  __m128i mn = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  __m128i mx = mn;
+  size_t i = 16;
+  for (; i + 16 <= n; i += 16)
+  {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    mn = _mm_min_epu8(mn, v);
+    mx = _mm_max_epu8(mx, v);
+  }
+  alignas(16) unsigned char a[16], b[16];
+  _mm_store_si128(reinterpret_cast<__m128i*>(a), mn);
+  _mm_store_si128(reinterpret_cast<__m128i*>(b), mx);
+  unsigned char cmn = *std::min_element(a, a + 16);
+  unsigned char cmx = *std::max_element(b, b + 16);
+  for (; i < n; ++i)
+  {
+    cmn = std::min(cmn, p[i]);
+    cmx = std::max(cmx, p[i]);
+  }
+  minimo = cmn;
+  maximo = cmx;
+}
+
+inline void minMax(const short* p, size_t n, double& minimo, double& maximo)
+{
+  if (n < 16)
+    return minMaxEscalar(p, n, minimo, maximo);
+  __m128i mn = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  __m128i mx = mn;
+  size_t i = 8;
+  for (; i + 8 <= n; i += 8)
+  {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    mn = _mm_min_epi16(mn, v);
+    mx = _mm_max_epi16(mx, v);
+  }
+  alignas(16) short a[8], b[8];
+  _mm_store_si128(reinterpret_cast<__m128i*>(a), mn);
+  _mm_store_si128(reinterpret_cast<__m128i*>(b), mx);
+  short smn = *std::min_element(a, a + 8);
+  short smx = *std::max_element(b, b + 8);
+  for (; i < n; ++i)
+  {
+    smn = std::min(smn, p[i]);
+    smx = std::max(smx, p[i]);
+  }
+  minimo = smn;
+  maximo = smx;
+}
+
+#endif
+
+} // namespace detalle
+
+// Mínimo y máximo de la región almacenada de la imagen.
+template <typename TImage>
+void MinMax(const TImage* imagen, double& minimo, double& maximo)
+{
+  const size_t n = imagen->GetBufferedRegion().GetNumberOfPixels();
+  minimo = maximo = 0.0;
+  if (n > 0)
+    detalle::minMax(imagen->GetBufferPointer(), n, minimo, maximo);
+}
+
+// Reescala [minimo, maximo] -> [0, 255] y devuelve la imagen uchar.
+template <typename TIntermedio = double, typename TImage>
+typename itk::Image<unsigned char, TImage::ImageDimension>::Pointer
+Convertir(const TImage* entrada, double minimo, double maximo)
+{
+  using SalidaType = itk::Image<unsigned char, TImage::ImageDimension>;
+
+  // Mismos factores que RescaleIntensityImageFilter con salida [0, 255]
+  double escala = 0.0;
+  if (minimo != maximo)
+    escala = 255.0 / (maximo - minimo);
+  else if (maximo != 0.0)
+    escala = 255.0 / maximo;
+  const double desplazamiento = 0.0 - minimo * escala;
+
+  auto salida = SalidaType::New();
+  salida->CopyInformation(entrada);
+  salida->SetRegions(entrada->GetBufferedRegion());
+  salida->Allocate();
+
+  const auto*    pin = entrada->GetBufferPointer();
+  unsigned char* pout = salida->GetBufferPointer();
+  const size_t   n = entrada->GetBufferedRegion().GetNumberOfPixels();
+  for (size_t i = 0; i < n; ++i)
+  {
+    double v = static_cast<double>(pin[i]) * escala + desplazamiento;
+    v = v < 0.0 ? 0.0 : (v > 255.0 ? 255.0 : v);
+    pout[i] = static_cast<unsigned char>(static_cast<TIntermedio>(v));
+  }
+  return salida;
+}
+
+template <typename TIntermedio = double, typename TImage>
+typename itk::Image<unsigned char, TImage::ImageDimension>::Pointer
+Convertir(const TImage* entrada)
+{
+  double minimo, maximo;
+  MinMax(entrada, minimo, maximo);
+  return Convertir<TIntermedio>(entrada, minimo, maximo);
+}
+
+// Convierte y escribe en 'fichero'. 'io' permite fijar el ImageIO (p.ej. un
+// PNGImageIO propio cuando se escribe desde varios hilos).
+template <typename TIntermedio = double, typename TImage>
+void Escribir(const TImage* entrada, const std::string& fichero, itk::ImageIOBase* io = nullptr)
+{
+  using SalidaType = itk::Image<unsigned char, TImage::ImageDimension>;
+  auto escritor = itk::ImageFileWriter<SalidaType>::New();
+  if (io)
+    escritor->SetImageIO(io);
+  escritor->SetInput(Convertir<TIntermedio>(entrada));
+  escritor->SetFileName(fichero);
+  escritor->Update();
+}
+
+} // namespace salidaUchar
+
+#endif
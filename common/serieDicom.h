@@ -0,0 +1,295 @@
+#ifndef serieDicom_h
+#define serieDicom_h
+
+// Carga de series DICOM en dos fases:
+//
+//  1. Exploración: sólo se leen las etiquetas necesarias (gdcm::Scanner deja de
+//     leer en cuanto las tiene, sin llegar a los píxeles), repartiendo los
+//     ficheros entre hilos. Los cortes se agrupan por Series Instance UID y se
+//     ordenan por su posición a lo largo de la normal (Image Position/
+//     Orientation Patient; si faltan, por Instance Number).
+//  2. Decodificación: el primer corte fija tamaño y geometría; el resto se
+//     decodifica en paralelo, cada uno en su plano Z de un volumen reservado de
+//     antemano.
+
+#include "itkGDCMImageIO.h"
+#include "itkImage.h"
+#include "itkImageFileReader.h"
+#include "gdcmScanner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace serieDicom
+{
+
+struct Corte
+{
+  std::string fichero;
+  double      posicion = 0.0; // coordenada a lo largo de la normal
+  double      ipp[3] = { 0.0, 0.0, 0.0 };
+  bool        tieneIPP = false;
+};
+
+struct Serie
+{
+  std::string        uid;
+  std::vector<Corte> cortes; // ordenados por 'posicion'
+  double             iop[6] = { 1.0, 0.0, 0.0, 0.0, 1.0, 0.0 };
+};
+
+namespace detalle
+{
+
+inline std::vector<double> numeros(const char* valor)
+{
+  std::vector<double> v;
+  if (!valor)
+    return v;
+  std::string texto(valor);
+  std::replace(texto.begin(), texto.end(), '\\', ' ');
+  std::istringstream is(texto);
+  double x;
+  while (is >> x)
+    v.push_back(x);
+  return v;
+}
+
+inline std::string recortar(const char* valor)
+{
+  std::string s = valor ? valor : "";
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\0'))
+    s.pop_back();
+  return s;
+}
+
+} // namespace detalle
+
+// Fase 1: exploración de etiquetas. Devuelve las series encontradas, de más a
+// menos cortes. 'ms' recibe la duración de la fase.
+inline std::vector<Serie> Explorar(const std::vector<std::string>& ficheros, unsigned int numHilos, double* ms = nullptr)
+{
+  const auto t0 = std::chrono::steady_clock::now();
+  const gdcm::Tag etiquetaSerie(0x0020, 0x000e);
+  const gdcm::Tag etiquetaInstancia(0x0020, 0x0013);
+  const gdcm::Tag etiquetaIPP(0x0020, 0x0032);
+  const gdcm::Tag etiquetaIOP(0x0020, 0x0037);
+
+  struct Leido
+  {
+    bool                valido = false;
+    std::string         uid;
+    std::vector<double> ipp, iop;
+    double              instancia = 0.0;
+  };
+  std::vector<Leido> leidos(ficheros.size());
+
+  // Cada hilo explora un bloque contiguo de ficheros con su propio Scanner
+  numHilos = std::max(1u, std::min<unsigned int>(numHilos, static_cast<unsigned int>(ficheros.size())));
+  auto explorarBloque = [&](size_t inicio, size_t fin) {
+    gdcm::Scanner scanner;
+    scanner.AddTag(etiquetaSerie);
+    scanner.AddTag(etiquetaInstancia);
+    scanner.AddTag(etiquetaIPP);
+    scanner.AddTag(etiquetaIOP);
+    const std::vector<std::string> bloque(ficheros.begin() + inicio, ficheros.begin() + fin);
+    if (!scanner.Scan(bloque))
+      return;
+    for (size_t i = inicio; i < fin; ++i)
+    {
+      const char* f = ficheros[i].c_str();
+      if (!scanner.IsKey(f))
+        continue; // no es DICOM
+      Leido& l = leidos[i];
+      l.valido = true;
+      l.uid = detalle::recortar(scanner.GetValue(f, etiquetaSerie));
+      l.ipp = detalle::numeros(scanner.GetValue(f, etiquetaIPP));
+      l.iop = detalle::numeros(scanner.GetValue(f, etiquetaIOP));
+      const std::vector<double> instancia = detalle::numeros(scanner.GetValue(f, etiquetaInstancia));
+      l.instancia = instancia.empty() ? static_cast<double>(i) : instancia[0];
+    }
+  };
+  std::vector<std::thread> hilos;
+  for (unsigned int h = 0; h < numHilos; ++h)
+    hilos.emplace_back(explorarBloque, ficheros.size() * h / numHilos, ficheros.size() * (h + 1) / numHilos);
+  for (auto& hilo : hilos)
+    hilo.join();
+
+  // Agrupar por serie y ordenar a lo largo de la normal
+  std::map<std::string, Serie> porUID;
+  for (size_t i = 0; i < ficheros.size(); ++i)
+  {
+    const Leido& l = leidos[i];
+    if (!l.valido)
+      continue;
+    Serie& serie = porUID[l.uid];
+    serie.uid = l.uid;
+    if (serie.cortes.empty() && l.iop.size() == 6)
+      std::copy(l.iop.begin(), l.iop.end(), serie.iop);
+
+    Corte corte;
+    corte.fichero = ficheros[i];
+    corte.tieneIPP = (l.ipp.size() == 3);
+    if (corte.tieneIPP)
+      std::copy(l.ipp.begin(), l.ipp.end(), corte.ipp);
+    corte.posicion = l.instancia;
+    serie.cortes.push_back(corte);
+  }
+
+  std::vector<Serie> series;
+  for (auto& par : porUID)
+  {
+    Serie& serie = par.second;
+    const double* o = serie.iop;
+    const double  normal[3] = { o[1] * o[5] - o[2] * o[4], o[2] * o[3] - o[0] * o[5], o[0] * o[4] - o[1] * o[3] };
+    const bool todosIPP = std::all_of(serie.cortes.begin(), serie.cortes.end(), [](const Corte& c) { return c.tieneIPP; });
+    if (todosIPP)
+      for (Corte& c : serie.cortes)
+        c.posicion = c.ipp[0] * normal[0] + c.ipp[1] * normal[1] + c.ipp[2] * normal[2];
+    std::stable_sort(serie.cortes.begin(), serie.cortes.end(),
+                     [](const Corte& a, const Corte& b) { return a.posicion < b.posicion; });
+    series.push_back(serie);
+  }
+  std::sort(series.begin(), series.end(),
+            [](const Serie& a, const Serie& b) { return a.cortes.size() > b.cortes.size(); });
+
+  if (ms)
+    *ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+  return series;
+}
+
+// Fase 2: decodificación en paralelo en un volumen 3D. 'ms' recibe la duración.
+template <typename TVolumen>
+typename TVolumen::Pointer Cargar(const Serie& serie, unsigned int numHilos, double* ms = nullptr)
+{
+  static_assert(TVolumen::ImageDimension == 3, "serieDicom: el volumen debe ser 3D");
+  using PixelType = typename TVolumen::PixelType;
+  using CorteType = itk::Image<PixelType, 2>;
+
+  const auto t0 = std::chrono::steady_clock::now();
+  if (serie.cortes.empty())
+    itkGenericExceptionMacro(<< "Serie DICOM vacía");
+
+  // Primer corte en este hilo: tamaño, spacing en el plano y tipo de píxel
+  auto lector0 = itk::ImageFileReader<CorteType>::New();
+  lector0->SetImageIO(itk::GDCMImageIO::New());
+  lector0->SetFileName(serie.cortes.front().fichero);
+  lector0->Update();
+  const CorteType* corte0 = lector0->GetOutput();
+  const auto       tam2D = corte0->GetLargestPossibleRegion().GetSize();
+  const size_t     pixelesCorte = static_cast<size_t>(tam2D[0]) * tam2D[1];
+  const size_t     n = serie.cortes.size();
+
+  typename TVolumen::SizeType tam;
+  tam[0] = tam2D[0];
+  tam[1] = tam2D[1];
+  tam[2] = n;
+  typename TVolumen::RegionType region;
+  region.SetSize(tam);
+
+  // Geometría: filas/columnas de IOP y normal; separación entre cortes de IPP
+  const Corte&    primero = serie.cortes.front();
+  const Corte&    ultimo = serie.cortes.back();
+  const double*   o = serie.iop;
+  const double    normal[3] = { o[1] * o[5] - o[2] * o[4], o[2] * o[3] - o[0] * o[5], o[0] * o[4] - o[1] * o[3] };
+  typename TVolumen::DirectionType direccion;
+  typename TVolumen::SpacingType   spacing;
+  typename TVolumen::PointType     origen;
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    direccion[i][0] = o[i];
+    direccion[i][1] = o[3 + i];
+    direccion[i][2] = normal[i];
+    origen[i] = primero.tieneIPP ? primero.ipp[i] : 0.0;
+  }
+  spacing[0] = corte0->GetSpacing()[0];
+  spacing[1] = corte0->GetSpacing()[1];
+  spacing[2] = 1.0;
+  if (n > 1 && primero.tieneIPP && ultimo.tieneIPP)
+  {
+    double distancia = 0.0;
+    for (unsigned int i = 0; i < 3; ++i)
+      distancia += (ultimo.ipp[i] - primero.ipp[i]) * normal[i];
+    if (distancia != 0.0)
+      spacing[2] = std::abs(distancia) / static_cast<double>(n - 1);
+  }
+
+  auto volumen = TVolumen::New();
+  volumen->SetRegions(region);
+  volumen->SetSpacing(spacing);
+  volumen->SetOrigin(origen);
+  volumen->SetDirection(direccion);
+  volumen->Allocate();
+  PixelType* buffer = volumen->GetBufferPointer();
+  std::memcpy(buffer, corte0->GetBufferPointer(), pixelesCorte * sizeof(PixelType));
+
+  // Resto de cortes: cada hilo con su GDCMImageIO. Si el fichero trae un solo
+  // corte con el tipo de píxel del volumen se decodifica directamente en su
+  // plano Z; si no, con un lector que lo convierte y una copia.
+  std::atomic<size_t> siguiente{ 1 };
+  std::atomic<bool>   correcto{ true };
+  std::mutex          mutexSalida;
+  auto trabajador = [&]() {
+    auto io = itk::GDCMImageIO::New();
+    auto lector = itk::ImageFileReader<CorteType>::New();
+    lector->SetImageIO(io);
+    for (size_t z = siguiente++; z < n; z = siguiente++)
+    {
+      try
+      {
+        const std::string& fichero = serie.cortes[z].fichero;
+        io->SetFileName(fichero);
+        io->ReadImageInformation();
+        if (io->GetDimensions(0) != tam2D[0] || io->GetDimensions(1) != tam2D[1])
+          itkGenericExceptionMacro(<< "Tamaño distinto al del primer corte");
+        const bool unCorte = io->GetNumberOfDimensions() == 2 || io->GetDimensions(2) == 1;
+        if (unCorte && io->GetNumberOfComponents() == 1 &&
+            io->GetComponentType() == itk::ImageIOBase::MapPixelType<PixelType>::CType)
+        {
+          io->Read(buffer + z * pixelesCorte);
+        }
+        else
+        {
+          lector->SetFileName(fichero);
+          lector->Update();
+          std::memcpy(buffer + z * pixelesCorte, lector->GetOutput()->GetBufferPointer(),
+                      pixelesCorte * sizeof(PixelType));
+        }
+      }
+      catch (itk::ExceptionObject& err)
+      {
+        std::lock_guard<std::mutex> lock(mutexSalida);
+        std::cerr << "Error decodificando " << serie.cortes[z].fichero << ": " << err << std::endl;
+        correcto = false;
+      }
+    }
+  };
+
+  numHilos = std::max(1u, std::min<unsigned int>(numHilos, static_cast<unsigned int>(n)));
+  std::vector<std::thread> hilos;
+  for (unsigned int h = 1; h < numHilos; ++h)
+    hilos.emplace_back(trabajador);
+  trabajador();
+  for (auto& hilo : hilos)
+    hilo.join();
+
+  if (!correcto)
+    itkGenericExceptionMacro(<< "No se pudieron decodificar todos los cortes de la serie");
+  if (ms)
+    *ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+  return volumen;
+}
+
+} // namespace serieDicom
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef ventanaDicom_h
+#define ventanaDicom_h
+
+// Exportación a 8 bits con ventana (window/level) DICOM en lugar de reescalar
+// el rango [mínimo, máximo] de la imagen.
+//
+// La ventana sale de las etiquetas Window Center/Width (0028,1050/1051) o de
+// un preset (cerebro, pulmón, hueso, ...). Para píxeles de 16 bits se
+// precalcula una tabla de 65536 entradas con la función lineal de DICOM
+// (PS3.3 C.11.2.1.2) y la conversión es una sola pasada de consultas a la
+// tabla, sin buscar mínimo/máximo ni imágenes intermedias en float.
+
+#include "itkImage.h"
+#include "itkMetaDataObject.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace ventanaDicom
+{
+
+struct Ventana
+{
+  double centro = 0.0;
+  double anchura = 1.0;
+};
+
+// Presets habituales en TC (unidades Hounsfield)
+inline bool Preset(const std::string& nombre, Ventana& ventana)
+{
+  struct Entrada
+  {
+    const char* nombre;
+    const char* alias;
+    double      centro, anchura;
+  };
+  static const Entrada presets[] = {
+    { "cerebro", "brain", 40.0, 80.0 },      { "blando", "soft", 50.0, 400.0 },
+    { "pulmon", "lung", -600.0, 1500.0 },     { "hueso", "bone", 400.0, 1800.0 },
+    { "higado", "liver", 60.0, 160.0 },       { "mediastino", "mediastinum", 50.0, 350.0 },
+  };
+  for (const auto& p : presets)
+    if (nombre == p.nombre || nombre == p.alias)
+    {
+      ventana.centro = p.centro;
+      ventana.anchura = p.anchura;
+      return true;
+    }
+  return false;
+}
+
+// Un preset o "centro,anchura"
+inline bool DesdeTexto(const std::string& texto, Ventana& ventana)
+{
+  if (Preset(texto, ventana))
+    return true;
+  const size_t coma = texto.find(',');
+  if (coma == std::string::npos)
+    return false;
+  char*        fin = nullptr;
+  const double c = std::strtod(texto.c_str(), &fin);
+  if (fin != texto.c_str() + coma)
+    return false;
+  const double w = std::strtod(texto.c_str() + coma + 1, &fin);
+  if (*fin != '\0' || w < 1.0)
+    return false;
+  ventana.centro = c;
+  ventana.anchura = w;
+  return true;
+}
+
+// Window Center/Width del diccionario que deja GDCMImageIO en la imagen. Si la
+// etiqueta tiene varios valores ("40\400") se usa el primero.
+inline bool DesdeEtiquetas(const itk::MetaDataDictionary& diccionario, Ventana& ventana)
+{
+  std::string centro, anchura;
+  if (!itk::ExposeMetaData<std::string>(diccionario, "0028|1050", centro) ||
+      !itk::ExposeMetaData<std::string>(diccionario, "0028|1051", anchura))
+    return false;
+  std::replace(centro.begin(), centro.end(), '\\', ' ');
+  std::replace(anchura.begin(), anchura.end(), '\\', ' ');
+  double c, w;
+  std::istringstream isc(centro), isw(anchura);
+  if (!(isc >> c) || !(isw >> w) || w < 1.0)
+    return false;
+  ventana.centro = c;
+  ventana.anchura = w;
+  return true;
+}
+
+// Tabla int16/uint16 -> uint8 para una ventana.
+template <typename TPixel>
+class Tabla
+{
+  static_assert(std::is_integral<TPixel>::value && sizeof(TPixel) == 2,
+                "ventanaDicom::Tabla: sólo píxeles enteros de 16 bits");
+
+public:
+  explicit Tabla(const Ventana& ventana)
+    : m_Ventana(ventana)
+    , m_Valores(65536)
+  {
+    const double c = ventana.centro - 0.5;
+    const double w = ventana.anchura - 1.0;
+    const double inferior = c - w / 2.0;
+    const double superior = c + w / 2.0;
+    for (unsigned int i = 0; i < 65536; ++i)
+    {
+      const double x = static_cast<double>(static_cast<TPixel>(static_cast<std::uint16_t>(i)));
+      double       y;
+      if (x <= inferior)
+        y = 0.0;
+      else if (x > superior)
+        y = 255.0;
+      else
+        y = w > 0.0 ? ((x - c) / w + 0.5) * 255.0 : 255.0;
+      m_Valores[i] = static_cast<std::uint8_t>(std::min(255.0, std::max(0.0, y + 0.5)));
+    }
+  }
+
+  const Ventana& GetVentana() const { return m_Ventana; }
+
+  void Aplicar(const TPixel* entrada, unsigned char* salida, size_t n) const
+  {
+    const std::uint8_t* t = m_Valores.data();
+    size_t              i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const std::uint8_t a = t[static_cast<std::uint16_t>(entrada[i])];
+      const std::uint8_t b = t[static_cast<std::uint16_t>(entrada[i + 1])];
+      const std::uint8_t c = t[static_cast<std::uint16_t>(entrada[i + 2])];
+      const std::uint8_t d = t[static_cast<std::uint16_t>(entrada[i + 3])];
+      salida[i] = a;
+      salida[i + 1] = b;
+      salida[i + 2] = c;
+      salida[i + 3] = d;
+    }
+    for (; i < n; ++i)
+      salida[i] = t[static_cast<std::uint16_t>(entrada[i])];
+  }
+
+private:
+  Ventana                   m_Ventana;
+  std::vector<std::uint8_t> m_Valores;
+};
+
+// Aplica la tabla y devuelve la imagen uchar.
+template <typename TImage>
+typename itk::Image<unsigned char, TImage::ImageDimension>::Pointer
+Convertir(const TImage* entrada, const Tabla<typename TImage::PixelType>& tabla)
+{
+  using SalidaType = itk::Image<unsigned char, TImage::ImageDimension>;
+  auto salida = SalidaType::New();
+  salida->CopyInformation(entrada);
+  salida->SetRegions(entrada->GetBufferedRegion());
+  salida->Allocate();
+  tabla.Aplicar(entrada->GetBufferPointer(), salida->GetBufferPointer(),
+                entrada->GetBufferedRegion().GetNumberOfPixels());
+  return salida;
+}
+
+} // namespace ventanaDicom
+
+#endif
@@ -0,0 +1,396 @@
+#ifndef volumenBloques_h
+#define volumenBloques_h
+
+// Formato de volumen por bloques (.blq): el volumen se parte en bloques 3D de
+// 'lado'^3 vóxeles (64 por defecto; los del borde son más pequeños) que se
+// comprimen cada uno por separado con deflate en su nivel más rápido. Tras la
+// cabecera va una tabla con el desplazamiento y tamaño de cada bloque, así que
+// cada bloque se lee y descomprime sin tocar los demás:
+//
+//   Cabecera (160 bytes) | tabla: numBloques x Entrada (16 bytes) | bloques
+//
+// Los bloques se ordenan con x más rápido, luego y, luego z, y dentro de cada
+// bloque los vóxeles también. Un bloque que no se reduce al comprimirlo se
+// guarda sin comprimir.
+//
+// Escribir() comprime los bloques en varios hilos mientras el hilo que llama
+// los va escribiendo en orden. LeerRegion() sólo lee y descomprime (en
+// paralelo) los bloques que cortan la región pedida: un corte axial de un
+// volumen de 512^3 toca 64 de los 512 bloques.
+
+#include "itkImage.h"
+#include "itk_zlib.h"
+#include "itksys/SystemTools.hxx"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace volumenBloques
+{
+
+struct Cabecera
+{
+  char          firma[8];
+  std::uint32_t dims[3];
+  std::uint32_t lado;       // lado de los bloques en vóxeles
+  std::uint32_t bytesPixel;
+  std::uint32_t tipo;       // 'u' entero sin signo, 'i' con signo, 'f' real
+  double        spacing[3];
+  double        origen[3];
+  double        direccion[9]; // por filas
+  std::uint64_t numBloques;
+};
+static_assert(sizeof(Cabecera) == 160, "volumenBloques::Cabecera debe ocupar 160 bytes");
+
+struct Entrada
+{
+  std::uint64_t desplazamiento;
+  std::uint32_t bytes;
+  std::uint32_t comprimido; // 0: el bloque está guardado tal cual
+};
+static_assert(sizeof(Entrada) == 16, "volumenBloques::Entrada debe ocupar 16 bytes");
+
+namespace detalle
+{
+
+const char firma[8] = "TVGBLQ1";
+
+template <typename T>
+std::uint32_t tipo()
+{
+  static_assert(std::is_arithmetic<T>::value, "volumenBloques: sólo píxeles escalares");
+  return std::is_floating_point<T>::value ? 'f' : (std::is_signed<T>::value ? 'i' : 'u');
+}
+
+// Caja de vóxeles [ini, ini + tam)
+struct Caja
+{
+  std::uint64_t ini[3];
+  std::uint64_t tam[3];
+};
+
+inline std::uint64_t bloquesEje(const Cabecera& cab, int eje)
+{
+  return (cab.dims[eje] + cab.lado - 1) / cab.lado;
+}
+
+inline Caja cajaBloque(const Cabecera& cab, std::uint64_t b)
+{
+  const std::uint64_t nx = bloquesEje(cab, 0), ny = bloquesEje(cab, 1);
+  const std::uint64_t indice[3] = { b % nx, (b / nx) % ny, b / (nx * ny) };
+  Caja c;
+  for (int i = 0; i < 3; ++i)
+  {
+    c.ini[i] = indice[i] * cab.lado;
+    c.tam[i] = std::min<std::uint64_t>(cab.lado, cab.dims[i] - c.ini[i]);
+  }
+  return c;
+}
+
+inline bool intersecar(const Caja& a, const Caja& b, Caja& r)
+{
+  for (int i = 0; i < 3; ++i)
+  {
+    const std::uint64_t ini = std::max(a.ini[i], b.ini[i]);
+    const std::uint64_t fin = std::min(a.ini[i] + a.tam[i], b.ini[i] + b.tam[i]);
+    if (fin <= ini)
+      return false;
+    r.ini[i] = ini;
+    r.tam[i] = fin - ini;
+  }
+  return true;
+}
+
+// Copia la parte 'zona' de un buffer que cubre 'origen' a otro que cubre
+// 'destino' (ambos con x más rápido).
+template <typename T>
+void copiarCaja(const T* src, const Caja& origen, T* dst, const Caja& destino, const Caja& zona)
+{
+  for (std::uint64_t z = 0; z < zona.tam[2]; ++z)
+    for (std::uint64_t y = 0; y < zona.tam[1]; ++y)
+    {
+      const std::uint64_t zs = zona.ini[2] + z - origen.ini[2], ys = zona.ini[1] + y - origen.ini[1];
+      const std::uint64_t zd = zona.ini[2] + z - destino.ini[2], yd = zona.ini[1] + y - destino.ini[1];
+      const T* a = src + (zs * origen.tam[1] + ys) * origen.tam[0] + (zona.ini[0] - origen.ini[0]);
+      T*       b = dst + (zd * destino.tam[1] + yd) * destino.tam[0] + (zona.ini[0] - destino.ini[0]);
+      std::memcpy(b, a, zona.tam[0] * sizeof(T));
+    }
+}
+
+inline unsigned int hilos(unsigned int numHilos, std::uint64_t trabajos)
+{
+  if (numHilos == 0)
+    numHilos = std::max(1u, std::thread::hardware_concurrency());
+  return static_cast<unsigned int>(std::max<std::uint64_t>(1, std::min<std::uint64_t>(numHilos, trabajos)));
+}
+
+} // namespace detalle
+
+// Cabecera y tabla de bloques de 'fichero'. Lanza una excepción si no es un .blq válido.
+inline void LeerInformacion(const std::string& fichero, Cabecera& cab, std::vector<Entrada>& tabla)
+{
+  std::ifstream is(fichero, std::ios::binary);
+  if (!is.read(reinterpret_cast<char*>(&cab), sizeof(cab)) ||
+      std::memcmp(cab.firma, detalle::firma, sizeof(cab.firma)) != 0 || cab.lado == 0)
+    itkGenericExceptionMacro(<< fichero << " no es un volumen por bloques");
+  const std::uint64_t esperados = detalle::bloquesEje(cab, 0) * detalle::bloquesEje(cab, 1) * detalle::bloquesEje(cab, 2);
+  if (cab.numBloques != esperados)
+    itkGenericExceptionMacro(<< fichero << ": tabla de bloques inconsistente");
+  tabla.resize(static_cast<size_t>(cab.numBloques));
+  if (!is.read(reinterpret_cast<char*>(tabla.data()), static_cast<std::streamsize>(tabla.size() * sizeof(Entrada))))
+    itkGenericExceptionMacro(<< fichero << ": tabla de bloques truncada");
+}
+
+// Escribe la región almacenada de 'imagen' en 'fichero' (vía un temporal y
+// rename). 'nivel' es el de zlib (1: el más rápido); 0 hilos = uno por núcleo.
+template <typename TImage>
+void Escribir(const TImage* imagen, const std::string& fichero, unsigned int lado = 64, int nivel = 1,
+              unsigned int numHilos = 0)
+{
+  static_assert(TImage::ImageDimension == 3, "volumenBloques: sólo volúmenes 3D");
+  using PixelType = typename TImage::PixelType;
+
+  const auto region = imagen->GetBufferedRegion();
+  Cabecera   cab{};
+  std::memcpy(cab.firma, detalle::firma, sizeof(cab.firma));
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    cab.dims[i] = static_cast<std::uint32_t>(region.GetSize()[i]);
+    cab.spacing[i] = imagen->GetSpacing()[i];
+    for (unsigned int j = 0; j < 3; ++j)
+      cab.direccion[3 * i + j] = imagen->GetDirection()[i][j];
+  }
+  // El origen del fichero es el punto del primer vóxel almacenado
+  typename TImage::PointType primero;
+  imagen->TransformIndexToPhysicalPoint(region.GetIndex(), primero);
+  for (unsigned int i = 0; i < 3; ++i)
+    cab.origen[i] = primero[i];
+  cab.lado = lado;
+  cab.bytesPixel = sizeof(PixelType);
+  cab.tipo = detalle::tipo<PixelType>();
+  cab.numBloques = detalle::bloquesEje(cab, 0) * detalle::bloquesEje(cab, 1) * detalle::bloquesEje(cab, 2);
+
+  const detalle::Caja total = { { 0, 0, 0 }, { cab.dims[0], cab.dims[1], cab.dims[2] } };
+  const PixelType*    buffer = imagen->GetBufferPointer();
+
+  // Cada hilo comprime el siguiente bloque libre; el hilo que llama escribe
+  // los bloques en orden según van estando listos y libera su memoria.
+  std::vector<std::vector<Bytef>> comprimidos(static_cast<size_t>(cab.numBloques));
+  std::vector<Entrada>            tabla(static_cast<size_t>(cab.numBloques));
+  std::vector<char>               listo(static_cast<size_t>(cab.numBloques), 0);
+  std::mutex                      mutexEstado;
+  std::condition_variable         cambio;
+  std::atomic<std::uint64_t>      siguiente{ 0 };
+  std::atomic<bool>               cancelar{ false };
+
+  auto trabajador = [&]() {
+    std::vector<PixelType> bloque;
+    for (std::uint64_t b = siguiente++; b < cab.numBloques && !cancelar; b = siguiente++)
+    {
+      const detalle::Caja caja = detalle::cajaBloque(cab, b);
+      bloque.resize(static_cast<size_t>(caja.tam[0] * caja.tam[1] * caja.tam[2]));
+      detalle::copiarCaja(buffer, total, bloque.data(), caja, caja);
+
+      const uLong        bytesCrudos = static_cast<uLong>(bloque.size() * sizeof(PixelType));
+      uLongf             bytes = compressBound(bytesCrudos);
+      std::vector<Bytef> salida(bytes);
+      const bool         reducido = compress2(salida.data(), &bytes, reinterpret_cast<const Bytef*>(bloque.data()),
+                                      bytesCrudos, nivel) == Z_OK && bytes < bytesCrudos;
+      if (reducido)
+        salida.resize(bytes);
+      else
+        salida.assign(reinterpret_cast<const Bytef*>(bloque.data()),
+                      reinterpret_cast<const Bytef*>(bloque.data()) + bytesCrudos);
+      {
+        std::lock_guard<std::mutex> lock(mutexEstado);
+        comprimidos[b].swap(salida);
+        tabla[b].comprimido = reducido ? 1 : 0;
+        listo[b] = 1;
+      }
+      cambio.notify_all();
+    }
+  };
+
+  std::vector<std::thread> hilos;
+  const unsigned int       n = detalle::hilos(numHilos, cab.numBloques);
+  for (unsigned int h = 0; h < n; ++h)
+    hilos.emplace_back(trabajador);
+
+  const std::string temporal = fichero + ".tmp";
+  std::ofstream     os(temporal, std::ios::binary);
+  os.write(reinterpret_cast<const char*>(&cab), sizeof(cab));
+  os.write(reinterpret_cast<const char*>(tabla.data()), static_cast<std::streamsize>(tabla.size() * sizeof(Entrada)));
+  std::uint64_t desplazamiento = sizeof(cab) + tabla.size() * sizeof(Entrada);
+  for (size_t b = 0; b < comprimidos.size() && os; ++b)
+  {
+    std::vector<Bytef> datos;
+    {
+      std::unique_lock<std::mutex> lock(mutexEstado);
+      cambio.wait(lock, [&] { return listo[b] != 0; });
+      datos.swap(comprimidos[b]);
+    }
+    os.write(reinterpret_cast<const char*>(datos.data()), static_cast<std::streamsize>(datos.size()));
+    tabla[b].desplazamiento = desplazamiento;
+    tabla[b].bytes = static_cast<std::uint32_t>(datos.size());
+    desplazamiento += datos.size();
+  }
+  cancelar = !os;
+  for (auto& hilo : hilos)
+    hilo.join();
+
+  // Con todos los tamaños conocidos, la tabla definitiva
+  os.seekp(sizeof(cab));
+  os.write(reinterpret_cast<const char*>(tabla.data()), static_cast<std::streamsize>(tabla.size() * sizeof(Entrada)));
+  os.close();
+  if (!os || std::rename(temporal.c_str(), fichero.c_str()) != 0)
+  {
+    std::remove(temporal.c_str());
+    itkGenericExceptionMacro(<< "Error escribiendo " << fichero);
+  }
+}
+
+// Lee sólo los bloques que cortan 'region' (en índices del volumen completo)
+// y devuelve una imagen con esa región. Si 'bloquesLeidos' no es nulo, guarda
+// cuántos bloques se han leído.
+template <typename TImage>
+typename TImage::Pointer LeerRegion(const std::string& fichero, const typename TImage::RegionType& region,
+                                    unsigned int numHilos = 0, size_t* bloquesLeidos = nullptr)
+{
+  static_assert(TImage::ImageDimension == 3, "volumenBloques: sólo volúmenes 3D");
+  using PixelType = typename TImage::PixelType;
+
+  Cabecera             cab;
+  std::vector<Entrada> tabla;
+  LeerInformacion(fichero, cab, tabla);
+  if (cab.bytesPixel != sizeof(PixelType) || cab.tipo != detalle::tipo<PixelType>())
+    itkGenericExceptionMacro(<< fichero << ": el tipo de píxel no coincide");
+
+  detalle::Caja pedida;
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    if (region.GetIndex()[i] < 0 ||
+        static_cast<std::uint64_t>(region.GetIndex()[i]) + region.GetSize()[i] > cab.dims[i])
+      itkGenericExceptionMacro(<< fichero << ": la región pedida se sale del volumen");
+    pedida.ini[i] = static_cast<std::uint64_t>(region.GetIndex()[i]);
+    pedida.tam[i] = region.GetSize()[i];
+  }
+
+  auto imagen = TImage::New();
+  imagen->SetRegions(region);
+  typename TImage::SpacingType   spacing;
+  typename TImage::PointType     origen;
+  typename TImage::DirectionType direccion;
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    spacing[i] = cab.spacing[i];
+    origen[i] = cab.origen[i];
+    for (unsigned int j = 0; j < 3; ++j)
+      direccion[i][j] = cab.direccion[3 * i + j];
+  }
+  imagen->SetSpacing(spacing);
+  imagen->SetOrigin(origen);
+  imagen->SetDirection(direccion);
+  imagen->Allocate();
+  PixelType* buffer = imagen->GetBufferPointer();
+
+  // Bloques que cortan la región
+  std::vector<std::uint64_t> necesarios;
+  for (std::uint64_t b = 0; b < cab.numBloques; ++b)
+  {
+    detalle::Caja zona;
+    if (detalle::intersecar(detalle::cajaBloque(cab, b), pedida, zona))
+      necesarios.push_back(b);
+  }
+  if (bloquesLeidos)
+    *bloquesLeidos = necesarios.size();
+
+  std::atomic<size_t> siguiente{ 0 };
+  std::atomic<bool>   correcto{ true };
+  auto                trabajador = [&]() {
+    std::ifstream          is(fichero, std::ios::binary);
+    std::vector<Bytef>     datos;
+    std::vector<PixelType> bloque;
+    for (size_t k = siguiente++; k < necesarios.size() && correcto; k = siguiente++)
+    {
+      const std::uint64_t b = necesarios[k];
+      const Entrada&      e = tabla[b];
+      const detalle::Caja caja = detalle::cajaBloque(cab, b);
+      bloque.resize(static_cast<size_t>(caja.tam[0] * caja.tam[1] * caja.tam[2]));
+      const uLong bytesCrudos = static_cast<uLong>(bloque.size() * sizeof(PixelType));
+
+      datos.resize(e.bytes);
+      is.seekg(static_cast<std::streamoff>(e.desplazamiento));
+      if (!is.read(reinterpret_cast<char*>(datos.data()), e.bytes))
+      {
+        correcto = false;
+        break;
+      }
+      if (e.comprimido)
+      {
+        uLongf bytes = bytesCrudos;
+        if (uncompress(reinterpret_cast<Bytef*>(bloque.data()), &bytes, datos.data(), e.bytes) != Z_OK ||
+            bytes != bytesCrudos)
+        {
+          correcto = false;
+          break;
+        }
+      }
+      else if (e.bytes == bytesCrudos)
+        std::memcpy(bloque.data(), datos.data(), bytesCrudos);
+      else
+      {
+        correcto = false;
+        break;
+      }
+
+      detalle::Caja zona;
+      detalle::intersecar(caja, pedida, zona);
+      detalle::copiarCaja(bloque.data(), caja, buffer, pedida, zona);
+    }
+  };
+
+  std::vector<std::thread> hilos;
+  const unsigned int       n = detalle::hilos(numHilos, necesarios.size());
+  for (unsigned int h = 0; h < n; ++h)
+    hilos.emplace_back(trabajador);
+  for (auto& hilo : hilos)
+    hilo.join();
+  if (!correcto)
+    itkGenericExceptionMacro(<< "Error leyendo los bloques de " << fichero);
+  return imagen;
+}
+
+// Lee el volumen completo (todos los bloques, en paralelo).
+template <typename TImage>
+typename TImage::Pointer Leer(const std::string& fichero, unsigned int numHilos = 0)
+{
+  Cabecera             cab;
+  std::vector<Entrada> tabla;
+  LeerInformacion(fichero, cab, tabla);
+  typename TImage::RegionType region;
+  typename TImage::SizeType   tam;
+  for (unsigned int i = 0; i < 3; ++i)
+    tam[i] = cab.dims[i];
+  region.SetSize(tam);
+  return LeerRegion<TImage>(fichero, region, numHilos);
+}
+
+// true si 'fichero' tiene la extensión del formato por bloques
+inline bool EsFicheroBloques(const std::string& fichero)
+{
+  return itksys::SystemTools::LowerCase(itksys::SystemTools::GetFilenameLastExtension(fichero)) == ".blq";
+}
+
+} // namespace volumenBloques
+
+#endif